@@ -60,16 +60,55 @@
 #include "mpl2parse.h"
 #include "qttextparse.h"
 #include "ttmlparse.h"
+#include "textencoding.h"
+#include "scenefile.h"
 
 GST_DEBUG_CATEGORY (ttml_parse_debug);
 
 #define DEFAULT_ENCODING   NULL
+#define DEFAULT_RESULT_CACHE_SIZE (4 * 1024 * 1024)
+#define DEFAULT_PARALLEL FALSE
+#define DEFAULT_MAX_DEPTH 64
+#define DEFAULT_MAX_REGIONS 64
+#define DEFAULT_MAX_ELEMENTS 100000
+#define DEFAULT_MAX_SCENES 100000
+#define DEFAULT_PARSE_TIME_BUDGET 0
+#define DEFAULT_SCENE_CACHE FALSE
+#define DEFAULT_SCENE_CACHE_DIR NULL
+
+/* The number of bytes of text that must have been read from textbuf before
+ * it is moved down over them. */
+#define TEXTBUF_COMPACT_THRESHOLD (64 * 1024)
+
+/* The maximum size of the scenes kept in the scene index; a stream with more
+ * is not indexed, so that a live stream does not grow it without bound. */
+#define SCENE_INDEX_MAX_BYTES (16 * 1024 * 1024)
+
+/* The minimum number of bytes of input between checkpoints in the line
+ * index. */
+#define LINE_INDEX_INTERVAL (16 * 1024)
+
+/* The number of bytes at the start of the input from which its format is
+ * detected. */
+#define FORMAT_DETECT_LEN 35
 
 enum
 {
   PROP_0,
   PROP_ENCODING,
-  PROP_VIDEOFPS
+  PROP_VIDEOFPS,
+  PROP_RESULT_CACHE_SIZE,
+  PROP_RESULT_CACHE_HITS,
+  PROP_RESULT_CACHE_MISSES,
+  PROP_PARALLEL,
+  PROP_MAX_DEPTH,
+  PROP_MAX_REGIONS,
+  PROP_MAX_ELEMENTS,
+  PROP_MAX_SCENES,
+  PROP_PARSE_TIME_BUDGET,
+  PROP_LOCATION,
+  PROP_SCENE_CACHE,
+  PROP_SCENE_CACHE_DIR
 };
 
 
@@ -112,6 +151,11 @@ static gboolean gst_ttml_parse_src_query (GstPad * pad, GstObject * parent,
     GstQuery * query);
 static gboolean gst_ttml_parse_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
+static gboolean gst_ttml_parse_src_activate_mode (GstPad * pad,
+    GstObject * parent, GstPadMode mode, gboolean active);
+static void gst_ttml_parse_read_location (GstTtmlParse * self);
+static void gst_ttml_parse_push_scene_index (GstTtmlParse * self);
+static void feed_textbuf (GstTtmlParse * self);
 
 static GstStateChangeReturn gst_ttml_parse_change_state (GstElement * element,
     GstStateChange transition);
@@ -122,6 +166,407 @@ static GstFlowReturn gst_ttml_parse_chain (GstPad * sinkpad, GstObject * parent,
 #define gst_ttml_parse_parent_class parent_class
 G_DEFINE_TYPE (GstTtmlParse, gst_ttml_parse, GST_TYPE_ELEMENT);
 
+/*
+ * Result cache.
+ */
+
+/* The scenes of a TTML document, kept so that they can be pushed again
+ * without re-parsing the document should it be received again. The scenes
+ * depend only on the text of the document (which also gives its cell
+ * resolution) and on its timing, which is used for regions whose background
+ * is always shown; together these form the key. Scene times are taken from
+ * the document itself, so cached buffers are pushed again unchanged. */
+typedef struct
+{
+  guint hash;
+  GBytes *text;
+  GstClockTime begin;
+  GstClockTime duration;
+  GList *buffers;
+  guint64 size;
+} GstTtmlParseCacheEntry;
+
+static guint
+result_cache_entry_hash (gconstpointer key)
+{
+  return ((const GstTtmlParseCacheEntry *) key)->hash;
+}
+
+static gboolean
+result_cache_entry_equal (gconstpointer a, gconstpointer b)
+{
+  const GstTtmlParseCacheEntry *e1 = a;
+  const GstTtmlParseCacheEntry *e2 = b;
+
+  return e1->hash == e2->hash && e1->begin == e2->begin
+      && e1->duration == e2->duration && g_bytes_equal (e1->text, e2->text);
+}
+
+static void
+result_cache_entry_free (GstTtmlParseCacheEntry * entry)
+{
+  g_bytes_unref (entry->text);
+  g_list_free_full (entry->buffers, (GDestroyNotify) gst_buffer_unref);
+  g_slice_free (GstTtmlParseCacheEntry, entry);
+}
+
+/* Evict the least recently used entries from the cache until it holds no
+ * more than @max_bytes. */
+static void
+result_cache_trim (GstTtmlParse * self, guint64 max_bytes)
+{
+  while (self->result_cache_bytes > max_bytes) {
+    GstTtmlParseCacheEntry *entry = g_queue_pop_tail (&self->result_cache);
+
+    g_hash_table_remove (self->result_cache_index, entry);
+    self->result_cache_bytes -= entry->size;
+    result_cache_entry_free (entry);
+  }
+}
+
+/* Returns a list of new references to the buffers carrying the scenes of
+ * the document with text @text and the given timing, or NULL if the
+ * document is not in the cache. */
+static GList *
+result_cache_lookup (GstTtmlParse * self, GBytes * text, guint hash,
+    GstClockTime begin, GstClockTime duration)
+{
+  GstTtmlParseCacheEntry key;
+  GList *link;
+
+  key.hash = hash;
+  key.text = text;
+  key.begin = begin;
+  key.duration = duration;
+
+  link = g_hash_table_lookup (self->result_cache_index, &key);
+  if (!link)
+    return NULL;
+
+  g_queue_unlink (&self->result_cache, link);
+  g_queue_push_head_link (&self->result_cache, link);
+  return g_list_copy_deep (((GstTtmlParseCacheEntry *) link->data)->buffers,
+      (GCopyFunc) gst_buffer_ref, NULL);
+}
+
+/* Add to the cache the buffers, @buffers, carrying the scenes of the
+ * document with text @text and the given timing, evicting entries as
+ * needed to keep the cache within @max_bytes. The cache keeps its own copy
+ * of @text. */
+static void
+result_cache_insert (GstTtmlParse * self, GBytes * text, guint hash,
+    GstClockTime begin, GstClockTime duration, GList * buffers,
+    guint64 max_bytes)
+{
+  GstTtmlParseCacheEntry *entry = g_slice_new0 (GstTtmlParseCacheEntry);
+  GList *buffer;
+
+  entry->hash = hash;
+  entry->text = text;
+  entry->begin = begin;
+  entry->duration = duration;
+  entry->size = g_bytes_get_size (text);
+  for (buffer = buffers; buffer; buffer = buffer->next)
+    entry->size += gst_buffer_get_size (buffer->data);
+
+  if (entry->size > max_bytes
+      || g_hash_table_contains (self->result_cache_index, entry)) {
+    g_slice_free (GstTtmlParseCacheEntry, entry);
+    return;
+  }
+
+  entry->text = g_bytes_new (g_bytes_get_data (text, NULL),
+      g_bytes_get_size (text));
+  entry->buffers = g_list_copy_deep (buffers, (GCopyFunc) gst_buffer_ref,
+      NULL);
+  g_queue_push_head (&self->result_cache, entry);
+  g_hash_table_insert (self->result_cache_index, entry,
+      self->result_cache.head);
+  self->result_cache_bytes += entry->size;
+  result_cache_trim (self, max_bytes);
+
+  GST_DEBUG_OBJECT (self, "Cached %u scenes of %" G_GSIZE_FORMAT "-byte "
+      "document; cache now holds %u documents in %" G_GUINT64_FORMAT
+      " bytes", g_list_length (buffers), g_bytes_get_size (text),
+      g_queue_get_length (&self->result_cache), self->result_cache_bytes);
+}
+
+/*
+ * Scene index.
+ */
+
+/* A scene output for the TTML input. max_end is the latest end time of this
+ * scene and all those before it in the index, which, unlike the end times
+ * themselves, never decreases and so can be searched. */
+typedef struct
+{
+  GstBuffer *buffer;
+  GstClockTime end;
+  GstClockTime max_end;
+} GstTtmlParseIndexEntry;
+
+static void
+scene_index_entry_clear (GstTtmlParseIndexEntry * entry)
+{
+  gst_buffer_unref (entry->buffer);
+}
+
+/* Forget the scenes recorded so far and start recording afresh. */
+static void
+scene_index_reset (GstTtmlParse * self)
+{
+  g_array_set_size (self->scene_index, 0);
+  self->scene_index_bytes = 0;
+  self->scene_index_valid = TRUE;
+  self->scene_index_complete = FALSE;
+}
+
+/* Stop recording scenes; seeks fall back to reading the input again. */
+static void
+scene_index_invalidate (GstTtmlParse * self)
+{
+  if (self->scene_index_valid)
+    GST_DEBUG_OBJECT (self, "scene index invalidated");
+  g_array_set_size (self->scene_index, 0);
+  self->scene_index_bytes = 0;
+  self->scene_index_valid = FALSE;
+  self->scene_index_complete = FALSE;
+}
+
+/* Record @buffer, a scene about to be pushed downstream. */
+static void
+scene_index_add (GstTtmlParse * self, GstBuffer * buffer)
+{
+  GstTtmlParseIndexEntry entry;
+
+  if (!self->scene_index_valid || self->scene_index_complete)
+    return;
+
+  self->scene_index_bytes += gst_buffer_get_size (buffer);
+  if (!GST_BUFFER_PTS_IS_VALID (buffer)
+      || self->scene_index_bytes > SCENE_INDEX_MAX_BYTES) {
+    scene_index_invalidate (self);
+    return;
+  }
+
+  entry.buffer = gst_buffer_ref (buffer);
+  entry.end = GST_BUFFER_PTS (buffer);
+  if (GST_BUFFER_DURATION_IS_VALID (buffer))
+    entry.end += GST_BUFFER_DURATION (buffer);
+  else
+    entry.end = GST_CLOCK_TIME_NONE;
+  g_array_append_val (self->scene_index, entry);
+}
+
+static gint
+scene_index_entry_compare (gconstpointer a, gconstpointer b)
+{
+  GstClockTime t1 = GST_BUFFER_PTS (((GstTtmlParseIndexEntry *) a)->buffer);
+  GstClockTime t2 = GST_BUFFER_PTS (((GstTtmlParseIndexEntry *) b)->buffer);
+
+  return t1 < t2 ? -1 : (t1 > t2 ? 1 : 0);
+}
+
+/* Called once all of the input has been received: sort the scenes recorded
+ * so that seeks can be served from them. */
+static void
+scene_index_finish (GstTtmlParse * self)
+{
+  GstClockTime max_end = 0;
+  guint i;
+
+  if (!self->scene_index_valid || self->scene_index_complete
+      || self->parser_type != GST_TTML_PARSE_FORMAT_TTML
+      || self->in_ttml_document)
+    return;
+
+  /* The scenes of successive documents are normally already in order. */
+  g_array_sort (self->scene_index, scene_index_entry_compare);
+
+  for (i = 0; i < self->scene_index->len; ++i) {
+    GstTtmlParseIndexEntry *entry = &g_array_index (self->scene_index,
+        GstTtmlParseIndexEntry, i);
+
+    /* GST_CLOCK_TIME_NONE, an open-ended scene, compares greatest. */
+    max_end = MAX (max_end, entry->end);
+    entry->max_end = max_end;
+  }
+
+  self->scene_index_complete = TRUE;
+  GST_DEBUG_OBJECT (self, "scene index holds %u scenes",
+      self->scene_index->len);
+}
+
+/* Returns the index of the first scene that ends after @time, or the number
+ * of scenes if there is none. */
+static guint
+scene_index_find (GstTtmlParse * self, GstClockTime time)
+{
+  guint lo = 0, hi = self->scene_index->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (self->scene_index, GstTtmlParseIndexEntry,
+            mid).max_end > time)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+
+  return lo;
+}
+
+/*
+ * Line index.
+ */
+
+/* A checkpoint in input in a line-based format. max_end never decreases from
+ * one entry to the next, so the index can be searched on it. The parser state
+ * keeps its own copy of the text of any pending subtitle; its segment and
+ * user_data are unused. */
+typedef struct
+{
+  guint64 offset;
+  GstClockTime max_end;
+  ParserState state;
+} GstTtmlParseLineIndexEntry;
+
+static void
+line_index_entry_clear (GstTtmlParseLineIndexEntry * entry)
+{
+  g_string_free (entry->state.buf, TRUE);
+}
+
+static void
+line_index_reset (GstTtmlParse * self)
+{
+  GST_OBJECT_LOCK (self);
+  g_array_set_size (self->line_index, 0);
+  self->line_index_pending = -1;
+  GST_OBJECT_UNLOCK (self);
+  self->line_index_building = TRUE;
+  self->line_index_max_end = 0;
+}
+
+/* Note that a subtitle ending at @end has been output. */
+static void
+line_index_add_subtitle (GstTtmlParse * self, GstClockTime end)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (end))
+    self->line_index_max_end = GST_CLOCK_TIME_NONE;
+  else if (GST_CLOCK_TIME_IS_VALID (self->line_index_max_end))
+    self->line_index_max_end = MAX (self->line_index_max_end, end);
+}
+
+/* Returns TRUE if checkpoints can be taken in the current input: it must be
+ * in a format whose parser keeps all its state in ParserState, the text in
+ * textbuf must be the input itself, so that positions in it map onto byte
+ * offsets, and no subtitle may have been dropped for being outside the
+ * segment. */
+static gboolean
+line_index_can_add (GstTtmlParse * self)
+{
+  switch (self->parser_type) {
+    case GST_TTML_PARSE_FORMAT_MDVDSUB:
+    case GST_TTML_PARSE_FORMAT_SUBRIP:
+    case GST_TTML_PARSE_FORMAT_TMPLAYER:
+    case GST_TTML_PARSE_FORMAT_MPL2:
+    case GST_TTML_PARSE_FORMAT_SUBVIEWER:
+    case GST_TTML_PARSE_FORMAT_DKS:
+    case GST_TTML_PARSE_FORMAT_LRC:
+      break;
+    default:
+      return FALSE;
+  }
+
+  return self->line_index_building && self->valid_utf8
+      && !self->detected_encoding && self->segment.start == 0
+      && !GST_CLOCK_TIME_IS_VALID (self->segment.stop);
+}
+
+/* Take a checkpoint at the line of textbuf about to be read, if the last one
+ * is far enough behind it. */
+static void
+line_index_add (GstTtmlParse * self)
+{
+  GstTtmlParseLineIndexEntry entry;
+  guint64 offset;
+
+  if (!line_index_can_add (self)) {
+    self->line_index_building = FALSE;
+    return;
+  }
+
+  offset = self->offset - gst_adapter_available (self->adapter)
+      - (self->textbuf->len - self->textbuf_pos);
+
+  if (self->line_index->len > 0) {
+    GstTtmlParseLineIndexEntry *last = &g_array_index (self->line_index,
+        GstTtmlParseLineIndexEntry, self->line_index->len - 1);
+
+    if (offset < last->offset + LINE_INDEX_INTERVAL)
+      return;
+  } else if (offset < LINE_INDEX_INTERVAL) {
+    return;
+  }
+
+  entry.offset = offset;
+  entry.max_end = self->line_index_max_end;
+  entry.state = self->state;
+  entry.state.buf = g_string_new_len (self->state.buf->str,
+      self->state.buf->len);
+  entry.state.segment = NULL;
+  entry.state.user_data = NULL;
+  /* the index is searched from the application thread on seeks */
+  GST_OBJECT_LOCK (self);
+  g_array_append_val (self->line_index, entry);
+  GST_OBJECT_UNLOCK (self);
+
+  GST_LOG_OBJECT (self, "checkpoint at byte %" G_GUINT64_FORMAT " after "
+      "subtitles ending by %" GST_TIME_FORMAT, offset,
+      GST_TIME_ARGS (entry.max_end));
+}
+
+/* Returns the last checkpoint before which every subtitle output ends no
+ * later than @time, or -1 if there is none. Must be called with the object
+ * lock held. */
+static gint
+line_index_find (GstTtmlParse * self, GstClockTime time)
+{
+  guint lo = 0, hi = self->line_index->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (g_array_index (self->line_index, GstTtmlParseLineIndexEntry,
+            mid).max_end <= time)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return (gint) lo - 1;
+}
+
+/* Restore the parser state saved at @entry. */
+static void
+line_index_restore (GstTtmlParse * self,
+    const GstTtmlParseLineIndexEntry * entry)
+{
+  ParserState *state = &self->state;
+  GString *buf = state->buf;
+
+  *state = entry->state;
+  state->buf = buf;
+  state->segment = NULL;
+  state->user_data = NULL;
+  g_string_assign (buf, entry->state.buf->str);
+
+  GST_DEBUG_OBJECT (self, "resuming from checkpoint at byte %"
+      G_GUINT64_FORMAT, entry->offset);
+}
+
 static void
 gst_ttml_parse_dispose (GObject * object)
 {
@@ -139,6 +584,26 @@ gst_ttml_parse_dispose (GObject * object)
     ttmlparse->detected_encoding = NULL;
   }
 
+  if (ttmlparse->location) {
+    g_free (ttmlparse->location);
+    ttmlparse->location = NULL;
+  }
+
+  if (ttmlparse->scene_cache_dir) {
+    g_free (ttmlparse->scene_cache_dir);
+    ttmlparse->scene_cache_dir = NULL;
+  }
+
+  if (ttmlparse->scene_source) {
+    scene_file_source_free (ttmlparse->scene_source);
+    ttmlparse->scene_source = NULL;
+  }
+
+  if (ttmlparse->scene_file) {
+    g_free (ttmlparse->scene_file);
+    ttmlparse->scene_file = NULL;
+  }
+
   if (ttmlparse->adapter) {
     g_object_unref (ttmlparse->adapter);
     ttmlparse->adapter = NULL;
@@ -149,6 +614,32 @@ gst_ttml_parse_dispose (GObject * object)
     ttmlparse->textbuf = NULL;
   }
 
+  if (ttmlparse->ttml_parser) {
+    ttml_parser_free (ttmlparse->ttml_parser);
+    ttmlparse->ttml_parser = NULL;
+  }
+
+  if (ttmlparse->head_cache) {
+    ttml_head_cache_free (ttmlparse->head_cache);
+    ttmlparse->head_cache = NULL;
+  }
+
+  if (ttmlparse->scene_index) {
+    g_array_free (ttmlparse->scene_index, TRUE);
+    ttmlparse->scene_index = NULL;
+  }
+
+  if (ttmlparse->line_index) {
+    g_array_free (ttmlparse->line_index, TRUE);
+    ttmlparse->line_index = NULL;
+  }
+
+  if (ttmlparse->result_cache_index) {
+    result_cache_trim (ttmlparse, 0);
+    g_hash_table_destroy (ttmlparse->result_cache_index);
+    ttmlparse->result_cache_index = NULL;
+  }
+
   GST_CALL_PARENT (G_OBJECT_CLASS, dispose, (object));
 }
 
@@ -190,6 +681,90 @@ gst_ttml_parse_class_init (GstTtmlParseClass * klass)
           "and the subtitle format requires it subtitles may be out of sync.",
           0, 1, G_MAXINT, 1, 24000, 1001,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_RESULT_CACHE_SIZE,
+      g_param_spec_uint64 ("result-cache-size", "Result cache size",
+          "Maximum number of bytes of TTML documents, and of the text of "
+          "their scenes, to keep so that documents that are received again "
+          "need not be re-parsed. 0 disables the cache.",
+          0, G_MAXUINT64, DEFAULT_RESULT_CACHE_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_RESULT_CACHE_HITS,
+      g_param_spec_uint64 ("result-cache-hits", "Result cache hits",
+          "Number of TTML documents whose scenes were taken from the result "
+          "cache.", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_RESULT_CACHE_MISSES,
+      g_param_spec_uint64 ("result-cache-misses", "Result cache misses",
+          "Number of TTML documents that were looked up in the result cache "
+          "but not found.", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_PARALLEL,
+      g_param_spec_boolean ("parallel", "Parallel",
+          "Process the regions and scenes of TTML documents concurrently, "
+          "using a thread pool shared by all instances of the element.",
+          DEFAULT_PARALLEL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_DEPTH,
+      g_param_spec_uint ("max-depth", "Maximum depth",
+          "Maximum depth to which elements of a TTML document may be nested; "
+          "more deeply nested elements are ignored. 0 means no limit.",
+          0, G_MAXUINT, DEFAULT_MAX_DEPTH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_REGIONS,
+      g_param_spec_uint ("max-regions", "Maximum regions",
+          "Maximum number of regions of a TTML document; further regions are "
+          "ignored. 0 means no limit.",
+          0, G_MAXUINT, DEFAULT_MAX_REGIONS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_ELEMENTS,
+      g_param_spec_uint ("max-elements", "Maximum elements",
+          "Maximum number of elements, including runs of text, in the body "
+          "of a TTML document; the rest of the body is ignored. 0 means no "
+          "limit.", 0, G_MAXUINT, DEFAULT_MAX_ELEMENTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_MAX_SCENES,
+      g_param_spec_uint ("max-scenes", "Maximum scenes",
+          "Maximum number of scenes output for a TTML document. 0 means no "
+          "limit.", 0, G_MAXUINT, DEFAULT_MAX_SCENES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_PARSE_TIME_BUDGET,
+      g_param_spec_uint ("parse-time-budget", "Parse time budget",
+          "Maximum time, in milliseconds, to spend parsing a TTML document "
+          "and building its scenes, not counting time spent waiting for "
+          "input or pushing output; the rest of the document is ignored once "
+          "it has run out. 0 means no limit.",
+          0, G_MAXUINT, DEFAULT_PARSE_TIME_BUDGET,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_LOCATION,
+      g_param_spec_string ("location", "File location",
+          "Subtitle file to read directly, rather than taking input from the "
+          "sink pad. The file is memory-mapped and parsed in place.", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS
+          | GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (object_class, PROP_SCENE_CACHE,
+      g_param_spec_boolean ("scene-cache", "Scene cache",
+          "Save the scenes of TTML files in scene files, from which they are "
+          "read back, rather than the TTML file being parsed again, when the "
+          "same file is next opened. Applies when reading from a file, either "
+          "directly or through an upstream element that can report its URI.",
+          DEFAULT_SCENE_CACHE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (object_class, PROP_SCENE_CACHE_DIR,
+      g_param_spec_string ("scene-cache-dir", "Scene cache directory",
+          "Directory in which to keep scene files. If not set, the scene file "
+          "of a TTML file is kept next to it, with \".scenes\" appended to its "
+          "name.", DEFAULT_SCENE_CACHE_DIR,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -207,6 +782,8 @@ gst_ttml_parse_init (GstTtmlParse * ttmlparse)
       GST_DEBUG_FUNCPTR (gst_ttml_parse_src_event));
   gst_pad_set_query_function (ttmlparse->srcpad,
       GST_DEBUG_FUNCPTR (gst_ttml_parse_src_query));
+  gst_pad_set_activatemode_function (ttmlparse->srcpad,
+      GST_DEBUG_FUNCPTR (gst_ttml_parse_src_activate_mode));
   gst_element_add_pad (GST_ELEMENT (ttmlparse), ttmlparse->srcpad);
 
   ttmlparse->textbuf = g_string_new (NULL);
@@ -217,6 +794,29 @@ gst_ttml_parse_init (GstTtmlParse * ttmlparse)
   ttmlparse->encoding = g_strdup (DEFAULT_ENCODING);
   ttmlparse->detected_encoding = NULL;
   ttmlparse->adapter = gst_adapter_new ();
+  ttmlparse->head_cache = ttml_head_cache_new ();
+  ttmlparse->scene_index = g_array_new (FALSE, FALSE,
+      sizeof (GstTtmlParseIndexEntry));
+  g_array_set_clear_func (ttmlparse->scene_index,
+      (GDestroyNotify) scene_index_entry_clear);
+  ttmlparse->scene_index_valid = TRUE;
+  ttmlparse->line_index = g_array_new (FALSE, FALSE,
+      sizeof (GstTtmlParseLineIndexEntry));
+  g_array_set_clear_func (ttmlparse->line_index,
+      (GDestroyNotify) line_index_entry_clear);
+  ttmlparse->line_index_pending = -1;
+  g_queue_init (&ttmlparse->result_cache);
+  ttmlparse->result_cache_index = g_hash_table_new (result_cache_entry_hash,
+      result_cache_entry_equal);
+  ttmlparse->result_cache_max_bytes = DEFAULT_RESULT_CACHE_SIZE;
+  ttmlparse->parallel = DEFAULT_PARALLEL;
+  ttmlparse->max_depth = DEFAULT_MAX_DEPTH;
+  ttmlparse->max_regions = DEFAULT_MAX_REGIONS;
+  ttmlparse->max_elements = DEFAULT_MAX_ELEMENTS;
+  ttmlparse->max_scenes = DEFAULT_MAX_SCENES;
+  ttmlparse->parse_time_budget = DEFAULT_PARSE_TIME_BUDGET;
+  ttmlparse->scene_cache = DEFAULT_SCENE_CACHE;
+  ttmlparse->scene_cache_dir = g_strdup (DEFAULT_SCENE_CACHE_DIR);
 
   ttmlparse->fps_n = 24000;
   ttmlparse->fps_d = 1001;
@@ -255,7 +855,12 @@ gst_ttml_parse_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
       ret = TRUE;
 
       gst_query_parse_seeking (query, &fmt, NULL, NULL, NULL);
-      if (fmt == GST_FORMAT_TIME) {
+      if (fmt == GST_FORMAT_TIME
+          && (self->scene_index_complete || self->location)) {
+        /* seeks are served from the scene index or by reading the file
+         * again from the start */
+        seekable = TRUE;
+      } else if (fmt == GST_FORMAT_TIME) {
         GstQuery *peerquery = gst_query_new_seeking (GST_FORMAT_BYTES);
 
         seekable = gst_pad_peer_query (self->sinkpad, peerquery);
@@ -275,6 +880,49 @@ gst_ttml_parse_src_query (GstPad * pad, GstObject * parent, GstQuery * query)
   return ret;
 }
 
+/* Seek without involving upstream: stop any task running on the source pad,
+ * apply the seek to our segment and start @func as the task that outputs the
+ * new segment. That is either gst_ttml_parse_push_scene_index(), which pushes
+ * the scenes overlapping the segment from the scene index, or, when reading
+ * from a file, gst_ttml_parse_read_location(), which reads the file again
+ * from checkpoint @line_index_entry of the line index, or from the start if
+ * that is -1, throwing away any text before the requested position. */
+static gboolean
+gst_ttml_parse_seek_in_task (GstTtmlParse * self, GstTaskFunction func,
+    gint line_index_entry, gdouble rate, GstFormat format, GstSeekFlags flags,
+    GstSeekType start_type, gint64 start, GstSeekType stop_type, gint64 stop)
+{
+  gboolean flush = (flags & GST_SEEK_FLAG_FLUSH) != 0;
+  gboolean update;
+
+  if (flush)
+    gst_pad_push_event (self->srcpad, gst_event_new_flush_start ());
+  else
+    gst_pad_pause_task (self->srcpad);
+
+  /* wait for the streaming thread to stop */
+  GST_PAD_STREAM_LOCK (self->srcpad);
+
+  if (flush)
+    gst_pad_push_event (self->srcpad, gst_event_new_flush_stop (TRUE));
+
+  gst_segment_do_seek (&self->segment, rate, format, flags,
+      start_type, start, stop_type, stop, &update);
+  GST_DEBUG_OBJECT (self, "segment after seek: %" GST_SEGMENT_FORMAT,
+      &self->segment);
+  GST_OBJECT_LOCK (self);
+  self->need_segment = TRUE;
+  self->line_index_building = FALSE;
+  self->line_index_pending = line_index_entry;
+  GST_OBJECT_UNLOCK (self);
+
+  gst_pad_start_task (self->srcpad, func, self, NULL);
+
+  GST_PAD_STREAM_UNLOCK (self->srcpad);
+
+  return TRUE;
+}
+
 static gboolean
 gst_ttml_parse_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
 {
@@ -292,6 +940,10 @@ gst_ttml_parse_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
       gint64 start, stop;
       gdouble rate;
       gboolean update;
+      gint entry = -1;
+      guint64 byte_offset = 0;
+      GstSegment old_segment;
+      gboolean old_need_segment, old_building;
 
       gst_event_parse_seek (event, &rate, &format, &flags,
           &start_type, &start, &stop_type, &stop);
@@ -302,23 +954,58 @@ gst_ttml_parse_src_event (GstPad * pad, GstObject * parent, GstEvent * event)
         goto beach;
       }
 
-      /* Convert that seek to a seeking in bytes at position 0,
-         FIXME: could use an index */
+      /* Reading resumes from the last checkpoint before which no subtitle
+       * overlaps the new segment, or else from the start */
+      GST_OBJECT_LOCK (self);
+      if (rate > 0.0 && start_type == GST_SEEK_TYPE_SET)
+        entry = line_index_find (self, start);
+      if (entry >= 0)
+        byte_offset = g_array_index (self->line_index,
+            GstTtmlParseLineIndexEntry, entry).offset;
+      GST_OBJECT_UNLOCK (self);
+
+      if (self->scene_index_complete || self->location) {
+        GstTaskFunction func = self->scene_index_complete ?
+            (GstTaskFunction) gst_ttml_parse_push_scene_index :
+            (GstTaskFunction) gst_ttml_parse_read_location;
+
+        ret = gst_ttml_parse_seek_in_task (self, func, entry, rate, format,
+            flags, start_type, start, stop_type, stop);
+        gst_event_unref (event);
+        break;
+      }
+
+      /* Apply the seek to our segment, and note where reading resumes,
+       * before converting it to a seek in bytes: upstream may push the data
+       * from the new position from its streaming thread before the seek
+       * event returns. */
+      GST_OBJECT_LOCK (self);
+      old_segment = self->segment;
+      old_need_segment = self->need_segment;
+      old_building = self->line_index_building;
+      gst_segment_do_seek (&self->segment, rate, format, flags,
+          start_type, start, stop_type, stop, &update);
+      self->need_segment = TRUE;
+      self->line_index_building = FALSE;
+      self->line_index_pending = entry;
+      GST_OBJECT_UNLOCK (self);
+
       ret = gst_pad_push_event (self->sinkpad,
           gst_event_new_seek (rate, GST_FORMAT_BYTES, flags,
-              GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_NONE, 0));
+              GST_SEEK_TYPE_SET, byte_offset, GST_SEEK_TYPE_NONE, 0));
 
       if (ret) {
-        /* Apply the seek to our segment */
-        gst_segment_do_seek (&self->segment, rate, format, flags,
-            start_type, start, stop_type, stop, &update);
-
         GST_DEBUG_OBJECT (self, "segment after seek: %" GST_SEGMENT_FORMAT,
             &self->segment);
-
-        self->need_segment = TRUE;
       } else {
-        GST_WARNING_OBJECT (self, "seek to 0 bytes failed");
+        GST_WARNING_OBJECT (self, "seek to %" G_GUINT64_FORMAT " bytes failed",
+            byte_offset);
+        GST_OBJECT_LOCK (self);
+        self->segment = old_segment;
+        self->need_segment = old_need_segment;
+        self->line_index_building = old_building;
+        self->line_index_pending = -1;
+        GST_OBJECT_UNLOCK (self);
       }
 
       gst_event_unref (event);
@@ -360,6 +1047,49 @@ gst_ttml_parse_set_property (GObject * object, guint prop_id,
       }
       break;
     }
+    case PROP_RESULT_CACHE_SIZE:
+      /* Takes effect when the next document is added to the cache. */
+      ttmlparse->result_cache_max_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_PARALLEL:
+      /* Takes effect from the next document. */
+      ttmlparse->parallel = g_value_get_boolean (value);
+      break;
+    /* Limits take effect from the next document. */
+    case PROP_MAX_DEPTH:
+      ttmlparse->max_depth = g_value_get_uint (value);
+      break;
+    case PROP_MAX_REGIONS:
+      ttmlparse->max_regions = g_value_get_uint (value);
+      break;
+    case PROP_MAX_ELEMENTS:
+      ttmlparse->max_elements = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SCENES:
+      ttmlparse->max_scenes = g_value_get_uint (value);
+      break;
+    case PROP_PARSE_TIME_BUDGET:
+      ttmlparse->parse_time_budget = g_value_get_uint (value);
+      break;
+    /* The scene cache settings take effect from the next stream. */
+    case PROP_SCENE_CACHE:
+      ttmlparse->scene_cache = g_value_get_boolean (value);
+      break;
+    case PROP_SCENE_CACHE_DIR:
+      g_free (ttmlparse->scene_cache_dir);
+      ttmlparse->scene_cache_dir = g_value_dup_string (value);
+      break;
+    case PROP_LOCATION:
+      if (GST_STATE (ttmlparse) > GST_STATE_READY) {
+        GST_WARNING_OBJECT (object, "location can only be changed in the NULL "
+            "or READY state");
+        break;
+      }
+      g_free (ttmlparse->location);
+      ttmlparse->location = g_value_dup_string (value);
+      GST_LOG_OBJECT (object, "location set to %s",
+          GST_STR_NULL (ttmlparse->location));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -381,6 +1111,42 @@ gst_ttml_parse_get_property (GObject * object, guint prop_id,
     case PROP_VIDEOFPS:
       gst_value_set_fraction (value, ttmlparse->fps_n, ttmlparse->fps_d);
       break;
+    case PROP_RESULT_CACHE_SIZE:
+      g_value_set_uint64 (value, ttmlparse->result_cache_max_bytes);
+      break;
+    case PROP_RESULT_CACHE_HITS:
+      g_value_set_uint64 (value, ttmlparse->result_cache_hits);
+      break;
+    case PROP_RESULT_CACHE_MISSES:
+      g_value_set_uint64 (value, ttmlparse->result_cache_misses);
+      break;
+    case PROP_PARALLEL:
+      g_value_set_boolean (value, ttmlparse->parallel);
+      break;
+    case PROP_MAX_DEPTH:
+      g_value_set_uint (value, ttmlparse->max_depth);
+      break;
+    case PROP_MAX_REGIONS:
+      g_value_set_uint (value, ttmlparse->max_regions);
+      break;
+    case PROP_MAX_ELEMENTS:
+      g_value_set_uint (value, ttmlparse->max_elements);
+      break;
+    case PROP_MAX_SCENES:
+      g_value_set_uint (value, ttmlparse->max_scenes);
+      break;
+    case PROP_PARSE_TIME_BUDGET:
+      g_value_set_uint (value, ttmlparse->parse_time_budget);
+      break;
+    case PROP_LOCATION:
+      g_value_set_string (value, ttmlparse->location);
+      break;
+    case PROP_SCENE_CACHE:
+      g_value_set_boolean (value, ttmlparse->scene_cache);
+      break;
+    case PROP_SCENE_CACHE_DIR:
+      g_value_set_string (value, ttmlparse->scene_cache_dir);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -447,25 +1213,7 @@ gst_convert_to_utf8 (const gchar * str, gsize len, const gchar * encoding,
 static gchar *
 detect_encoding (const gchar * str, gsize len)
 {
-  if (len >= 3 && (guint8) str[0] == 0xEF && (guint8) str[1] == 0xBB
-      && (guint8) str[2] == 0xBF)
-    return g_strdup ("UTF-8");
-
-  if (len >= 2 && (guint8) str[0] == 0xFE && (guint8) str[1] == 0xFF)
-    return g_strdup ("UTF-16BE");
-
-  if (len >= 2 && (guint8) str[0] == 0xFF && (guint8) str[1] == 0xFE)
-    return g_strdup ("UTF-16LE");
-
-  if (len >= 4 && (guint8) str[0] == 0x00 && (guint8) str[1] == 0x00
-      && (guint8) str[2] == 0xFE && (guint8) str[3] == 0xFF)
-    return g_strdup ("UTF-32BE");
-
-  if (len >= 4 && (guint8) str[0] == 0xFF && (guint8) str[1] == 0xFE
-      && (guint8) str[2] == 0x00 && (guint8) str[3] == 0x00)
-    return g_strdup ("UTF-32LE");
-
-  return NULL;
+  return g_strdup (text_encoding_detect_bom (str, len));
 }
 
 static gchar *
@@ -495,7 +1243,7 @@ convert_encoding (GstTtmlParse * self, const gchar * str, gsize len,
 
   /* Otherwise check if it's UTF8 */
   if (self->valid_utf8) {
-    if (g_utf8_validate (str, len, NULL)) {
+    if (text_encoding_validate_utf8 (str, len, NULL)) {
       GST_LOG_OBJECT (self, "valid UTF-8, no conversion needed");
       *consumed = len;
       return g_strndup (str, len);
@@ -535,31 +1283,29 @@ convert_encoding (GstTtmlParse * self, const gchar * str, gsize len,
   return ret;
 }
 
-static gchar *
+/* Returns the next complete line of textbuf, without its line ending, or
+ * NULL if there is none. The line is not copied but terminated in place, so
+ * it is valid only until textbuf is next modified. */
+static const gchar *
 get_next_line (GstTtmlParse * self)
 {
-  char *line = NULL;
-  const char *line_end;
-  int line_len;
-  gboolean have_r = FALSE;
+  gchar *line = self->textbuf->str + self->textbuf_pos;
+  gchar *line_end;
 
-  line_end = strchr (self->textbuf->str, '\n');
+  line_end = memchr (line, '\n', self->textbuf->len - self->textbuf_pos);
 
   if (!line_end) {
     /* end-of-line not found; return for more data */
     return NULL;
   }
 
+  self->textbuf_pos = line_end + 1 - self->textbuf->str;
+
   /* get rid of '\r' */
-  if (line_end != self->textbuf->str && *(line_end - 1) == '\r') {
+  if (line_end != line && *(line_end - 1) == '\r')
     line_end--;
-    have_r = TRUE;
-  }
 
-  line_len = line_end - self->textbuf->str;
-  line = g_strndup (self->textbuf->str, line_len);
-  self->textbuf = g_string_erase (self->textbuf, 0,
-      line_len + (have_r ? 2 : 1));
+  *line_end = '\0';
   return line;
 }
 
@@ -1393,18 +2139,76 @@ gst_ttml_parse_data_format_autodetect (gchar * match_str)
   return GST_TTML_PARSE_FORMAT_UNKNOWN;
 }
 
+/* Returns the caps of the output for TTML input. */
+static GstCaps *
+new_ttml_caps (void)
+{
+  GstCaps *caps;
+  GstCapsFeatures *features = gst_caps_features_new ("meta:GstSubtitleMeta",
+      NULL);
+
+  caps = gst_caps_new_empty_simple ("text/x-raw");
+  gst_caps_set_features (caps, 0, features);
+  return caps;
+}
+
+/* Returns TRUE if TTML input may be given to the TTML parser straight from
+ * the adapter's memory: it must be UTF-8, so that it needs no conversion,
+ * and no converted text may be waiting in textbuf. */
+static gboolean
+can_handle_ttml_in_place (GstTtmlParse * self)
+{
+  return self->textbuf->len == 0 && self->valid_utf8
+      && (!self->detected_encoding
+      || g_ascii_strcasecmp (self->detected_encoding, "UTF-8") == 0);
+}
+
+
+/* Returns a copy of the first FORMAT_DETECT_LEN bytes of the input in the
+ * adapter, if they are valid UTF-8 (but for a character cut short at their
+ * end), or else NULL. */
+static gchar *
+peek_format_detect_text (GstTtmlParse * self)
+{
+  gsize len = MIN (gst_adapter_available (self->adapter), FORMAT_DETECT_LEN);
+  const gchar *data, *end;
+  gchar *ret = NULL;
+
+  if (len == 0)
+    return NULL;
+
+  data = (const gchar *) gst_adapter_map (self->adapter, len);
+  if (text_encoding_validate_utf8 (data, len, &end)
+      || g_utf8_get_char_validated (end, len - (end - data)) == (gunichar) - 2)
+    ret = g_strndup (data, end - data);
+  gst_adapter_unmap (self->adapter);
+
+  return ret;
+}
+
+/* Detect the format of the input from its first bytes. UTF-8 input is
+ * detected from those bytes as they are in the adapter, so that TTML input
+ * can then be parsed in place without ever being copied into textbuf; other
+ * input is first converted into textbuf. */
 static GstCaps *
 gst_ttml_parse_format_autodetect (GstTtmlParse * self)
 {
-  gchar *data;
+  gchar *data = NULL;
   GstTtmlParseFormat format;
 
-  if (strlen (self->textbuf->str) < 30) {
+  if (can_handle_ttml_in_place (self))
+    data = peek_format_detect_text (self);
+  if (!data) {
+    feed_textbuf (self);
+    data = g_strndup (self->textbuf->str, FORMAT_DETECT_LEN);
+  }
+
+  if (strlen (data) < 30) {
     GST_DEBUG ("File too small to be a subtitles file");
+    g_free (data);
     return NULL;
   }
 
-  data = g_strndup (self->textbuf->str, 35);
   format = gst_ttml_parse_data_format_autodetect (data);
   g_free (data);
 
@@ -1457,17 +2261,8 @@ gst_ttml_parse_format_autodetect (GstTtmlParse * self)
       return gst_caps_new_simple ("text/x-raw",
           "format", G_TYPE_STRING, "utf8", NULL);
     case GST_TTML_PARSE_FORMAT_TTML:
-    {
-      GstCaps *caps;
-      GstCapsFeatures *features = gst_caps_features_new ("meta:GstSubtitleMeta",
-          NULL);
-
       self->parse_line = NULL;
-
-      caps = gst_caps_new_empty_simple ("text/x-raw");
-      gst_caps_set_features (caps, 0, features);
-      return caps;
-    }
+      return new_ttml_caps ();
 
     case GST_TTML_PARSE_FORMAT_UNKNOWN:
     default:
@@ -1479,13 +2274,10 @@ gst_ttml_parse_format_autodetect (GstTtmlParse * self)
 }
 
 static void
-feed_textbuf (GstTtmlParse * self, GstBuffer * buf)
+feed_adapter (GstTtmlParse * self, GstBuffer * buf)
 {
   gboolean discont;
-  gsize consumed;
-  gchar *input = NULL;
-  const guint8 *data;
-  gsize avail;
+  gint pending;
 
   discont = GST_BUFFER_IS_DISCONT (buf);
 
@@ -1499,8 +2291,29 @@ feed_textbuf (GstTtmlParse * self, GstBuffer * buf)
     GST_INFO ("discontinuity");
     /* flush the parser state */
     parser_state_init (&self->state);
+    /* a seek from the application thread may have set a checkpoint; only
+     * this thread appends to the index, so the entry stays in place */
+    GST_OBJECT_LOCK (self);
+    pending = self->line_index_pending;
+    self->line_index_pending = -1;
+    GST_OBJECT_UNLOCK (self);
+    if (pending >= 0) {
+      GstTtmlParseLineIndexEntry *entry = &g_array_index (self->line_index,
+          GstTtmlParseLineIndexEntry, pending);
+
+      if (GST_BUFFER_OFFSET (buf) == entry->offset)
+        line_index_restore (self, entry);
+    }
     g_string_truncate (self->textbuf, 0);
+    self->textbuf_pos = 0;
     gst_adapter_clear (self->adapter);
+    if (self->ttml_parser) {
+      ttml_parser_free (self->ttml_parser);
+      self->ttml_parser = NULL;
+    }
+    self->in_ttml_document = FALSE;
+    self->last_document_len = 0;
+    scene_index_reset (self);
     if (self->parser_type == GST_TTML_PARSE_FORMAT_SAMI)
       sami_context_reset (&self->state);
     /* we could set a flag to make sure that the next buffer we push out also
@@ -1511,21 +2324,43 @@ feed_textbuf (GstTtmlParse * self, GstBuffer * buf)
   self->offset += gst_buffer_get_size (buf);
 
   gst_adapter_push (self->adapter, buf);
+}
+
+
+/* Discard the text already read from textbuf, if all of it has been read or
+ * if enough has been read that moving the rest down is worthwhile; the cost
+ * of moving text is then linear in the amount of input. */
+static void
+discard_read_text (GstTtmlParse * self)
+{
+  if (self->textbuf_pos == self->textbuf->len) {
+    g_string_truncate (self->textbuf, 0);
+    self->textbuf_pos = 0;
+  } else if (self->textbuf_pos >= TEXTBUF_COMPACT_THRESHOLD
+      && self->textbuf_pos >= self->textbuf->len / 2) {
+    g_string_erase (self->textbuf, 0, self->textbuf_pos);
+    self->textbuf_pos = 0;
+  }
+}
+
+
+/* Convert the input held in the adapter to UTF-8 and append it to
+ * textbuf. */
+static void
+feed_textbuf (GstTtmlParse * self)
+{
+  gsize consumed;
+  gchar *input = NULL;
+  const guint8 *data;
+  gsize avail;
 
   avail = gst_adapter_available (self->adapter);
   data = gst_adapter_map (self->adapter, avail);
   input = convert_encoding (self, (const gchar *) data, avail, &consumed);
 
   if (input && consumed > 0) {
-    if (g_strcmp0 (self->subtitle_codec, "EBUTT") == 0) {
-      if (self->textbuf) {
-        g_string_free (self->textbuf, TRUE);
-        self->textbuf = NULL;
-      }
-      self->textbuf = g_string_new (input);
-    } else {
-      self->textbuf = g_string_append (self->textbuf, input);
-    }
+    discard_read_text (self);
+    self->textbuf = g_string_append (self->textbuf, input);
     gst_adapter_unmap (self->adapter);
     gst_adapter_flush (self->adapter, consumed);
   } else {
@@ -1536,13 +2371,545 @@ feed_textbuf (GstTtmlParse * self, GstBuffer * buf)
 }
 
 
+/* Returns the duration of the TTML document being received, if known. */
+static GstClockTime
+get_ttml_document_duration (GstTtmlParse * self)
+{
+  if (GST_CLOCK_TIME_IS_VALID (self->document_begin)
+      && GST_CLOCK_TIME_IS_VALID (self->document_end)
+      && self->document_end >= self->document_begin)
+    return self->document_end - self->document_begin;
+  return GST_CLOCK_TIME_NONE;
+}
+
+
+/* Push downstream the buffers in @subtitle_list, taking ownership of them. */
+static GstFlowReturn
+push_ttml_buffers (GstTtmlParse * self, GList * subtitle_list)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GList *subtitle;
+
+  for (subtitle = subtitle_list; subtitle; subtitle = subtitle->next) {
+    GstBuffer *op_buffer = subtitle->data;
+    self->segment.position = GST_BUFFER_PTS (op_buffer);
+    scene_index_add (self, op_buffer);
+
+    GST_DEBUG_OBJECT (self, "Sending buffer %p, %llu %llu",
+        op_buffer, GST_BUFFER_PTS (op_buffer),
+        GST_BUFFER_DURATION (op_buffer));
+
+    ret = gst_pad_push (self->srcpad, op_buffer);
+
+    if (ret != GST_FLOW_OK)
+      GST_DEBUG_OBJECT (self, "flow: %s", gst_flow_get_name (ret));
+  }
+
+  if (ret != GST_FLOW_OK)
+    scene_index_invalidate (self);
+
+  g_list_free (subtitle_list);
+  return ret;
+}
+
+
+/* Warn that the TTML document just processed exceeded the resource limits
+ * in @exceeded, and so was only partly output. */
+static void
+post_ttml_limits_warning (GstTtmlParse * self, TtmlLimitFlags exceeded)
+{
+  GString *limits = g_string_new (NULL);
+
+  if (exceeded & TTML_LIMIT_DEPTH)
+    g_string_append (limits, " max-depth");
+  if (exceeded & TTML_LIMIT_REGIONS)
+    g_string_append (limits, " max-regions");
+  if (exceeded & TTML_LIMIT_ELEMENTS)
+    g_string_append (limits, " max-elements");
+  if (exceeded & TTML_LIMIT_SCENES)
+    g_string_append (limits, " max-scenes");
+  if (exceeded & TTML_LIMIT_TIME)
+    g_string_append (limits, " parse-time-budget");
+
+  GST_ELEMENT_WARNING (self, STREAM, DECODE,
+      ("TTML document exceeds processing limits; its subtitles are "
+          "incomplete."), ("Limits exceeded:%s", limits->str));
+  g_string_free (limits, TRUE);
+}
+
+
+/* Build the scenes of the TTML document that has been fed to the TTML parser
+ * and push them downstream. Each scene is built only once the previous one
+ * has been pushed, so the first subtitle is output promptly and, since
+ * pushing blocks once downstream has enough data, scenes are built only a
+ * little ahead of playback. If @text is non-NULL, it holds the text of the
+ * whole document, which is added to the result cache along with the
+ * document's scenes, within a budget of @max_bytes. */
+static GstFlowReturn
+push_ttml_document (GstTtmlParse * self, GBytes * text, guint hash,
+    guint64 max_bytes)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime duration = get_ttml_document_duration (self);
+  TtmlSceneIter *iter;
+  GstBuffer *op_buffer;
+  GList *cached = NULL;
+  guint64 cached_bytes = 0;
+  GTimer *timer = g_timer_new ();
+  TtmlLimitFlags exceeded;
+
+  iter = ttml_parser_finish_iter (self->ttml_parser, self->document_begin,
+      duration);
+  self->in_ttml_document = FALSE;
+
+  /* A document that extends its predecessor yields only the scenes affected
+   * by its new content. */
+  if (!iter || max_bytes == 0 || ttml_parser_has_resumed (self->ttml_parser))
+    text = NULL;
+  if (text)
+    cached_bytes = g_bytes_get_size (text);
+
+  while (iter && !self->flushing
+      && (op_buffer = ttml_scene_iter_next (iter))) {
+    if (timer) {
+      g_timer_stop (timer);
+      GST_CAT_INFO (ttml_parse_debug, "Time to build first scene: %gms",
+          g_timer_elapsed (timer, NULL) * 1000.0);
+      g_timer_destroy (timer);
+      timer = NULL;
+    }
+
+    /* Keep the scenes for the cache only while they fit within it. */
+    if (text) {
+      cached_bytes += gst_buffer_get_size (op_buffer);
+      if (cached_bytes <= max_bytes) {
+        cached = g_list_prepend (cached, gst_buffer_ref (op_buffer));
+      } else {
+        g_list_free_full (cached, (GDestroyNotify) gst_buffer_unref);
+        cached = NULL;
+        text = NULL;
+      }
+    }
+
+    self->segment.position = GST_BUFFER_PTS (op_buffer);
+    scene_index_add (self, op_buffer);
+
+    GST_DEBUG_OBJECT (self, "Sending buffer %p, %llu %llu",
+        op_buffer, GST_BUFFER_PTS (op_buffer),
+        GST_BUFFER_DURATION (op_buffer));
+
+    ret = gst_pad_push (self->srcpad, op_buffer);
+
+    if (ret != GST_FLOW_OK) {
+      GST_DEBUG_OBJECT (self, "flow: %s", gst_flow_get_name (ret));
+      break;
+    }
+  }
+
+  exceeded = ttml_parser_get_exceeded_limits (self->ttml_parser);
+  if (exceeded)
+    post_ttml_limits_warning (self, exceeded);
+
+  /* The index must hold every scene of the input: a document that extended
+   * its predecessor yielded only some of its scenes, and one that exceeded
+   * the time budget might yield more if parsed again. */
+  if (ret != GST_FLOW_OK || self->flushing || exceeded
+      || ttml_parser_has_resumed (self->ttml_parser))
+    scene_index_invalidate (self);
+
+  if (iter) {
+    /* Only a complete set of scenes can be cached. */
+    if (text && ret == GST_FLOW_OK && !self->flushing && cached
+        && !exceeded) {
+      cached = g_list_reverse (cached);
+      result_cache_insert (self, text, hash, self->document_begin, duration,
+          cached, max_bytes);
+    }
+    g_list_free_full (cached, (GDestroyNotify) gst_buffer_unref);
+    ttml_scene_iter_free (iter);
+  }
+
+  if (timer)
+    g_timer_destroy (timer);
+  return ret;
+}
+
+
+/* If the TTML document whose text is @text is in the result cache, push its
+ * scenes downstream, setting @ret to the result, and return TRUE. A document
+ * identical to the last one received is not looked up: live encoders
+ * republish documents, and the TTML parser outputs only the scenes affected
+ * by any new content of a document that extends its predecessor. */
+static gboolean
+push_cached_ttml_document (GstTtmlParse * self, GBytes * text, guint hash,
+    GstFlowReturn * ret)
+{
+  GstClockTime duration = get_ttml_document_duration (self);
+  gsize len = g_bytes_get_size (text);
+  gboolean republished;
+  GList *subtitle_list;
+
+  republished = (len == self->last_document_len
+      && hash == self->last_document_hash);
+  self->last_document_len = len;
+  self->last_document_hash = hash;
+  if (republished)
+    return FALSE;
+
+  subtitle_list = result_cache_lookup (self, text, hash, self->document_begin,
+      duration);
+
+  GST_OBJECT_LOCK (self);
+  if (subtitle_list)
+    ++self->result_cache_hits;
+  else
+    ++self->result_cache_misses;
+  GST_OBJECT_UNLOCK (self);
+
+  if (!subtitle_list)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (self, "Pushing %u cached scenes of %" G_GSIZE_FORMAT
+      "-byte document", g_list_length (subtitle_list), len);
+  *ret = push_ttml_buffers (self, subtitle_list);
+  return TRUE;
+}
+
+
+/* Feed the @len bytes of UTF-8 text at @text to the TTML parser, which
+ * parses each document as its data arrives. A document may span several
+ * buffers, and a buffer may hold the end of one document and the start of
+ * the next; @pts and @duration are the timing of the buffer from which the
+ * text came. A document that fills a buffer on its own, as a DASH segment
+ * does, is looked up in the result cache before being parsed, and added to
+ * it afterwards. All of @text is consumed. */
+static GstFlowReturn
+handle_ttml_text (GstTtmlParse * self, const gchar * text, gsize len,
+    GstClockTime pts, GstClockTime duration)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  gboolean use_cache, parallel;
+  guint64 max_bytes;
+  TtmlLimits limits;
+
+  /* Read the properties once, as they may be changed from the application
+   * thread while the text is parsed. */
+  GST_OBJECT_LOCK (self);
+  max_bytes = self->result_cache_max_bytes;
+  parallel = self->parallel;
+  limits.max_depth = self->max_depth;
+  limits.max_regions = self->max_regions;
+  limits.max_elements = self->max_elements;
+  limits.max_scenes = self->max_scenes;
+  limits.time_budget = self->parse_time_budget * GST_MSECOND;
+  GST_OBJECT_UNLOCK (self);
+  use_cache = (max_bytes > 0);
+
+  while (len > 0) {
+    GBytes *document = NULL;
+    guint hash = 0;
+    gsize consumed;
+
+    if (!self->in_ttml_document) {
+      /* Skip any whitespace between documents. */
+      while (len > 0 && g_ascii_isspace (*text)) {
+        ++text;
+        --len;
+      }
+      if (len == 0)
+        break;
+
+      self->in_ttml_document = TRUE;
+      self->document_begin = pts;
+      self->document_end = GST_CLOCK_TIME_NONE;
+      if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (duration))
+        self->document_end = pts + duration;
+
+      if (use_cache) {
+        gsize document_len = len;
+
+        /* The rest of the text may be a single document. */
+        while (g_ascii_isspace (text[document_len - 1]))
+          --document_len;
+        document = g_bytes_new_static (text, document_len);
+        hash = g_bytes_hash (document);
+
+        if (push_cached_ttml_document (self, document, hash, &ret)) {
+          g_bytes_unref (document);
+          self->in_ttml_document = FALSE;
+          break;
+        }
+      }
+
+      if (self->ttml_parser)
+        ttml_parser_start_document (self->ttml_parser);
+      else
+        self->ttml_parser = ttml_parser_new (self->head_cache);
+      ttml_parser_set_parallel (self->ttml_parser, parallel);
+      ttml_parser_set_limits (self->ttml_parser, &limits);
+    }
+
+    if (GST_CLOCK_TIME_IS_VALID (pts) && GST_CLOCK_TIME_IS_VALID (duration))
+      self->document_end = pts + duration;
+
+    consumed = ttml_parser_feed (self->ttml_parser, text, len);
+    text += consumed;
+    len -= consumed;
+
+    /* Cache the result only if the document did fill the rest of the
+     * text. */
+    if (ttml_parser_is_complete (self->ttml_parser)
+        || ttml_parser_has_failed (self->ttml_parser))
+      ret = push_ttml_document (self, (document
+              && consumed >= g_bytes_get_size (document)) ? document : NULL,
+          hash, max_bytes);
+
+    if (document)
+      g_bytes_unref (document);
+  }
+
+  return ret;
+}
+
+
+/* Feed the TTML input in the adapter to the TTML parser without copying it,
+ * setting @ret to the result, as long as the input is valid UTF-8. A
+ * character split between buffers is left in the adapter until the rest of
+ * it arrives. Returns FALSE, consuming nothing, if the input is not valid
+ * UTF-8 and so must be converted. */
+static gboolean
+handle_ttml_in_place (GstTtmlParse * self, GstClockTime pts,
+    GstClockTime duration, GstFlowReturn * ret)
+{
+  gsize avail = gst_adapter_available (self->adapter);
+  const gchar *data, *end;
+  gsize len = avail;
+
+  *ret = GST_FLOW_OK;
+  if (avail == 0)
+    return TRUE;
+
+  /* This does not copy if the adapter holds a single buffer. */
+  data = (const gchar *) gst_adapter_map (self->adapter, avail);
+
+  if (!text_encoding_validate_utf8 (data, avail, &end)) {
+    len = end - data;
+    if (g_utf8_get_char_validated (end, avail - len) != (gunichar) - 2) {
+      gst_adapter_unmap (self->adapter);
+      return FALSE;
+    }
+  }
+
+  GST_LOG_OBJECT (self, "parsing %" G_GSIZE_FORMAT " bytes in place", len);
+  *ret = handle_ttml_text (self, data, len, pts, duration);
+
+  gst_adapter_unmap (self->adapter);
+  gst_adapter_flush (self->adapter, len);
+  return TRUE;
+}
+
+
+/* Push downstream the scenes in the scene index that overlap the segment,
+ * preceded by the segment if it has yet to be pushed. */
+static GstFlowReturn
+push_scene_index_segment (GstTtmlParse * self)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstClockTime start = self->segment.start;
+  GstClockTime stop = self->segment.stop;
+  guint i;
+
+  if (self->need_segment) {
+    GST_LOG_OBJECT (self, "pushing newsegment event with %" GST_SEGMENT_FORMAT,
+        &self->segment);
+    gst_pad_push_event (self->srcpad, gst_event_new_segment (&self->segment));
+    self->need_segment = FALSE;
+  }
+
+  i = scene_index_find (self, start);
+  GST_DEBUG_OBJECT (self, "pushing scenes from index %u of %u", i,
+      self->scene_index->len);
+
+  for (; i < self->scene_index->len && ret == GST_FLOW_OK; ++i) {
+    GstTtmlParseIndexEntry *entry = &g_array_index (self->scene_index,
+        GstTtmlParseIndexEntry, i);
+    GstClockTime pts = GST_BUFFER_PTS (entry->buffer);
+
+    if (GST_CLOCK_TIME_IS_VALID (stop) && pts >= stop)
+      break;
+    if (entry->end <= start)
+      continue;
+
+    self->segment.position = pts;
+    ret = gst_pad_push (self->srcpad, gst_buffer_ref (entry->buffer));
+  }
+
+  return ret;
+}
+
+
+/* Returns the path of the file from which the input comes, if it is known
+ * to come from one. */
+static gchar *
+get_source_path (GstTtmlParse * self)
+{
+  GstQuery *query;
+  gchar *uri = NULL, *path = NULL;
+
+  if (self->location)
+    return g_strdup (self->location);
+
+  query = gst_query_new_uri ();
+  if (gst_pad_peer_query (self->sinkpad, query))
+    gst_query_parse_uri (query, &uri);
+  gst_query_unref (query);
+
+  if (uri && gst_uri_has_protocol (uri, "file"))
+    path = g_filename_from_uri (uri, NULL, NULL);
+  g_free (uri);
+  return path;
+}
+
+
+/* Called with the first buffer of input, @buf. If the scene cache is enabled
+ * and the input is a file, note the file's identity so that its scenes can
+ * be written to its scene file once it has been parsed. If that scene file
+ * is up to date, read the scenes from it into the scene index instead and
+ * return TRUE. Input that has timing of its own, as a DASH segment has, may
+ * yield different scenes each time, so is not cached. */
+static gboolean
+open_scene_file (GstTtmlParse * self, GstBuffer * buf)
+{
+  gboolean enabled;
+  gchar *cache_dir, *source_path = NULL;
+  GPtrArray *scenes;
+  GError *error = NULL;
+  guint i;
+
+  GST_OBJECT_LOCK (self);
+  enabled = self->scene_cache;
+  cache_dir = g_strdup (self->scene_cache_dir);
+  GST_OBJECT_UNLOCK (self);
+
+  if (!enabled || GST_BUFFER_PTS_IS_VALID (buf)
+      || (GST_BUFFER_OFFSET_IS_VALID (buf) && GST_BUFFER_OFFSET (buf) != 0)
+      || !(source_path = get_source_path (self)))
+    goto done;
+
+  if (!(self->scene_source = scene_file_source_new (source_path, &error))) {
+    GST_DEBUG_OBJECT (self, "not caching scenes: %s", error->message);
+    g_clear_error (&error);
+    goto done;
+  }
+  self->scene_file = scene_file_get_path (source_path, cache_dir);
+
+  if (!(scenes = scene_file_read (self->scene_file, self->scene_source,
+              &error))) {
+    GST_DEBUG_OBJECT (self, "not reading scene file: %s", error->message);
+    g_clear_error (&error);
+    goto done;
+  }
+
+  self->parser_type = GST_TTML_PARSE_FORMAT_TTML;
+  scene_index_reset (self);
+  for (i = 0; i < scenes->len; ++i)
+    scene_index_add (self, g_ptr_array_index (scenes, i));
+  scene_index_finish (self);
+  g_ptr_array_free (scenes, TRUE);
+
+  if (self->scene_index_complete) {
+    GST_INFO_OBJECT (self, "read %u scenes from %s", self->scene_index->len,
+        self->scene_file);
+    self->subtitle_codec =
+        gst_ttml_parse_get_format_description (self->parser_type);
+    self->parse_line = NULL;
+    parser_state_init (&self->state);
+    self->scenes_from_file = TRUE;
+  } else {
+    self->parser_type = GST_TTML_PARSE_FORMAT_UNKNOWN;
+    scene_index_reset (self);
+  }
+
+done:
+  g_free (source_path);
+  g_free (cache_dir);
+  return self->scenes_from_file;
+}
+
+
+/* Output the scenes read from a scene file, as handle_buffer() would have
+ * output those of the file itself. */
+static GstFlowReturn
+push_scene_file (GstTtmlParse * self)
+{
+  GstCaps *caps = new_ttml_caps ();
+  gboolean caps_set;
+
+  caps_set = gst_pad_set_caps (self->srcpad, caps);
+  gst_caps_unref (caps);
+  if (!caps_set)
+    return GST_FLOW_NOT_NEGOTIATED;
+
+  if (self->need_segment) {
+    GST_LOG_OBJECT (self, "pushing newsegment event with %" GST_SEGMENT_FORMAT,
+        &self->segment);
+    gst_pad_push_event (self->srcpad, gst_event_new_segment (&self->segment));
+    self->need_segment = FALSE;
+  }
+
+  gst_pad_push_event (self->srcpad, gst_event_new_tag (gst_tag_list_new
+          (GST_TAG_SUBTITLE_CODEC, self->subtitle_codec, NULL)));
+
+  return push_scene_index_segment (self);
+}
+
+
+/* Write the scenes in the scene index to the scene file of the input, once
+ * all of it has been parsed. */
+static void
+write_scene_file (GstTtmlParse * self)
+{
+  GPtrArray *scenes = g_ptr_array_sized_new (self->scene_index->len);
+  GError *error = NULL;
+  guint i;
+
+  for (i = 0; i < self->scene_index->len; ++i)
+    g_ptr_array_add (scenes, g_array_index (self->scene_index,
+            GstTtmlParseIndexEntry, i).buffer);
+
+  if (scene_file_write (self->scene_file, self->scene_source, scenes,
+          &error)) {
+    GST_INFO_OBJECT (self, "wrote %u scenes to %s", scenes->len,
+        self->scene_file);
+  } else {
+    GST_WARNING_OBJECT (self, "could not write scene file: %s",
+        error->message);
+    g_clear_error (&error);
+  }
+  g_ptr_array_free (scenes, TRUE);
+
+  /* Once is enough. */
+  scene_file_source_free (self->scene_source);
+  self->scene_source = NULL;
+}
+
+
 static GstFlowReturn
 handle_buffer (GstTtmlParse * self, GstBuffer * buf)
 {
   GstFlowReturn ret = GST_FLOW_OK;
   GstCaps *caps = NULL;
-  gchar *line, *subtitle;
-  gboolean need_tags = FALSE;
+  const gchar *line;
+  gchar *subtitle;
+  gboolean need_tags = FALSE, need_segment, in_place;
+  GstClockTime pts = GST_BUFFER_PTS (buf);
+  GstClockTime duration = GST_BUFFER_DURATION (buf);
+
+  /* All the scenes have already been output from the scene file. */
+  if (self->scenes_from_file) {
+    gst_buffer_unref (buf);
+    return GST_FLOW_EOS;
+  }
 
   if (self->first_buffer) {
     GstMapInfo map;
@@ -1553,9 +2920,15 @@ handle_buffer (GstTtmlParse * self, GstBuffer * buf)
     self->first_buffer = FALSE;
     self->state.fps_n = self->fps_n;
     self->state.fps_d = self->fps_d;
+
+    if (open_scene_file (self, buf)) {
+      gst_buffer_unref (buf);
+      ret = push_scene_file (self);
+      return ret == GST_FLOW_OK ? GST_FLOW_EOS : ret;
+    }
   }
 
-  feed_textbuf (self, buf);
+  feed_adapter (self, buf);
 
   /* make sure we know the format */
   if (G_UNLIKELY (self->parser_type == GST_TTML_PARSE_FORMAT_UNKNOWN)) {
@@ -1570,13 +2943,24 @@ handle_buffer (GstTtmlParse * self, GstBuffer * buf)
     need_tags = TRUE;
   }
 
-  /* Push newsegment if needed */
-  if (self->need_segment) {
+  /* UTF-8 TTML input is parsed straight from the adapter rather than being
+   * copied into textbuf. */
+  in_place = (self->parser_type == GST_TTML_PARSE_FORMAT_TTML
+      && can_handle_ttml_in_place (self));
+  if (!in_place)
+    feed_textbuf (self);
+
+  /* Push newsegment if needed; a seek from the application thread sets
+   * need_segment */
+  GST_OBJECT_LOCK (self);
+  need_segment = self->need_segment;
+  self->need_segment = FALSE;
+  GST_OBJECT_UNLOCK (self);
+  if (need_segment) {
     GST_LOG_OBJECT (self, "pushing newsegment event with %" GST_SEGMENT_FORMAT,
         &self->segment);
 
     gst_pad_push_event (self->srcpad, gst_event_new_segment (&self->segment));
-    self->need_segment = FALSE;
   }
 
   if (need_tags) {
@@ -1591,32 +2975,13 @@ handle_buffer (GstTtmlParse * self, GstBuffer * buf)
   }
 
   if (g_strcmp0 (self->subtitle_codec, "EBUTT") == 0) {
-    GList *subtitle;
-    GTimer *timer = g_timer_new ();
-
-    GList *subtitle_list = ttml_parse (self->textbuf->str,
-        GST_BUFFER_PTS (buf), GST_BUFFER_DURATION (buf));
-
-    g_timer_stop (timer);
-    GST_CAT_INFO (ttml_parse_debug, "Time to parse file: %gms",
-        g_timer_elapsed (timer, NULL) * 1000.0);
-    g_timer_destroy (timer);
-
-    for (subtitle = subtitle_list; subtitle; subtitle = subtitle->next) {
-      GstBuffer *op_buffer = subtitle->data;
-      self->segment.position = GST_BUFFER_PTS (op_buffer);
-
-      GST_DEBUG_OBJECT (self, "Sending buffer %p, %llu %llu",
-          op_buffer, GST_BUFFER_PTS (op_buffer),
-          GST_BUFFER_DURATION (op_buffer));
-
-      ret = gst_pad_push (self->srcpad, op_buffer);
-
-      if (ret != GST_FLOW_OK)
-        GST_DEBUG_OBJECT (self, "flow: %s", gst_flow_get_name (ret));
+    if (!in_place || !handle_ttml_in_place (self, pts, duration, &ret)) {
+      if (in_place)
+        feed_textbuf (self);
+      ret = handle_ttml_text (self, self->textbuf->str, self->textbuf->len,
+          pts, duration);
+      g_string_truncate (self->textbuf, 0);
     }
-
-    g_list_free (subtitle_list);
   } else {
     while (!self->flushing && (line = get_next_line (self))) {
       guint offset = 0;
@@ -1626,7 +2991,6 @@ handle_buffer (GstTtmlParse * self, GstBuffer * buf)
       /* Now parse the line, out of segment lines will just return NULL */
       GST_LOG_OBJECT (self, "Parsing line '%s'", line + offset);
       subtitle = self->parse_line (&self->state, line + offset);
-      g_free (line);
 
       if (subtitle) {
         guint subtitle_len = strlen (subtitle);
@@ -1652,6 +3016,9 @@ handle_buffer (GstTtmlParse * self, GstBuffer * buf)
         }
 
         self->segment.position = self->state.start_time;
+        line_index_add_subtitle (self, GST_BUFFER_DURATION_IS_VALID (buf) ?
+            GST_BUFFER_TIMESTAMP (buf) + GST_BUFFER_DURATION (buf) :
+            GST_CLOCK_TIME_NONE);
 
         GST_DEBUG_OBJECT (self, "Sending text '%s', %" GST_TIME_FORMAT " + %"
             GST_TIME_FORMAT, subtitle, GST_TIME_ARGS (self->state.start_time),
@@ -1671,6 +3038,9 @@ handle_buffer (GstTtmlParse * self, GstBuffer * buf)
           break;
         }
       }
+
+      if (self->line_index_building)
+        line_index_add (self);
     }
   }
   return ret;
@@ -1689,6 +3059,145 @@ gst_ttml_parse_chain (GstPad * sinkpad, GstObject * parent, GstBuffer * buf)
   return ret;
 }
 
+/* Called once all of the input has been received. Make sure the last chunk
+ * of formats whose entries end with an empty line is pushed out even if the
+ * input does not end with one, and complete the scene index, saving it to
+ * the scene file if there is one to write. */
+static void
+handle_end_of_input (GstTtmlParse * self)
+{
+  if (self->parser_type == GST_TTML_PARSE_FORMAT_SUBRIP ||
+      self->parser_type == GST_TTML_PARSE_FORMAT_TMPLAYER ||
+      self->parser_type == GST_TTML_PARSE_FORMAT_MPL2 ||
+      self->parser_type == GST_TTML_PARSE_FORMAT_QTTEXT) {
+    gchar term_chars[] = { '\n', '\n', '\0' };
+    GstBuffer *buf = gst_buffer_new_and_alloc (2 + 1);
+
+    /* the terminating empty lines are not part of the input */
+    self->line_index_building = FALSE;
+
+    GST_DEBUG ("EOS. Pushing remaining text (if any)");
+    gst_buffer_fill (buf, 0, term_chars, 3);
+    gst_buffer_set_size (buf, 2);
+
+    GST_BUFFER_OFFSET (buf) = self->offset;
+    handle_buffer (self, buf);
+  }
+
+  scene_index_finish (self);
+  if (self->scene_source && self->scene_index_complete
+      && !self->scenes_from_file)
+    write_scene_file (self);
+}
+
+/* Finish the work of the task on the source pad, whose last push returned
+ * @ret: signal the end of the stream, or an error, and pause the task. */
+static void
+gst_ttml_parse_pause_task (GstTtmlParse * self, GstFlowReturn ret)
+{
+  if (ret == GST_FLOW_NOT_LINKED || ret < GST_FLOW_EOS) {
+    GST_ELEMENT_ERROR (self, STREAM, FAILED, ("Internal data stream error."),
+        ("streaming stopped, reason %s", gst_flow_get_name (ret)));
+    gst_pad_push_event (self->srcpad, gst_event_new_eos ());
+  } else if (ret == GST_FLOW_OK || ret == GST_FLOW_EOS) {
+    gst_pad_push_event (self->srcpad, gst_event_new_eos ());
+  }
+
+  GST_DEBUG_OBJECT (self, "pausing task, reason %s", gst_flow_get_name (ret));
+  gst_pad_pause_task (self->srcpad);
+}
+
+/* Streaming thread function used when the location property is set. The whole
+ * file is mapped and handed to handle_buffer() as a single read-only buffer
+ * that wraps the mapping, so the file is not read into memory first. UTF-8
+ * TTML, whose format is detected from its first bytes, is then parsed
+ * straight from the mapping; the other formats are still converted into
+ * textbuf, a copy of the file, from which their lines are read. */
+static void
+gst_ttml_parse_read_location (GstTtmlParse * self)
+{
+  GMappedFile *file;
+  GError *error = NULL;
+  GstFlowReturn ret = GST_FLOW_OK;
+  gsize size, start = 0;
+
+  file = g_mapped_file_new (self->location, FALSE, &error);
+  if (!file) {
+    GST_ELEMENT_ERROR (self, RESOURCE, OPEN_READ,
+        ("Could not open file \"%s\" for reading.", self->location),
+        ("%s", error->message));
+    g_error_free (error);
+    goto pause;
+  }
+
+  if (self->first_buffer) {
+    gchar *stream_id;
+
+    stream_id = gst_pad_create_stream_id (self->srcpad, GST_ELEMENT (self),
+        NULL);
+    gst_pad_push_event (self->srcpad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+  }
+
+  size = g_mapped_file_get_length (file);
+  GST_DEBUG_OBJECT (self, "mapped %" G_GSIZE_FORMAT " bytes of %s", size,
+      self->location);
+
+  /* after a seek, reading may resume from a checkpoint */
+  GST_OBJECT_LOCK (self);
+  if (self->line_index_pending >= 0)
+    start = g_array_index (self->line_index, GstTtmlParseLineIndexEntry,
+        self->line_index_pending).offset;
+  GST_OBJECT_UNLOCK (self);
+
+  if (size > start) {
+    GstBuffer *buf;
+
+    buf = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        g_mapped_file_get_contents (file), size, start, size - start,
+        g_mapped_file_ref (file), (GDestroyNotify) g_mapped_file_unref);
+    /* a buffer starting at an earlier offset (after a seek) is a
+     * discontinuity, which resets the parser state */
+    GST_BUFFER_OFFSET (buf) = start;
+    ret = handle_buffer (self, buf);
+  }
+  g_mapped_file_unref (file);
+
+  if (ret == GST_FLOW_OK) {
+    handle_end_of_input (self);
+  }
+
+pause:
+  gst_ttml_parse_pause_task (self, ret);
+}
+
+/* Streaming thread function used to serve a seek from the scene index: push
+ * the scenes that overlap the segment, then EOS. */
+static void
+gst_ttml_parse_push_scene_index (GstTtmlParse * self)
+{
+  gst_ttml_parse_pause_task (self, push_scene_index_segment (self));
+}
+
+static gboolean
+gst_ttml_parse_src_activate_mode (GstPad * pad, GstObject * parent,
+    GstPadMode mode, gboolean active)
+{
+  GstTtmlParse *self = GST_TTMLPARSE (parent);
+
+  if (mode != GST_PAD_MODE_PUSH)
+    return TRUE;
+
+  /* A task may also have been started to serve a seek from the scene
+   * index. */
+  if (!active)
+    return gst_pad_stop_task (pad);
+  else if (self->location)
+    return gst_pad_start_task (pad,
+        (GstTaskFunction) gst_ttml_parse_read_location, self, NULL);
+  return TRUE;
+}
+
 static gboolean
 gst_ttml_parse_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
 {
@@ -1699,22 +3208,7 @@ gst_ttml_parse_sink_event (GstPad * pad, GstObject * parent, GstEvent * event)
 
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_EOS:{
-      /* Make sure the last subrip chunk is pushed out even
-       * if the file does not have an empty line at the end */
-      if (self->parser_type == GST_TTML_PARSE_FORMAT_SUBRIP ||
-          self->parser_type == GST_TTML_PARSE_FORMAT_TMPLAYER ||
-          self->parser_type == GST_TTML_PARSE_FORMAT_MPL2 ||
-          self->parser_type == GST_TTML_PARSE_FORMAT_QTTEXT) {
-        gchar term_chars[] = { '\n', '\n', '\0' };
-        GstBuffer *buf = gst_buffer_new_and_alloc (2 + 1);
-
-        GST_DEBUG ("EOS. Pushing remaining text (if any)");
-        gst_buffer_fill (buf, 0, term_chars, 3);
-        gst_buffer_set_size (buf, 2);
-
-        GST_BUFFER_OFFSET (buf) = self->offset;
-        gst_ttml_parse_chain (pad, parent, buf);
-      }
+      handle_end_of_input (self);
       ret = gst_pad_event_default (pad, parent, event);
       break;
     }
@@ -1778,7 +3272,22 @@ gst_ttml_parse_change_state (GstElement * element, GstStateChange transition)
       g_free (self->detected_encoding);
       self->detected_encoding = NULL;
       g_string_truncate (self->textbuf, 0);
+      self->textbuf_pos = 0;
       gst_adapter_clear (self->adapter);
+      if (self->ttml_parser) {
+        ttml_parser_free (self->ttml_parser);
+        self->ttml_parser = NULL;
+      }
+      self->in_ttml_document = FALSE;
+      scene_index_reset (self);
+      line_index_reset (self);
+      if (self->scene_source) {
+        scene_file_source_free (self->scene_source);
+        self->scene_source = NULL;
+      }
+      g_free (self->scene_file);
+      self->scene_file = NULL;
+      self->scenes_from_file = FALSE;
       break;
     default:
       break;
@@ -1870,7 +3379,7 @@ gst_ttmlparse_type_find (GstTypeFind * tf, gpointer private)
 
   /* Check if at least the first 120 chars are valid UTF8,
    * otherwise convert as always */
-  if (!g_utf8_validate (str, 128, &end) && (end - str) < 120) {
+  if (!text_encoding_validate_utf8 (str, 128, &end) && (end - str) < 120) {
     gchar *converted_str;
     gsize tmp;
     const gchar *enc;
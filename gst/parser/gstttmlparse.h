@@ -82,8 +82,77 @@ struct _GstTtmlParse {
 
   /* contains the input in the input encoding */
   GstAdapter *adapter;
-  /* contains the UTF-8 decoded input */
+  /* contains the UTF-8 decoded input; the first textbuf_pos bytes have
+   * already been read as lines and are discarded only once there are enough
+   * of them to be worth moving the rest */
   GString *textbuf;
+  gsize textbuf_pos;
+
+  /* parses TTML documents as their data arrives; the parser is kept between
+   * documents so that a document that extends the previous one need only be
+   * partly parsed. in_ttml_document is set while a document is being fed to
+   * the parser, and document_begin and document_end give the timing of the
+   * buffers carrying it */
+  struct _TtmlParser *ttml_parser;
+  gboolean in_ttml_document;
+  GstClockTime document_begin;
+  GstClockTime document_end;
+
+  /* parsed document heads, kept for the lifetime of the element so that the
+   * identical heads of successive DASH segments are parsed only once */
+  struct _TtmlHeadCache *head_cache;
+
+  /* the scenes output for the TTML input, kept so that once all of the input
+   * has been received a seek is served from them rather than by reading and
+   * parsing the input again. scene_index_valid is cleared if the scenes
+   * output do not give the whole timeline, and scene_index_complete is set
+   * once the input has ended and the index has been sorted. scene_index_bytes
+   * is the size of the scenes held */
+  GArray *scene_index;
+  guint64 scene_index_bytes;
+  gboolean scene_index_valid;
+  gboolean scene_index_complete;
+
+  /* the persistent scene cache: if scene_cache is set, the scenes of a TTML
+   * file are written to a scene file, next to it or in scene_cache_dir, and
+   * read back from there when the file is next opened. scene_source
+   * identifies the file being read, if any, and scene_file is the path of
+   * its scene file. scenes_from_file is set once the scenes have been output
+   * from the scene file, when the rest of the input is ignored */
+  gboolean scene_cache;
+  gchar *scene_cache_dir;
+  struct _SceneFileSource *scene_source;
+  gchar *scene_file;
+  gboolean scenes_from_file;
+
+  /* the scenes of recently parsed TTML documents, most recently used first,
+   * so that documents received again (e.g., DASH segments re-requested after
+   * a seek or quality switch) need not be re-parsed. result_cache_index maps
+   * each entry onto its link in result_cache. last_document_hash and
+   * last_document_len identify the text of the last document received */
+  GQueue result_cache;
+  GHashTable *result_cache_index;
+  guint64 result_cache_bytes;
+  guint64 result_cache_max_bytes;
+  guint64 result_cache_hits;
+  guint64 result_cache_misses;
+  guint last_document_hash;
+  gsize last_document_len;
+
+  /* whether TTML documents are processed using the shared thread pool */
+  gboolean parallel;
+
+  /* limits on the resources used to process each TTML document; 0 means no
+   * limit. parse_time_budget is in milliseconds */
+  guint max_depth;
+  guint max_regions;
+  guint max_elements;
+  guint max_scenes;
+  guint parse_time_budget;
+
+  /* if set, the file that is read, memory-mapped, in place of input on the
+   * sink pad */
+  gchar *location;
 
   GstTtmlParseFormat parser_type;
   gboolean parser_detected;
@@ -95,6 +164,19 @@ struct _GstTtmlParse {
   /* seek */
   guint64 offset;
 
+  /* checkpoints taken while input in a line-based format is first read
+   * linearly: the byte offset of a line, the latest end of the subtitles
+   * output before it and a copy of the parser state there, so that a seek
+   * can resume reading close to its target. line_index_max_end is the latest
+   * end of the subtitles output so far, and line_index_pending the entry from
+   * which a seek has asked for reading to resume, or -1. The index,
+   * line_index_pending and need_segment are locked with the object lock, as
+   * seeks are handled on the application thread */
+  GArray *line_index;
+  gboolean line_index_building;
+  GstClockTime line_index_max_end;
+  gint line_index_pending;
+
   /* Segment */
   GstSegment    segment;
   gboolean      need_segment;
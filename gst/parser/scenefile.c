@@ -0,0 +1,808 @@
+/* GStreamer TTML scene files
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * A scene file holds the scenes output for a TTML file, so that when the
+ * file is next opened its scenes can be read back rather than the file
+ * being parsed again. It is tied to the TTML file from which it was made by
+ * that file's size, modification time and MD5 digest, and is written in the
+ * byte order of the host that made it.
+ *
+ * The file starts with a header:
+ *
+ *   magic                  8 bytes, "GSTTTMLS"
+ *   version                guint32
+ *   byte order mark        guint32, 0x01020304
+ *   source size            guint64
+ *   source mtime           gint64
+ *   source digest          16 bytes
+ *   text size              guint32
+ *   style, region and
+ *   scene counts           guint32 each
+ *
+ * after which come the text, padded to a multiple of 8 bytes, and then the
+ * style sets, regions and scenes. Each distinct string in the text is
+ * stored once and followed by a NUL. Each distinct style set and region is
+ * also stored once; the regions of the scenes that share them, as those made
+ * from the same part of a document do, are shared again when the file is
+ * read back. When read back, the text of each scene is shared straight from
+ * the mapped file.
+ */
+
+#include "scenefile.h"
+
+#include <gst/subtitle/subtitle.h>
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+#define SCENE_FILE_MAGIC "GSTTTMLS"
+#define SCENE_FILE_MAGIC_SIZE 8
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_BYTE_ORDER 0x01020304
+#define SCENE_FILE_DIGEST_SIZE 16
+#define SCENE_FILE_EXTENSION ".scenes"
+
+/* Stands for a NULL font family. */
+#define SCENE_FILE_NO_STRING G_MAXUINT32
+
+/* The size of a style set record: 12 enums, the offset and length of the
+ * font family, 2 colours and 11 gdoubles. */
+#define SCENE_FILE_STYLE_SIZE (12 * 4 + 2 * 4 + 2 * 4 + 11 * 8)
+
+struct _SceneFileSource
+{
+  guint64 size;
+  gint64 mtime;
+  guint8 digest[SCENE_FILE_DIGEST_SIZE];
+};
+
+
+/* Returns the identity of the file at @path, against which scene files are
+ * checked, or NULL if the file cannot be read. */
+SceneFileSource *
+scene_file_source_new (const gchar * path, GError ** error)
+{
+  SceneFileSource *source;
+  GStatBuf st;
+  GMappedFile *file;
+  GChecksum *checksum;
+  gsize digest_len = SCENE_FILE_DIGEST_SIZE;
+
+  if (g_stat (path, &st) != 0) {
+    int saved_errno = errno;
+
+    g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (saved_errno),
+        "Could not stat %s: %s", path, g_strerror (saved_errno));
+    return NULL;
+  }
+
+  file = g_mapped_file_new (path, FALSE, error);
+  if (!file)
+    return NULL;
+
+  source = g_slice_new0 (SceneFileSource);
+  source->size = g_mapped_file_get_length (file);
+  source->mtime = st.st_mtime;
+
+  checksum = g_checksum_new (G_CHECKSUM_MD5);
+  if (source->size > 0)
+    g_checksum_update (checksum,
+        (const guchar *) g_mapped_file_get_contents (file), source->size);
+  g_checksum_get_digest (checksum, source->digest, &digest_len);
+  g_checksum_free (checksum);
+
+  g_mapped_file_unref (file);
+  return source;
+}
+
+
+void
+scene_file_source_free (SceneFileSource * source)
+{
+  g_slice_free (SceneFileSource, source);
+}
+
+
+/* Returns the path of the scene file for the file at @source_path: next to
+ * it or, if @cache_dir is set, in @cache_dir under a name derived from
+ * @source_path's absolute path. */
+gchar *
+scene_file_get_path (const gchar * source_path, const gchar * cache_dir)
+{
+  gchar *abs_path, *hash, *name, *ret;
+
+  if (!cache_dir || *cache_dir == '\0')
+    return g_strconcat (source_path, SCENE_FILE_EXTENSION, NULL);
+
+  if (g_path_is_absolute (source_path)) {
+    abs_path = g_strdup (source_path);
+  } else {
+    gchar *cwd = g_get_current_dir ();
+
+    abs_path = g_build_filename (cwd, source_path, NULL);
+    g_free (cwd);
+  }
+
+  hash = g_compute_checksum_for_string (G_CHECKSUM_SHA1, abs_path, -1);
+  name = g_strconcat (hash, SCENE_FILE_EXTENSION, NULL);
+  ret = g_build_filename (cache_dir, name, NULL);
+
+  g_free (name);
+  g_free (hash);
+  g_free (abs_path);
+  return ret;
+}
+
+
+/*
+ * Writing.
+ */
+
+typedef struct
+{
+  GByteArray *text;
+  GHashTable *strings;          /* GBytes -> offset in text + 1 */
+  GByteArray *styles;
+  GHashTable *style_indices;    /* GBytes of record -> index + 1 */
+  guint n_styles;
+  GByteArray *regions;
+  GHashTable *region_indices;   /* GstSubtitleRegion -> index + 1 */
+  guint n_regions;
+  GByteArray *scenes;
+} SceneFileWriter;
+
+static void
+append_u32 (GByteArray * array, guint32 value)
+{
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+append_u64 (GByteArray * array, guint64 value)
+{
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+append_double (GByteArray * array, gdouble value)
+{
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+static void
+append_color (GByteArray * array, const GstSubtitleColor * color)
+{
+  guint8 rgba[4] = { color->r, color->g, color->b, color->a };
+
+  g_byte_array_append (array, rgba, sizeof (rgba));
+}
+
+/* Add the @size bytes at @data to the text, if not already there, and
+ * return their offset in it. */
+static guint32
+scene_file_writer_add_text (SceneFileWriter * writer, const guint8 * data,
+    gsize size)
+{
+  GBytes *key = g_bytes_new (data, size);
+  gpointer value;
+  guint32 offset;
+
+  if ((value = g_hash_table_lookup (writer->strings, key))) {
+    g_bytes_unref (key);
+    return GPOINTER_TO_UINT (value) - 1;
+  }
+
+  offset = writer->text->len;
+  g_byte_array_append (writer->text, data, size);
+  g_byte_array_append (writer->text, (const guint8 *) "", 1);
+  g_hash_table_insert (writer->strings, key, GUINT_TO_POINTER (offset + 1));
+  return offset;
+}
+
+static guint32
+scene_file_writer_add_style (SceneFileWriter * writer,
+    const GstSubtitleStyleSet * style)
+{
+  GByteArray *record = g_byte_array_sized_new (SCENE_FILE_STYLE_SIZE);
+  GBytes *key;
+  gpointer value;
+  guint32 index;
+
+  append_u32 (record, style->text_direction);
+  append_u32 (record, style->text_align);
+  append_u32 (record, style->font_style);
+  append_u32 (record, style->font_weight);
+  append_u32 (record, style->text_decoration);
+  append_u32 (record, style->unicode_bidi);
+  append_u32 (record, style->wrap_option);
+  append_u32 (record, style->multi_row_align);
+  append_u32 (record, style->display_align);
+  append_u32 (record, style->writing_mode);
+  append_u32 (record, style->show_background);
+  append_u32 (record, style->overflow);
+
+  if (style->font_family) {
+    gsize len = strlen (style->font_family);
+
+    append_u32 (record, scene_file_writer_add_text (writer,
+            (const guint8 *) style->font_family, len));
+    append_u32 (record, len);
+  } else {
+    append_u32 (record, SCENE_FILE_NO_STRING);
+    append_u32 (record, 0);
+  }
+
+  append_color (record, &style->color);
+  append_color (record, &style->background_color);
+
+  append_double (record, style->font_size);
+  append_double (record, style->line_height);
+  append_double (record, style->line_padding);
+  append_double (record, style->origin_x);
+  append_double (record, style->origin_y);
+  append_double (record, style->extent_w);
+  append_double (record, style->extent_h);
+  append_double (record, style->padding_start);
+  append_double (record, style->padding_end);
+  append_double (record, style->padding_before);
+  append_double (record, style->padding_after);
+
+  key = g_byte_array_free_to_bytes (record);
+  if ((value = g_hash_table_lookup (writer->style_indices, key))) {
+    g_bytes_unref (key);
+    return GPOINTER_TO_UINT (value) - 1;
+  }
+
+  index = writer->n_styles++;
+  g_byte_array_append (writer->styles, g_bytes_get_data (key, NULL),
+      g_bytes_get_size (key));
+  g_hash_table_insert (writer->style_indices, key,
+      GUINT_TO_POINTER (index + 1));
+  return index;
+}
+
+static guint32
+scene_file_writer_add_region (SceneFileWriter * writer,
+    const GstSubtitleRegion * region)
+{
+  gpointer value;
+  guint32 index;
+  guint i, j, n_blocks;
+
+  if ((value = g_hash_table_lookup (writer->region_indices, region)))
+    return GPOINTER_TO_UINT (value) - 1;
+
+  n_blocks = gst_subtitle_region_get_block_count (region);
+  append_u32 (writer->regions,
+      scene_file_writer_add_style (writer, region->style_set));
+  append_u32 (writer->regions, n_blocks);
+
+  for (i = 0; i < n_blocks; ++i) {
+    const GstSubtitleBlock *block = gst_subtitle_region_get_block (region, i);
+    guint n_elements = gst_subtitle_block_get_element_count (block);
+
+    append_u32 (writer->regions,
+        scene_file_writer_add_style (writer, block->style_set));
+    append_u32 (writer->regions, n_elements);
+
+    for (j = 0; j < n_elements; ++j) {
+      const GstSubtitleElement *element =
+          gst_subtitle_block_get_element (block, j);
+
+      append_u32 (writer->regions,
+          scene_file_writer_add_style (writer, element->style_set));
+      append_u32 (writer->regions, element->text_index);
+      append_u32 (writer->regions, element->suppress_whitespace);
+    }
+  }
+
+  index = writer->n_regions++;
+  g_hash_table_insert (writer->region_indices, (gpointer) region,
+      GUINT_TO_POINTER (index + 1));
+  return index;
+}
+
+static void
+scene_file_writer_add_scene (SceneFileWriter * writer, GstBuffer * scene)
+{
+  GstSubtitleMeta *meta = gst_buffer_get_subtitle_meta (scene);
+  guint i, n_memory = gst_buffer_n_memory (scene);
+  guint n_regions = meta ? meta->regions->len : 0;
+
+  append_u64 (writer->scenes, GST_BUFFER_PTS (scene));
+  append_u64 (writer->scenes, GST_BUFFER_DURATION (scene));
+
+  append_u32 (writer->scenes, n_memory);
+  for (i = 0; i < n_memory; ++i) {
+    GstMemory *mem = gst_buffer_peek_memory (scene, i);
+    GstMapInfo map;
+
+    if (gst_memory_map (mem, &map, GST_MAP_READ)) {
+      append_u32 (writer->scenes,
+          scene_file_writer_add_text (writer, map.data, map.size));
+      append_u32 (writer->scenes, map.size);
+      gst_memory_unmap (mem, &map);
+    } else {
+      append_u32 (writer->scenes, 0);
+      append_u32 (writer->scenes, 0);
+    }
+  }
+
+  append_u32 (writer->scenes, n_regions);
+  for (i = 0; i < n_regions; ++i)
+    append_u32 (writer->scenes, scene_file_writer_add_region (writer,
+            g_ptr_array_index (meta->regions, i)));
+}
+
+
+/* Write to @filename a scene file holding @scenes, the time-ordered scenes
+ * output for the TTML file identified by @source. The file is replaced
+ * atomically, so that it is never seen partly written. */
+gboolean
+scene_file_write (const gchar * filename, const SceneFileSource * source,
+    const GPtrArray * scenes, GError ** error)
+{
+  SceneFileWriter writer;
+  GByteArray *out;
+  gchar *dirname;
+  gboolean ret;
+  guint i;
+
+  writer.text = g_byte_array_new ();
+  writer.strings = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+      (GDestroyNotify) g_bytes_unref, NULL);
+  writer.styles = g_byte_array_new ();
+  writer.style_indices = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+      (GDestroyNotify) g_bytes_unref, NULL);
+  writer.n_styles = 0;
+  writer.regions = g_byte_array_new ();
+  writer.region_indices = g_hash_table_new (g_direct_hash, g_direct_equal);
+  writer.n_regions = 0;
+  writer.scenes = g_byte_array_new ();
+
+  for (i = 0; i < scenes->len; ++i)
+    scene_file_writer_add_scene (&writer, g_ptr_array_index (scenes, i));
+
+  /* Pad the text so that the records after it are aligned. */
+  while (writer.text->len % 8)
+    g_byte_array_append (writer.text, (const guint8 *) "", 1);
+
+  out = g_byte_array_sized_new (64 + writer.text->len + writer.styles->len
+      + writer.regions->len + writer.scenes->len);
+  g_byte_array_append (out, (const guint8 *) SCENE_FILE_MAGIC,
+      SCENE_FILE_MAGIC_SIZE);
+  append_u32 (out, SCENE_FILE_VERSION);
+  append_u32 (out, SCENE_FILE_BYTE_ORDER);
+  append_u64 (out, source->size);
+  append_u64 (out, source->mtime);
+  g_byte_array_append (out, source->digest, SCENE_FILE_DIGEST_SIZE);
+  append_u32 (out, writer.text->len);
+  append_u32 (out, writer.n_styles);
+  append_u32 (out, writer.n_regions);
+  append_u32 (out, scenes->len);
+  g_byte_array_append (out, writer.text->data, writer.text->len);
+  g_byte_array_append (out, writer.styles->data, writer.styles->len);
+  g_byte_array_append (out, writer.regions->data, writer.regions->len);
+  g_byte_array_append (out, writer.scenes->data, writer.scenes->len);
+
+  g_byte_array_free (writer.text, TRUE);
+  g_hash_table_destroy (writer.strings);
+  g_byte_array_free (writer.styles, TRUE);
+  g_hash_table_destroy (writer.style_indices);
+  g_byte_array_free (writer.regions, TRUE);
+  g_hash_table_destroy (writer.region_indices);
+  g_byte_array_free (writer.scenes, TRUE);
+
+  dirname = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dirname, 0755);
+  g_free (dirname);
+
+  ret = g_file_set_contents (filename, (const gchar *) out->data, out->len,
+      error);
+  g_byte_array_free (out, TRUE);
+  return ret;
+}
+
+
+/*
+ * Reading.
+ */
+
+typedef struct
+{
+  const guint8 *data;
+  gsize size;
+  gsize pos;
+  gboolean ok;
+} SceneFileReader;
+
+/* Copy the next @n bytes to @dest; on reading past the end of the file,
+ * zero @dest and mark the reader as failed. */
+static void
+read_bytes (SceneFileReader * reader, gpointer dest, gsize n)
+{
+  if (!reader->ok || reader->size - reader->pos < n) {
+    reader->ok = FALSE;
+    memset (dest, 0, n);
+    return;
+  }
+
+  memcpy (dest, reader->data + reader->pos, n);
+  reader->pos += n;
+}
+
+static guint32
+read_u32 (SceneFileReader * reader)
+{
+  guint32 value;
+
+  read_bytes (reader, &value, sizeof (value));
+  return value;
+}
+
+static guint64
+read_u64 (SceneFileReader * reader)
+{
+  guint64 value;
+
+  read_bytes (reader, &value, sizeof (value));
+  return value;
+}
+
+static gdouble
+read_double (SceneFileReader * reader)
+{
+  gdouble value;
+
+  read_bytes (reader, &value, sizeof (value));
+  return value;
+}
+
+static void
+read_color (SceneFileReader * reader, GstSubtitleColor * color)
+{
+  guint8 rgba[4];
+
+  read_bytes (reader, rgba, sizeof (rgba));
+  color->r = rgba[0];
+  color->g = rgba[1];
+  color->b = rgba[2];
+  color->a = rgba[3];
+}
+
+/* Read the value of an enum whose last value is @max, failing on any value
+ * beyond it. */
+static guint32
+read_enum (SceneFileReader * reader, guint32 max)
+{
+  guint32 value = read_u32 (reader);
+
+  if (value > max) {
+    reader->ok = FALSE;
+    return 0;
+  }
+  return value;
+}
+
+/* Read a double, failing on an infinity or NaN. */
+static gdouble
+read_finite_double (SceneFileReader * reader)
+{
+  gdouble value = read_double (reader);
+
+  if (!isfinite (value)) {
+    reader->ok = FALSE;
+    return 0.0;
+  }
+  return value;
+}
+
+/* Returns TRUE if @count records of at least @size bytes each could follow;
+ * guards the allocations made for counts read from a corrupt file. */
+static gboolean
+reader_has_records (SceneFileReader * reader, guint32 count, gsize size)
+{
+  return reader->ok && (reader->size - reader->pos) / size >= count;
+}
+
+/* Read a style set record into @style, whose font family then points into
+ * @text. */
+static void
+read_style (SceneFileReader * reader, const gchar * text, guint32 text_size,
+    GstSubtitleStyleSet * style)
+{
+  guint32 offset, len;
+
+  style->text_direction =
+      read_enum (reader, GST_SUBTITLE_TEXT_DIRECTION_RTL);
+  style->text_align = read_enum (reader, GST_SUBTITLE_TEXT_ALIGN_END);
+  style->font_style = read_enum (reader, GST_SUBTITLE_FONT_STYLE_ITALIC);
+  style->font_weight = read_enum (reader, GST_SUBTITLE_FONT_WEIGHT_BOLD);
+  style->text_decoration =
+      read_enum (reader, GST_SUBTITLE_TEXT_DECORATION_UNDERLINE);
+  style->unicode_bidi =
+      read_enum (reader, GST_SUBTITLE_UNICODE_BIDI_OVERRIDE);
+  style->wrap_option = read_enum (reader, GST_SUBTITLE_WRAPPING_OFF);
+  style->multi_row_align =
+      read_enum (reader, GST_SUBTITLE_MULTI_ROW_ALIGN_END);
+  style->display_align = read_enum (reader, GST_SUBTITLE_DISPLAY_ALIGN_AFTER);
+  style->writing_mode = read_enum (reader, GST_SUBTITLE_WRITING_MODE_TBLR);
+  style->show_background =
+      read_enum (reader, GST_SUBTITLE_BACKGROUND_MODE_WHEN_ACTIVE);
+  style->overflow = read_enum (reader, GST_SUBTITLE_OVERFLOW_MODE_VISIBLE);
+
+  offset = read_u32 (reader);
+  len = read_u32 (reader);
+  if (offset == SCENE_FILE_NO_STRING)
+    style->font_family = NULL;
+  else if ((guint64) offset + len < text_size && text[offset + len] == '\0')
+    style->font_family = (gchar *) text + offset;
+  else
+    reader->ok = FALSE;
+
+  read_color (reader, &style->color);
+  read_color (reader, &style->background_color);
+
+  style->font_size = read_finite_double (reader);
+  style->line_height = read_finite_double (reader);
+  style->line_padding = read_finite_double (reader);
+  style->origin_x = read_finite_double (reader);
+  style->origin_y = read_finite_double (reader);
+  style->extent_w = read_finite_double (reader);
+  style->extent_h = read_finite_double (reader);
+  style->padding_start = read_finite_double (reader);
+  style->padding_end = read_finite_double (reader);
+  style->padding_before = read_finite_double (reader);
+  style->padding_after = read_finite_double (reader);
+}
+
+/* Returns a new style set that is a copy of the one at index @index of
+ * @styles, or NULL if there is none. */
+static GstSubtitleStyleSet *
+copy_style (SceneFileReader * reader, const GstSubtitleStyleSet * styles,
+    guint32 n_styles, guint32 index)
+{
+  GstSubtitleStyleSet *ret;
+
+  if (index >= n_styles) {
+    reader->ok = FALSE;
+    return NULL;
+  }
+
+  ret = gst_subtitle_style_set_new ();
+  g_free (ret->font_family);
+  *ret = styles[index];
+  ret->font_family = g_strdup (styles[index].font_family);
+  return ret;
+}
+
+/* Read a region, returning it and setting @n_texts to the number of text
+ * memories its elements require of the buffers that carry it. */
+static GstSubtitleRegion *
+read_region (SceneFileReader * reader, const GstSubtitleStyleSet * styles,
+    guint32 n_styles, guint64 * n_texts)
+{
+  GstSubtitleStyleSet *style;
+  GstSubtitleRegion *region;
+  guint32 i, j, n_blocks;
+
+  *n_texts = 0;
+  if (!(style = copy_style (reader, styles, n_styles, read_u32 (reader))))
+    return NULL;
+  region = gst_subtitle_region_new (style);
+
+  n_blocks = read_u32 (reader);
+  if (!reader_has_records (reader, n_blocks, 8)) {
+    reader->ok = FALSE;
+    n_blocks = 0;
+  }
+
+  for (i = 0; i < n_blocks && reader->ok; ++i) {
+    GstSubtitleBlock *block;
+    guint32 n_elements;
+
+    if (!(style = copy_style (reader, styles, n_styles, read_u32 (reader))))
+      break;
+    block = gst_subtitle_block_new (style);
+
+    n_elements = read_u32 (reader);
+    if (!reader_has_records (reader, n_elements, 12)) {
+      reader->ok = FALSE;
+      n_elements = 0;
+    }
+
+    for (j = 0; j < n_elements && reader->ok; ++j) {
+      guint32 text_index;
+      gboolean suppress_whitespace;
+
+      if (!(style = copy_style (reader, styles, n_styles, read_u32 (reader))))
+        break;
+      text_index = read_u32 (reader);
+      suppress_whitespace = read_u32 (reader) != 0;
+
+      gst_subtitle_block_add_element (block,
+          gst_subtitle_element_new (style, text_index, suppress_whitespace));
+      *n_texts = MAX (*n_texts, (guint64) text_index + 1);
+    }
+
+    gst_subtitle_region_add_block (region, block);
+  }
+
+  return region;
+}
+
+/* Returns the scenes held in the scene file @filename, as a new array of
+ * buffers, or NULL if the file cannot be read, is not a scene file of this
+ * version and byte order, is corrupt, or was not made from the TTML file
+ * identified by @source as it is now. */
+GPtrArray *
+scene_file_read (const gchar * filename, const SceneFileSource * source,
+    GError ** error)
+{
+  GMappedFile *file;
+  SceneFileReader reader;
+  gchar magic[SCENE_FILE_MAGIC_SIZE];
+  guint8 digest[SCENE_FILE_DIGEST_SIZE];
+  guint64 size;
+  gint64 mtime;
+  guint32 text_size, n_styles, n_regions, n_scenes, i, j;
+  const gchar *text;
+  GstSubtitleStyleSet *styles = NULL;
+  GPtrArray *regions = NULL, *ret = NULL;
+  guint64 *region_texts = NULL;
+  GstMemory *text_mem = NULL;
+
+  file = g_mapped_file_new (filename, FALSE, error);
+  if (!file)
+    return NULL;
+
+  reader.data = (const guint8 *) g_mapped_file_get_contents (file);
+  reader.size = g_mapped_file_get_length (file);
+  reader.pos = 0;
+  reader.ok = TRUE;
+
+  read_bytes (&reader, magic, SCENE_FILE_MAGIC_SIZE);
+  if (!reader.ok || memcmp (magic, SCENE_FILE_MAGIC, SCENE_FILE_MAGIC_SIZE)
+      || read_u32 (&reader) != SCENE_FILE_VERSION
+      || read_u32 (&reader) != SCENE_FILE_BYTE_ORDER) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s is not a scene file of a supported version", filename);
+    goto done;
+  }
+
+  size = read_u64 (&reader);
+  mtime = read_u64 (&reader);
+  read_bytes (&reader, digest, SCENE_FILE_DIGEST_SIZE);
+  if (!reader.ok || size != source->size || mtime != source->mtime
+      || memcmp (digest, source->digest, SCENE_FILE_DIGEST_SIZE)) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "%s is out of date", filename);
+    goto done;
+  }
+
+  text_size = read_u32 (&reader);
+  n_styles = read_u32 (&reader);
+  n_regions = read_u32 (&reader);
+  n_scenes = read_u32 (&reader);
+  if (!reader.ok || text_size % 8 || reader.size - reader.pos < text_size)
+    goto corrupt;
+  text = (const gchar *) reader.data + reader.pos;
+  reader.pos += text_size;
+
+  if (!reader_has_records (&reader, n_styles, SCENE_FILE_STYLE_SIZE))
+    goto corrupt;
+  styles = g_new0 (GstSubtitleStyleSet, n_styles);
+  for (i = 0; i < n_styles; ++i)
+    read_style (&reader, text, text_size, &styles[i]);
+
+  if (!reader_has_records (&reader, n_regions, 8))
+    goto corrupt;
+  regions = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_subtitle_region_unref);
+  region_texts = g_new0 (guint64, n_regions);
+  for (i = 0; i < n_regions && reader.ok; ++i) {
+    GstSubtitleRegion *region = read_region (&reader, styles, n_styles,
+        &region_texts[i]);
+
+    if (region)
+      g_ptr_array_add (regions, region);
+  }
+  if (!reader.ok)
+    goto corrupt;
+
+  if (text_size > 0)
+    text_mem = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
+        (gpointer) text, text_size, 0, text_size, g_mapped_file_ref (file),
+        (GDestroyNotify) g_mapped_file_unref);
+
+  if (!reader_has_records (&reader, n_scenes, 24))
+    goto corrupt;
+  ret = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_buffer_unref);
+  for (i = 0; i < n_scenes && reader.ok; ++i) {
+    GstBuffer *scene = gst_buffer_new ();
+    GPtrArray *scene_regions;
+    guint32 n_memory, n_scene_regions;
+
+    g_ptr_array_add (ret, scene);
+    GST_BUFFER_PTS (scene) = read_u64 (&reader);
+    GST_BUFFER_DURATION (scene) = read_u64 (&reader);
+
+    n_memory = read_u32 (&reader);
+    if (!reader_has_records (&reader, n_memory, 8)) {
+      reader.ok = FALSE;
+      break;
+    }
+    for (j = 0; j < n_memory; ++j) {
+      guint32 offset = read_u32 (&reader);
+      guint32 mem_size = read_u32 (&reader);
+
+      if ((guint64) offset + mem_size > text_size || !text_mem) {
+        reader.ok = FALSE;
+        break;
+      }
+      gst_buffer_append_memory (scene,
+          gst_memory_share (text_mem, offset, mem_size));
+    }
+
+    n_scene_regions = read_u32 (&reader);
+    if (!reader_has_records (&reader, n_scene_regions, 4)) {
+      reader.ok = FALSE;
+      break;
+    }
+    scene_regions = g_ptr_array_new_with_free_func (
+        (GDestroyNotify) gst_subtitle_region_unref);
+    for (j = 0; j < n_scene_regions; ++j) {
+      guint32 index = read_u32 (&reader);
+
+      /* Every element's text must be in the scene's buffer. */
+      if (index >= regions->len || region_texts[index] > n_memory) {
+        reader.ok = FALSE;
+        break;
+      }
+      g_ptr_array_add (scene_regions,
+          gst_subtitle_region_ref (g_ptr_array_index (regions, index)));
+    }
+    gst_buffer_add_subtitle_meta (scene, scene_regions);
+  }
+
+  if (!reader.ok || ret->len != n_scenes)
+    goto corrupt;
+  goto done;
+
+corrupt:
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+      "%s is corrupt", filename);
+  if (ret) {
+    g_ptr_array_free (ret, TRUE);
+    ret = NULL;
+  }
+
+done:
+  if (text_mem)
+    gst_memory_unref (text_mem);
+  if (regions)
+    g_ptr_array_free (regions, TRUE);
+  g_free (region_texts);
+  g_free (styles);
+  g_mapped_file_unref (file);
+  return ret;
+}
@@ -0,0 +1,48 @@
+/* GStreamer TTML scene files
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _SCENE_FILE_H_
+#define _SCENE_FILE_H_
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+typedef struct _SceneFileSource SceneFileSource;
+
+SceneFileSource * scene_file_source_new  (const gchar * path,
+                                          GError ** error);
+
+void              scene_file_source_free (SceneFileSource * source);
+
+gchar *           scene_file_get_path    (const gchar * source_path,
+                                          const gchar * cache_dir);
+
+gboolean          scene_file_write       (const gchar * filename,
+                                          const SceneFileSource * source,
+                                          const GPtrArray * scenes,
+                                          GError ** error);
+
+GPtrArray *       scene_file_read        (const gchar * filename,
+                                          const SceneFileSource * source,
+                                          GError ** error);
+
+G_END_DECLS
+
+#endif /* _SCENE_FILE_H_ */
@@ -0,0 +1,170 @@
+/* GStreamer subtitle parser text encoding helpers
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include "textencoding.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Subtitle text is mostly ASCII, so validation skips runs of ASCII a block
+ * at a time and decodes only the multi-byte sequences between them. */
+
+
+/* Returns the number of leading bytes of the @len bytes at @p that are
+ * non-NUL ASCII characters, rounded down to a whole number of blocks. */
+static gsize
+skip_ascii (const guchar * p, gsize len)
+{
+  gsize i = 0;
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128 ();
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i block = _mm_loadu_si128 ((const __m128i *) (p + i));
+
+    /* High bits mark non-ASCII bytes; compare with zero to find NULs. */
+    if (_mm_movemask_epi8 (block)
+        || _mm_movemask_epi8 (_mm_cmpeq_epi8 (block, zero)))
+      break;
+  }
+#else
+  for (; i + 8 <= len; i += 8) {
+    guint64 word;
+
+    memcpy (&word, p + i, 8);
+    /* The second term is non-zero if any byte of the word is zero. */
+    if ((word & G_GUINT64_CONSTANT (0x8080808080808080))
+        || ((word - G_GUINT64_CONSTANT (0x0101010101010101)) & ~word
+            & G_GUINT64_CONSTANT (0x8080808080808080)))
+      break;
+  }
+#endif
+
+  return i;
+}
+
+
+/* Returns the length of the valid UTF-8 character at the start of the @len
+ * bytes at @p, or 0 if there is no complete, valid, non-NUL character
+ * there. */
+static guint
+validate_char (const guchar * p, gsize len)
+{
+  guchar c = p[0];
+  guint n, i;
+  guchar min = 0x80, max = 0xBF;
+
+  if (c == 0)
+    return 0;
+  if (c < 0x80)
+    return 1;
+
+  if (c < 0xC2) {
+    /* Continuation bytes, and leading bytes of overlong forms. */
+    return 0;
+  } else if (c < 0xE0) {
+    n = 2;
+  } else if (c < 0xF0) {
+    n = 3;
+    if (c == 0xE0)
+      min = 0xA0;               /* overlong */
+    else if (c == 0xED)
+      max = 0x9F;               /* surrogates */
+  } else if (c < 0xF5) {
+    n = 4;
+    if (c == 0xF0)
+      min = 0x90;               /* overlong */
+    else if (c == 0xF4)
+      max = 0x8F;               /* beyond U+10FFFF */
+  } else {
+    return 0;
+  }
+
+  if (len < n || p[1] < min || p[1] > max)
+    return 0;
+  for (i = 2; i < n; ++i) {
+    if (p[i] < 0x80 || p[i] > 0xBF)
+      return 0;
+  }
+
+  return n;
+}
+
+
+/* Validate the @len bytes at @str as UTF-8, as g_utf8_validate() does: NUL
+ * bytes are invalid, as are overlong forms, surrogates and code points
+ * beyond U+10FFFF. If @end is non-NULL, it is set to the end of the valid
+ * text. Returns TRUE if all of @str is valid. */
+gboolean
+text_encoding_validate_utf8 (const gchar * str, gsize len, const gchar ** end)
+{
+  const guchar *p = (const guchar *) str;
+  gsize i = 0;
+
+  while (i < len) {
+    guint n;
+
+    i += skip_ascii (p + i, len - i);
+    if (i == len)
+      break;
+
+    /* Finish any ASCII run byte by byte, then take a multi-byte
+     * character. */
+    if (!(n = validate_char (p + i, len - i)))
+      break;
+    i += n;
+  }
+
+  if (end)
+    *end = str + i;
+  return i == len;
+}
+
+
+/* Returns the encoding identified by a byte order mark at the start of the
+ * @len bytes at @str, or NULL if there is none. */
+const gchar *
+text_encoding_detect_bom (const gchar * str, gsize len)
+{
+  const guchar *p = (const guchar *) str;
+
+  if (len >= 3 && p[0] == 0xEF && p[1] == 0xBB && p[2] == 0xBF)
+    return "UTF-8";
+
+  /* The UTF-32LE mark starts with the UTF-16LE one, so test for it first. */
+  if (len >= 4 && p[0] == 0xFF && p[1] == 0xFE && p[2] == 0x00
+      && p[3] == 0x00)
+    return "UTF-32LE";
+
+  if (len >= 4 && p[0] == 0x00 && p[1] == 0x00 && p[2] == 0xFE
+      && p[3] == 0xFF)
+    return "UTF-32BE";
+
+  if (len >= 2 && p[0] == 0xFE && p[1] == 0xFF)
+    return "UTF-16BE";
+
+  if (len >= 2 && p[0] == 0xFF && p[1] == 0xFE)
+    return "UTF-16LE";
+
+  return NULL;
+}
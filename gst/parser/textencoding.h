@@ -0,0 +1,34 @@
+/* GStreamer subtitle parser text encoding helpers
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _TEXT_ENCODING_H_
+#define _TEXT_ENCODING_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+gboolean      text_encoding_validate_utf8 (const gchar * str, gsize len,
+                                           const gchar ** end);
+
+const gchar * text_encoding_detect_bom    (const gchar * str, gsize len);
+
+G_END_DECLS
+
+#endif /* _TEXT_ENCODING_H_ */
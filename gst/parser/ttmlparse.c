@@ -32,7 +32,6 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <math.h>
 #include <libxml/xmlmemory.h>
 #include <libxml/parser.h>
 
@@ -44,7 +43,282 @@
 
 GST_DEBUG_CATEGORY_STATIC (ttmlparse);
 
-static gchar * ttml_get_xml_property (const xmlNode * node, const char * name);
+/* Size of the blocks from which an arena's allocations are made, and the
+ * alignment of each allocation (sufficient for the gdoubles and
+ * GstClockTimes in TtmlStyleSet and TtmlElement). */
+#define TTML_ARENA_BLOCK_SIZE 16384
+#define TTML_ARENA_ALIGNMENT 8
+
+typedef struct _TtmlArenaBlock TtmlArenaBlock;
+
+struct _TtmlArenaBlock {
+  TtmlArenaBlock *next;
+};
+
+/* A bump allocator holding the elements, style sets, strings and tree nodes
+ * created while parsing a single document. Nothing allocated from an arena is
+ * freed individually; everything is released together when the arena is
+ * freed. */
+typedef struct {
+  TtmlArenaBlock *blocks;
+  guint8 *pos;
+  gsize remaining;
+} TtmlArena;
+
+/* Offset of the first allocation in each block. */
+#define TTML_ARENA_HEADER_SIZE \
+  ((sizeof (TtmlArenaBlock) + TTML_ARENA_ALIGNMENT - 1) \
+   & ~(gsize) (TTML_ARENA_ALIGNMENT - 1))
+
+
+static TtmlArena *
+ttml_arena_new (void)
+{
+  return g_slice_new0 (TtmlArena);
+}
+
+
+static void
+ttml_arena_free (TtmlArena * arena)
+{
+  TtmlArenaBlock *block = arena->blocks;
+
+  while (block) {
+    TtmlArenaBlock *next = block->next;
+    g_free (block);
+    block = next;
+  }
+  g_slice_free (TtmlArena, arena);
+}
+
+
+static gpointer
+ttml_arena_alloc (TtmlArena * arena, gsize size)
+{
+  TtmlArenaBlock *block;
+  gpointer ret;
+
+  size = (size + TTML_ARENA_ALIGNMENT - 1)
+    & ~(gsize) (TTML_ARENA_ALIGNMENT - 1);
+
+  if (size > arena->remaining) {
+    gsize block_size = MAX (size, TTML_ARENA_BLOCK_SIZE);
+
+    block = g_malloc (TTML_ARENA_HEADER_SIZE + block_size);
+    if (block_size > TTML_ARENA_BLOCK_SIZE && arena->blocks) {
+      /* Give an oversized allocation a block of its own, leaving the current
+       * block to serve subsequent allocations. */
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+      return (guint8 *) block + TTML_ARENA_HEADER_SIZE;
+    }
+    block->next = arena->blocks;
+    arena->blocks = block;
+    arena->pos = (guint8 *) block + TTML_ARENA_HEADER_SIZE;
+    arena->remaining = block_size;
+  }
+
+  ret = arena->pos;
+  arena->pos += size;
+  arena->remaining -= size;
+  return ret;
+}
+
+
+static gpointer
+ttml_arena_alloc0 (TtmlArena * arena, gsize size)
+{
+  return memset (ttml_arena_alloc (arena, size), 0, size);
+}
+
+
+/* Transfer every allocation made from @src to @dest, and free @src. The
+ * current block of @dest continues to serve subsequent allocations. */
+static void
+ttml_arena_merge (TtmlArena * dest, TtmlArena * src)
+{
+  TtmlArenaBlock *last;
+
+  if (src->blocks && !dest->blocks) {
+    *dest = *src;
+  } else if (src->blocks) {
+    for (last = src->blocks; last->next; last = last->next);
+    last->next = dest->blocks->next;
+    dest->blocks->next = src->blocks;
+  }
+  g_slice_free (TtmlArena, src);
+}
+
+
+#define ttml_arena_new0(arena, type) \
+  ((type *) ttml_arena_alloc0 ((arena), sizeof (type)))
+
+
+static gchar *
+ttml_arena_strndup (TtmlArena * arena, const gchar * str, gsize len)
+{
+  gchar *ret = ttml_arena_alloc (arena, len + 1);
+
+  memcpy (ret, str, len);
+  ret[len] = '\0';
+  return ret;
+}
+
+
+/* Split @str, of length @len, into the space-separated tokens it contains.
+ * Returns a NULL-terminated array of tokens, all allocated from @arena. */
+static gchar **
+ttml_arena_split_tokens (TtmlArena * arena, const gchar * str, gsize len)
+{
+  const gchar *end = str + len;
+  const gchar *c;
+  gchar **ret;
+  guint n_tokens = 0, i = 0;
+
+  for (c = str; c < end; ++c) {
+    if (*c != ' ' && (c == str || *(c - 1) == ' '))
+      ++n_tokens;
+  }
+
+  ret = ttml_arena_alloc (arena, (n_tokens + 1) * sizeof (gchar *));
+  for (c = str; c < end;) {
+    const gchar *token;
+
+    while (c < end && *c == ' ')
+      ++c;
+    if (c == end)
+      break;
+    token = c;
+    while (c < end && *c != ' ')
+      ++c;
+    ret[i++] = ttml_arena_strndup (arena, token, c - token);
+  }
+  ret[i] = NULL;
+
+  return ret;
+}
+
+
+/* Create a tree node holding @data. The node must not be freed with
+ * g_node_destroy(). */
+static GNode *
+ttml_arena_node_new (TtmlArena * arena, gpointer data)
+{
+  GNode *node = ttml_arena_new0 (arena, GNode);
+
+  node->data = data;
+  return node;
+}
+
+
+/* Work that parsers in parallel mode share out to a thread pool. The pool is
+ * shared by all parsers in the process, so each batch of tasks is tracked by
+ * a TtmlTaskGroup of its own. */
+typedef struct {
+  GMutex lock;
+  GCond cond;
+  guint pending;
+} TtmlTaskGroup;
+
+typedef struct {
+  TtmlTaskGroup *group;
+  GFunc func;
+  gpointer data;
+} TtmlTask;
+
+
+static void
+ttml_run_task (gpointer data, gpointer user_data)
+{
+  TtmlTask *task = data;
+  TtmlTaskGroup *group = task->group;
+
+  task->func (task->data, NULL);
+
+  g_mutex_lock (&group->lock);
+  if (--group->pending == 0)
+    g_cond_signal (&group->cond);
+  g_mutex_unlock (&group->lock);
+}
+
+
+/* Returns the thread pool shared by all parsers, creating it if need be, or
+ * NULL if it could not be created. */
+static GThreadPool *
+ttml_get_thread_pool (void)
+{
+  static gsize pool = 0;
+
+  if (g_once_init_enter (&pool)) {
+    GError *error = NULL;
+    GThreadPool *p = g_thread_pool_new (ttml_run_task, NULL,
+        g_get_num_processors (), FALSE, &error);
+
+    if (!p) {
+      GST_CAT_WARNING (ttmlparse, "Could not create thread pool: %s",
+          error->message);
+      g_error_free (error);
+    }
+    g_once_init_leave (&pool, (gsize) p + 1);
+  }
+
+  return (GThreadPool *) (pool - 1);
+}
+
+
+/* Call @func on each of the @n_items items in @items, using the shared
+ * thread pool if @parallel is set, and return once every call has returned.
+ * @func is passed each item and NULL. */
+static void
+ttml_run_parallel (GFunc func, gpointer * items, guint n_items,
+    gboolean parallel)
+{
+  GThreadPool *pool = parallel && n_items > 1 ? ttml_get_thread_pool () : NULL;
+  TtmlTaskGroup group;
+  TtmlTask *tasks;
+  guint i;
+
+  if (!pool) {
+    for (i = 0; i < n_items; ++i)
+      func (items[i], NULL);
+    return;
+  }
+
+  g_mutex_init (&group.lock);
+  g_cond_init (&group.cond);
+  group.pending = n_items;
+  tasks = g_new (TtmlTask, n_items);
+
+  for (i = 0; i < n_items; ++i) {
+    tasks[i].group = &group;
+    tasks[i].func = func;
+    tasks[i].data = items[i];
+    g_thread_pool_push (pool, &tasks[i], NULL);
+  }
+
+  g_mutex_lock (&group.lock);
+  while (group.pending > 0)
+    g_cond_wait (&group.cond, &group.lock);
+  g_mutex_unlock (&group.lock);
+
+  g_free (tasks);
+  g_cond_clear (&group.cond);
+  g_mutex_clear (&group.lock);
+}
+
+
+/* The attributes of an element, as passed to the startElementNs SAX2
+ * callback: for each attribute, @values holds five pointers giving its local
+ * name, prefix, namespace URI, and the start and end of its value. */
+typedef struct {
+  const xmlChar **values;
+  gint n_attributes;
+} TtmlAttributes;
+
+static const xmlChar ** ttml_find_attribute (
+    const TtmlAttributes * attributes, const gchar * name);
+static gchar * ttml_get_attribute (const TtmlAttributes * attributes,
+    const gchar * name);
 
 
 static guint8
@@ -92,6 +366,294 @@ ttml_parse_colorstring (const gchar * color)
 }
 
 
+/* Maps a keyword appearing in a styling attribute onto the corresponding
+ * enum value. Keyword tables are terminated by an entry with a NULL keyword,
+ * whose value is used for any unrecognised keyword. */
+typedef struct {
+  const gchar *keyword;
+  gint value;
+} TtmlStyleKeyword;
+
+/* Parses the value of a styling attribute into the field at @dest. */
+typedef void (*TtmlStyleParseFunc) (gpointer dest, const gchar * value);
+
+typedef struct {
+  const gchar *attribute;
+  TtmlStyleProp prop;
+  gsize offset;
+  gsize size;
+  const TtmlStyleKeyword *keywords;
+  TtmlStyleParseFunc parse;
+} TtmlStyleAttribute;
+
+
+static const TtmlStyleKeyword ttml_text_direction_keywords[] = {
+  { "rtl", GST_SUBTITLE_TEXT_DIRECTION_RTL },
+  { NULL, GST_SUBTITLE_TEXT_DIRECTION_LTR }
+};
+
+static const TtmlStyleKeyword ttml_text_align_keywords[] = {
+  { "left", GST_SUBTITLE_TEXT_ALIGN_LEFT },
+  { "center", GST_SUBTITLE_TEXT_ALIGN_CENTER },
+  { "right", GST_SUBTITLE_TEXT_ALIGN_RIGHT },
+  { "end", GST_SUBTITLE_TEXT_ALIGN_END },
+  { NULL, GST_SUBTITLE_TEXT_ALIGN_START }
+};
+
+static const TtmlStyleKeyword ttml_font_style_keywords[] = {
+  { "italic", GST_SUBTITLE_FONT_STYLE_ITALIC },
+  { NULL, GST_SUBTITLE_FONT_STYLE_NORMAL }
+};
+
+static const TtmlStyleKeyword ttml_font_weight_keywords[] = {
+  { "bold", GST_SUBTITLE_FONT_WEIGHT_BOLD },
+  { NULL, GST_SUBTITLE_FONT_WEIGHT_NORMAL }
+};
+
+static const TtmlStyleKeyword ttml_text_decoration_keywords[] = {
+  { "underline", GST_SUBTITLE_TEXT_DECORATION_UNDERLINE },
+  { NULL, GST_SUBTITLE_TEXT_DECORATION_NONE }
+};
+
+static const TtmlStyleKeyword ttml_unicode_bidi_keywords[] = {
+  { "embed", GST_SUBTITLE_UNICODE_BIDI_EMBED },
+  { "bidiOverride", GST_SUBTITLE_UNICODE_BIDI_OVERRIDE },
+  { NULL, GST_SUBTITLE_UNICODE_BIDI_NORMAL }
+};
+
+static const TtmlStyleKeyword ttml_wrap_option_keywords[] = {
+  { "noWrap", GST_SUBTITLE_WRAPPING_OFF },
+  { NULL, GST_SUBTITLE_WRAPPING_ON }
+};
+
+static const TtmlStyleKeyword ttml_multi_row_align_keywords[] = {
+  { "start", GST_SUBTITLE_MULTI_ROW_ALIGN_START },
+  { "center", GST_SUBTITLE_MULTI_ROW_ALIGN_CENTER },
+  { "end", GST_SUBTITLE_MULTI_ROW_ALIGN_END },
+  { NULL, GST_SUBTITLE_MULTI_ROW_ALIGN_AUTO }
+};
+
+static const TtmlStyleKeyword ttml_display_align_keywords[] = {
+  { "center", GST_SUBTITLE_DISPLAY_ALIGN_CENTER },
+  { "after", GST_SUBTITLE_DISPLAY_ALIGN_AFTER },
+  { NULL, GST_SUBTITLE_DISPLAY_ALIGN_BEFORE }
+};
+
+static const TtmlStyleKeyword ttml_overflow_keywords[] = {
+  { "visible", GST_SUBTITLE_OVERFLOW_MODE_VISIBLE },
+  { NULL, GST_SUBTITLE_OVERFLOW_MODE_HIDDEN }
+};
+
+static const TtmlStyleKeyword ttml_writing_mode_keywords[] = {
+  { "rl", GST_SUBTITLE_WRITING_MODE_RLTB },
+  { "rltb", GST_SUBTITLE_WRITING_MODE_RLTB },
+  { "tbrl", GST_SUBTITLE_WRITING_MODE_TBRL },
+  { "tb", GST_SUBTITLE_WRITING_MODE_TBRL },
+  { "tblr", GST_SUBTITLE_WRITING_MODE_TBLR },
+  { NULL, GST_SUBTITLE_WRITING_MODE_LRTB }
+};
+
+static const TtmlStyleKeyword ttml_show_background_keywords[] = {
+  { "whenActive", GST_SUBTITLE_BACKGROUND_MODE_WHEN_ACTIVE },
+  { NULL, GST_SUBTITLE_BACKGROUND_MODE_ALWAYS }
+};
+
+
+/* @value is allocated from the arena of the style set, so is kept as it
+ * is. */
+static void
+ttml_parse_font_family (gpointer dest, const gchar * value)
+{
+  if (strlen (value) <= MAX_FONT_FAMILY_NAME_LENGTH)
+    *(const gchar **) dest = value;
+  else
+    GST_CAT_WARNING (ttmlparse,
+        "Ignoring font family name as it's overly long.");
+}
+
+
+static void
+ttml_parse_number (gpointer dest, const gchar * value)
+{
+  *(gdouble *) dest = g_ascii_strtod (value, NULL);
+}
+
+
+static void
+ttml_parse_line_height (gpointer dest, const gchar * value)
+{
+  /* The TTML spec (section 8.2.12) recommends using a line height of 125%
+   * when "normal" is specified. */
+  if (g_strcmp0 (value, "normal") == 0)
+    *(gdouble *) dest = 125.0;
+  else
+    *(gdouble *) dest = g_ascii_strtod (value, NULL);
+}
+
+
+static void
+ttml_parse_color (gpointer dest, const gchar * value)
+{
+  *(GstSubtitleColor *) dest = ttml_parse_colorstring (value);
+}
+
+
+/* Parse a pair of percentages, e.g., "10% 80%", into fractions. */
+static void
+ttml_parse_percentage_pair (gpointer dest, const gchar * value)
+{
+  gdouble *pair = dest;
+  gchar *c;
+
+  pair[0] = g_ascii_strtod (value, &c) / 100.0;
+  while (*c && !g_ascii_isdigit (*c) && *c != '+' && *c != '-') ++c;
+  pair[1] = g_ascii_strtod (c, NULL) / 100.0;
+}
+
+
+/* Parse between one and four percentages into fractions, expanding them to
+ * give a value for each of the before, end, after and start edges. */
+static void
+ttml_parse_padding (gpointer dest, const gchar * value)
+{
+  gdouble *padding = dest;
+  gdouble values[4];
+  const gchar *c = value;
+  guint n_values = 0;
+
+  while (n_values < 4) {
+    gchar *end;
+    gdouble v = g_ascii_strtod (c, &end);
+
+    while (*end == ' ') ++end;
+    if (end == c || *end != '%')
+      break;
+    values[n_values++] = v / 100.0;
+    c = end + 1;
+  }
+
+  switch (n_values) {
+    case 1:
+      padding[0] = padding[1] = padding[2] = padding[3] = values[0];
+      break;
+    case 2:
+      padding[0] = padding[2] = values[0];
+      padding[1] = padding[3] = values[1];
+      break;
+    case 3:
+      padding[0] = values[0];
+      padding[1] = padding[3] = values[1];
+      padding[2] = values[2];
+      break;
+    case 4:
+      memcpy (padding, values, sizeof (values));
+      break;
+  }
+}
+
+
+#define TTML_STYLE_FIELD(field) \
+  G_STRUCT_OFFSET (TtmlStyleSet, field), \
+  sizeof (((TtmlStyleSet *) NULL)->field)
+
+static const TtmlStyleAttribute ttml_style_attributes[] = {
+  { "direction", TTML_STYLE_PROP_TEXT_DIRECTION,
+    TTML_STYLE_FIELD (text_direction), ttml_text_direction_keywords, NULL },
+  { "fontFamily", TTML_STYLE_PROP_FONT_FAMILY,
+    TTML_STYLE_FIELD (font_family), NULL, ttml_parse_font_family },
+  { "fontSize", TTML_STYLE_PROP_FONT_SIZE,
+    TTML_STYLE_FIELD (font_size), NULL, ttml_parse_number },
+  { "lineHeight", TTML_STYLE_PROP_LINE_HEIGHT,
+    TTML_STYLE_FIELD (line_height), NULL, ttml_parse_line_height },
+  { "textAlign", TTML_STYLE_PROP_TEXT_ALIGN,
+    TTML_STYLE_FIELD (text_align), ttml_text_align_keywords, NULL },
+  { "color", TTML_STYLE_PROP_COLOR,
+    TTML_STYLE_FIELD (color), NULL, ttml_parse_color },
+  { "backgroundColor", TTML_STYLE_PROP_BACKGROUND_COLOR,
+    TTML_STYLE_FIELD (background_color), NULL, ttml_parse_color },
+  { "fontStyle", TTML_STYLE_PROP_FONT_STYLE,
+    TTML_STYLE_FIELD (font_style), ttml_font_style_keywords, NULL },
+  { "fontWeight", TTML_STYLE_PROP_FONT_WEIGHT,
+    TTML_STYLE_FIELD (font_weight), ttml_font_weight_keywords, NULL },
+  { "textDecoration", TTML_STYLE_PROP_TEXT_DECORATION,
+    TTML_STYLE_FIELD (text_decoration), ttml_text_decoration_keywords, NULL },
+  { "unicodeBidi", TTML_STYLE_PROP_UNICODE_BIDI,
+    TTML_STYLE_FIELD (unicode_bidi), ttml_unicode_bidi_keywords, NULL },
+  { "wrapOption", TTML_STYLE_PROP_WRAP_OPTION,
+    TTML_STYLE_FIELD (wrap_option), ttml_wrap_option_keywords, NULL },
+  { "multiRowAlign", TTML_STYLE_PROP_MULTI_ROW_ALIGN,
+    TTML_STYLE_FIELD (multi_row_align), ttml_multi_row_align_keywords, NULL },
+  { "linePadding", TTML_STYLE_PROP_LINE_PADDING,
+    TTML_STYLE_FIELD (line_padding), NULL, ttml_parse_number },
+  { "origin", TTML_STYLE_PROP_ORIGIN,
+    TTML_STYLE_FIELD (origin), NULL, ttml_parse_percentage_pair },
+  { "extent", TTML_STYLE_PROP_EXTENT,
+    TTML_STYLE_FIELD (extent), NULL, ttml_parse_percentage_pair },
+  { "displayAlign", TTML_STYLE_PROP_DISPLAY_ALIGN,
+    TTML_STYLE_FIELD (display_align), ttml_display_align_keywords, NULL },
+  { "overflow", TTML_STYLE_PROP_OVERFLOW,
+    TTML_STYLE_FIELD (overflow), ttml_overflow_keywords, NULL },
+  { "padding", TTML_STYLE_PROP_PADDING,
+    TTML_STYLE_FIELD (padding), NULL, ttml_parse_padding },
+  { "writingMode", TTML_STYLE_PROP_WRITING_MODE,
+    TTML_STYLE_FIELD (writing_mode), ttml_writing_mode_keywords, NULL },
+  { "showBackground", TTML_STYLE_PROP_SHOW_BACKGROUND,
+    TTML_STYLE_FIELD (show_background), ttml_show_background_keywords, NULL },
+};
+
+/*
+ * The following styling attributes are not inherited:
+ *   - tts:backgroundColor
+ *   - tts:origin
+ *   - tts:extent
+ *   - tts:displayAlign
+ *   - tts:overflow
+ *   - tts:padding
+ *   - tts:writingMode
+ *   - tts:showBackground
+ *   - tts:unicodeBidi
+ */
+#define TTML_STYLE_INHERITED_PROPS \
+  (TTML_STYLE_PROP_TEXT_DIRECTION | TTML_STYLE_PROP_FONT_FAMILY \
+   | TTML_STYLE_PROP_FONT_SIZE | TTML_STYLE_PROP_LINE_HEIGHT \
+   | TTML_STYLE_PROP_TEXT_ALIGN | TTML_STYLE_PROP_COLOR \
+   | TTML_STYLE_PROP_FONT_STYLE | TTML_STYLE_PROP_FONT_WEIGHT \
+   | TTML_STYLE_PROP_TEXT_DECORATION | TTML_STYLE_PROP_WRAP_OPTION \
+   | TTML_STYLE_PROP_MULTI_ROW_ALIGN | TTML_STYLE_PROP_LINE_PADDING)
+
+
+static const TtmlStyleAttribute *
+ttml_lookup_style_attribute (const gchar * name)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (ttml_style_attributes); ++i) {
+    if (g_strcmp0 (ttml_style_attributes[i].attribute, name) == 0)
+      return &ttml_style_attributes[i];
+  }
+  return NULL;
+}
+
+
+static gint
+ttml_lookup_style_keyword (const TtmlStyleKeyword * keywords,
+    const gchar * value)
+{
+  for (; keywords->keyword; ++keywords) {
+    if (g_strcmp0 (keywords->keyword, value) == 0)
+      break;
+  }
+  return keywords->value;
+}
+
+
+static TtmlStyleSet *
+ttml_style_set_new (TtmlArena * arena)
+{
+  return ttml_arena_new0 (arena, TtmlStyleSet);
+}
+
+
 static void
 ttml_print_style_set (TtmlStyleSet * set)
 {
@@ -100,1670 +662,3934 @@ ttml_print_style_set (TtmlStyleSet * set)
     return;
   }
 
-  if (set->text_direction)
-    GST_CAT_LOG (ttmlparse, "\t\ttext_direction: %s", set->text_direction);
-  if (set->font_family)
+  if (set->present & TTML_STYLE_PROP_TEXT_DIRECTION)
+    GST_CAT_LOG (ttmlparse, "\t\ttext_direction: %d", set->text_direction);
+  if (set->present & TTML_STYLE_PROP_FONT_FAMILY)
     GST_CAT_LOG (ttmlparse, "\t\tfont_family: %s", set->font_family);
-  if (set->font_size)
-    GST_CAT_LOG (ttmlparse, "\t\tfont_size: %s", set->font_size);
-  if (set->line_height)
-    GST_CAT_LOG (ttmlparse, "\t\tline_height: %s", set->line_height);
-  if (set->text_align)
-    GST_CAT_LOG (ttmlparse, "\t\ttext_align: %s", set->text_align);
-  if (set->color)
-    GST_CAT_LOG (ttmlparse, "\t\tcolor: %s", set->color);
-  if (set->background_color)
-    GST_CAT_LOG (ttmlparse, "\t\tbackground_color: %s", set->background_color);
-  if (set->font_style)
-    GST_CAT_LOG (ttmlparse, "\t\tfont_style: %s", set->font_style);
-  if (set->font_weight)
-    GST_CAT_LOG (ttmlparse, "\t\tfont_weight: %s", set->font_weight);
-  if (set->text_decoration)
-    GST_CAT_LOG (ttmlparse, "\t\ttext_decoration: %s", set->text_decoration);
-  if (set->unicode_bidi)
-    GST_CAT_LOG (ttmlparse, "\t\tunicode_bidi: %s", set->unicode_bidi);
-  if (set->wrap_option)
-    GST_CAT_LOG (ttmlparse, "\t\twrap_option: %s", set->wrap_option);
-  if (set->multi_row_align)
-    GST_CAT_LOG (ttmlparse, "\t\tmulti_row_align: %s", set->multi_row_align);
-  if (set->line_padding)
-    GST_CAT_LOG (ttmlparse, "\t\tline_padding: %s", set->line_padding);
-  if (set->origin)
-    GST_CAT_LOG (ttmlparse, "\t\torigin: %s", set->origin);
-  if (set->extent)
-    GST_CAT_LOG (ttmlparse, "\t\textent: %s", set->extent);
-  if (set->display_align)
-    GST_CAT_LOG (ttmlparse, "\t\tdisplay_align: %s", set->display_align);
-  if (set->overflow)
-    GST_CAT_LOG (ttmlparse, "\t\toverflow: %s", set->overflow);
-  if (set->padding)
-    GST_CAT_LOG (ttmlparse, "\t\tpadding: %s", set->padding);
-  if (set->writing_mode)
-    GST_CAT_LOG (ttmlparse, "\t\twriting_mode: %s", set->writing_mode);
-  if (set->show_background)
-    GST_CAT_LOG (ttmlparse, "\t\tshow_background: %s", set->show_background);
+  if (set->present & TTML_STYLE_PROP_FONT_SIZE)
+    GST_CAT_LOG (ttmlparse, "\t\tfont_size: %g%%", set->font_size);
+  if (set->present & TTML_STYLE_PROP_LINE_HEIGHT)
+    GST_CAT_LOG (ttmlparse, "\t\tline_height: %g%%", set->line_height);
+  if (set->present & TTML_STYLE_PROP_TEXT_ALIGN)
+    GST_CAT_LOG (ttmlparse, "\t\ttext_align: %d", set->text_align);
+  if (set->present & TTML_STYLE_PROP_COLOR)
+    GST_CAT_LOG (ttmlparse, "\t\tcolor: %u %u %u %u", set->color.r,
+        set->color.g, set->color.b, set->color.a);
+  if (set->present & TTML_STYLE_PROP_BACKGROUND_COLOR)
+    GST_CAT_LOG (ttmlparse, "\t\tbackground_color: %u %u %u %u",
+        set->background_color.r, set->background_color.g,
+        set->background_color.b, set->background_color.a);
+  if (set->present & TTML_STYLE_PROP_FONT_STYLE)
+    GST_CAT_LOG (ttmlparse, "\t\tfont_style: %d", set->font_style);
+  if (set->present & TTML_STYLE_PROP_FONT_WEIGHT)
+    GST_CAT_LOG (ttmlparse, "\t\tfont_weight: %d", set->font_weight);
+  if (set->present & TTML_STYLE_PROP_TEXT_DECORATION)
+    GST_CAT_LOG (ttmlparse, "\t\ttext_decoration: %d", set->text_decoration);
+  if (set->present & TTML_STYLE_PROP_UNICODE_BIDI)
+    GST_CAT_LOG (ttmlparse, "\t\tunicode_bidi: %d", set->unicode_bidi);
+  if (set->present & TTML_STYLE_PROP_WRAP_OPTION)
+    GST_CAT_LOG (ttmlparse, "\t\twrap_option: %d", set->wrap_option);
+  if (set->present & TTML_STYLE_PROP_MULTI_ROW_ALIGN)
+    GST_CAT_LOG (ttmlparse, "\t\tmulti_row_align: %d", set->multi_row_align);
+  if (set->present & TTML_STYLE_PROP_LINE_PADDING)
+    GST_CAT_LOG (ttmlparse, "\t\tline_padding: %gc", set->line_padding);
+  if (set->present & TTML_STYLE_PROP_ORIGIN)
+    GST_CAT_LOG (ttmlparse, "\t\torigin: %g %g", set->origin[0],
+        set->origin[1]);
+  if (set->present & TTML_STYLE_PROP_EXTENT)
+    GST_CAT_LOG (ttmlparse, "\t\textent: %g %g", set->extent[0],
+        set->extent[1]);
+  if (set->present & TTML_STYLE_PROP_DISPLAY_ALIGN)
+    GST_CAT_LOG (ttmlparse, "\t\tdisplay_align: %d", set->display_align);
+  if (set->present & TTML_STYLE_PROP_OVERFLOW)
+    GST_CAT_LOG (ttmlparse, "\t\toverflow: %d", set->overflow);
+  if (set->present & TTML_STYLE_PROP_PADDING)
+    GST_CAT_LOG (ttmlparse, "\t\tpadding: %g %g %g %g", set->padding[0],
+        set->padding[1], set->padding[2], set->padding[3]);
+  if (set->present & TTML_STYLE_PROP_WRITING_MODE)
+    GST_CAT_LOG (ttmlparse, "\t\twriting_mode: %d", set->writing_mode);
+  if (set->present & TTML_STYLE_PROP_SHOW_BACKGROUND)
+    GST_CAT_LOG (ttmlparse, "\t\tshow_background: %d", set->show_background);
 }
 
 
 static TtmlStyleSet *
-ttml_parse_style_set (const xmlNode * node)
+ttml_parse_style_set (TtmlArena * arena, const TtmlAttributes * attributes)
 {
   TtmlStyleSet *s;
-  gchar *value = NULL;
+  const gchar *value;
+  gint i;
 
-  value = ttml_get_xml_property (node, "id");
-  if (!value) {
+  if (!ttml_find_attribute (attributes, "id")) {
     GST_CAT_ERROR (ttmlparse, "styles must have an ID.");
     return NULL;
   }
-  g_free (value);
 
-  s = g_slice_new0 (TtmlStyleSet);
+  s = ttml_style_set_new (arena);
 
-  if ((value = ttml_get_xml_property (node, "direction"))) {
-    s->text_direction = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "fontFamily"))) {
-    s->font_family = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "fontSize"))) {
-    s->font_size = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "lineHeight"))) {
-    s->line_height = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "textAlign"))) {
-    s->text_align = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "color"))) {
-    s->color = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "backgroundColor"))) {
-    s->background_color = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "fontStyle"))) {
-    s->font_style = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "fontWeight"))) {
-    s->font_weight = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "textDecoration"))) {
-    s->text_decoration = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "unicodeBidi"))) {
-    s->unicode_bidi = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "wrapOption"))) {
-    s->wrap_option = g_strdup (value);
-    g_free (value);
-  }
-  if ((value = ttml_get_xml_property (node, "multiRowAlign"))) {
-    s->multi_row_align = g_strdup (value);
-    g_free (value);
+  for (i = 0; i < attributes->n_attributes; ++i) {
+    const xmlChar **attribute = attributes->values + (i * 5);
+    const TtmlStyleAttribute *info;
+
+    info = ttml_lookup_style_attribute ((const gchar *) attribute[0]);
+    if (!info)
+      continue;
+
+    /* Values are allocated from the style set's arena, so that strings
+     * such as font family names can be kept without being copied again. */
+    value = ttml_arena_strndup (arena, (const gchar *) attribute[3],
+        attribute[4] - attribute[3]);
+
+    if (info->keywords)
+      *(gint *) G_STRUCT_MEMBER_P (s, info->offset) =
+        ttml_lookup_style_keyword (info->keywords, value);
+    else
+      info->parse (G_STRUCT_MEMBER_P (s, info->offset), value);
+
+    /* A font family that could not be used is treated as unspecified. */
+    if (info->prop != TTML_STYLE_PROP_FONT_FAMILY || s->font_family)
+      s->present |= info->prop;
   }
-  if ((value = ttml_get_xml_property (node, "linePadding"))) {
-    s->line_padding = g_strdup (value);
-    g_free (value);
+
+  return s;
+}
+
+
+/* Copy into @dest the values of those attributes in @props that are set in
+ * @src. */
+static void
+ttml_style_set_copy_props (TtmlStyleSet * dest, const TtmlStyleSet * src,
+    guint32 props)
+{
+  guint32 remaining;
+  guint i;
+
+  props &= src->present;
+  remaining = props;
+  for (i = 0; remaining && i < G_N_ELEMENTS (ttml_style_attributes); ++i) {
+    const TtmlStyleAttribute *info = &ttml_style_attributes[i];
+
+    if (remaining & info->prop) {
+      memcpy (G_STRUCT_MEMBER_P (dest, info->offset),
+          G_STRUCT_MEMBER_P (src, info->offset), info->size);
+      remaining &= ~info->prop;
+    }
   }
-  if ((value = ttml_get_xml_property (node, "origin"))) {
-    s->origin = g_strdup (value);
-    g_free (value);
+  dest->present |= props;
+}
+
+
+/* Hash the values of the attributes specified in @set. */
+static guint
+ttml_style_set_hash (const TtmlStyleSet * set)
+{
+  guint hash = set->present;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (ttml_style_attributes); ++i) {
+    const TtmlStyleAttribute *info = &ttml_style_attributes[i];
+    const guint8 *value;
+    gsize j;
+
+    if (!(set->present & info->prop))
+      continue;
+
+    if (info->prop == TTML_STYLE_PROP_FONT_FAMILY) {
+      hash = (hash * 31) + g_str_hash (set->font_family);
+      continue;
+    }
+
+    value = G_STRUCT_MEMBER_P (set, info->offset);
+    for (j = 0; j < info->size; ++j)
+      hash = (hash * 31) + value[j];
   }
-  if ((value = ttml_get_xml_property (node, "extent"))) {
-    s->extent = g_strdup (value);
-    g_free (value);
+
+  return hash;
+}
+
+
+/* Returns TRUE if @a and @b specify the same attributes with the same
+ * values. Either may be NULL. */
+static gboolean
+ttml_style_set_equal (const TtmlStyleSet * a, const TtmlStyleSet * b)
+{
+  guint i;
+
+  if (!a || !b)
+    return (a == b);
+  if (a->present != b->present)
+    return FALSE;
+
+  for (i = 0; i < G_N_ELEMENTS (ttml_style_attributes); ++i) {
+    const TtmlStyleAttribute *info = &ttml_style_attributes[i];
+
+    if (!(a->present & info->prop))
+      continue;
+
+    if (info->prop == TTML_STYLE_PROP_FONT_FAMILY) {
+      if (g_strcmp0 (a->font_family, b->font_family) != 0)
+        return FALSE;
+    } else if (memcmp (G_STRUCT_MEMBER_P (a, info->offset),
+            G_STRUCT_MEMBER_P (b, info->offset), info->size) != 0) {
+      return FALSE;
+    }
   }
-  if ((value = ttml_get_xml_property (node, "displayAlign"))) {
-    s->display_align = g_strdup (value);
-    g_free (value);
+
+  return TRUE;
+}
+
+
+/* Returns the background color in @set, or transparent if none is set. */
+static GstSubtitleColor
+ttml_get_background_color (const TtmlStyleSet * set)
+{
+  GstSubtitleColor transparent = { 0, 0, 0, 0 };
+
+  if (set->present & TTML_STYLE_PROP_BACKGROUND_COLOR)
+    return set->background_color;
+  return transparent;
+}
+
+
+/* Returns the five pointers describing the attribute with local name @name,
+ * or NULL if the element has no such attribute. As with xmlGetProp(), the
+ * namespace of the attribute is not considered. */
+static const xmlChar **
+ttml_find_attribute (const TtmlAttributes * attributes, const gchar * name)
+{
+  gint i;
+
+  for (i = 0; i < attributes->n_attributes; ++i) {
+    const xmlChar **attribute = attributes->values + (i * 5);
+
+    if (xmlStrcmp (attribute[0], (const xmlChar *) name) == 0)
+      return attribute;
   }
-  if ((value = ttml_get_xml_property (node, "overflow"))) {
-    s->overflow = g_strdup (value);
-    g_free (value);
+
+  return NULL;
+}
+
+
+/* Returns a copy of the value of the attribute with local name @name, or NULL
+ * if the element has no such attribute. */
+static gchar *
+ttml_get_attribute (const TtmlAttributes * attributes, const gchar * name)
+{
+  const xmlChar **attribute = ttml_find_attribute (attributes, name);
+
+  if (!attribute)
+    return NULL;
+  return g_strndup ((const gchar *) attribute[3], attribute[4] - attribute[3]);
+}
+
+
+/* As ttml_get_attribute(), but with the copy allocated from @arena. */
+static gchar *
+ttml_arena_get_attribute (TtmlArena * arena,
+    const TtmlAttributes * attributes, const gchar * name)
+{
+  const xmlChar **attribute = ttml_find_attribute (attributes, name);
+
+  if (!attribute)
+    return NULL;
+  return ttml_arena_strndup (arena, (const gchar *) attribute[3],
+      attribute[4] - attribute[3]);
+}
+
+
+/* Parameters, set on the root element, that determine the duration of the
+ * frames and ticks used in time expressions. The effective frame rate is
+ * @frame_rate * @frame_rate_num / @frame_rate_den frames per second. */
+typedef struct {
+  guint frame_rate;
+  guint frame_rate_num;
+  guint frame_rate_den;
+  guint sub_frame_rate;
+  guint tick_rate;
+} TtmlTimeParams;
+
+#define TTML_MAX_FRACTION_DIGITS 9
+
+static const guint64 ttml_powers_of_ten[TTML_MAX_FRACTION_DIGITS + 1] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+
+static void
+ttml_time_params_init (TtmlTimeParams * params)
+{
+  params->frame_rate = 30;
+  params->frame_rate_num = 1;
+  params->frame_rate_den = 1;
+  params->sub_frame_rate = 1;
+  params->tick_rate = 1;
+}
+
+
+static gboolean
+ttml_time_params_equal (const TtmlTimeParams * a, const TtmlTimeParams * b)
+{
+  return a->frame_rate == b->frame_rate
+    && a->frame_rate_num == b->frame_rate_num
+    && a->frame_rate_den == b->frame_rate_den
+    && a->sub_frame_rate == b->sub_frame_rate
+    && a->tick_rate == b->tick_rate;
+}
+
+
+/* Parse the run of decimal digits at *@pos, which must end before @end, into
+ * @value and advance *@pos past them. Returns the number of digits, or -1 if
+ * the value does not fit in 64 bits. */
+static gint
+ttml_parse_decimal (const gchar ** pos, const gchar * end, guint64 * value)
+{
+  const gchar *c;
+  guint64 v = 0;
+  gint n_digits;
+
+  for (c = *pos; c < end && g_ascii_isdigit (*c); ++c) {
+    guint digit = *c - '0';
+
+    if (v > (G_MAXUINT64 - digit) / 10)
+      return -1;
+    v = v * 10 + digit;
   }
-  if ((value = ttml_get_xml_property (node, "padding"))) {
-    s->padding = g_strdup (value);
-    g_free (value);
+
+  n_digits = c - *pos;
+  *pos = c;
+  *value = v;
+  return n_digits;
+}
+
+
+/* Parse the digits of a fraction at *@pos into @numerator, ignoring any
+ * digits beyond the precision of a GstClockTime. Returns the number of digits
+ * kept, i.e., the power of ten by which @numerator is to be divided, or -1 if
+ * there are no digits. */
+static gint
+ttml_parse_fraction (const gchar ** pos, const gchar * end,
+    guint64 * numerator)
+{
+  const gchar *c;
+  guint64 v = 0;
+  gint n_digits = 0;
+
+  for (c = *pos; c < end && g_ascii_isdigit (*c); ++c) {
+    if (n_digits < TTML_MAX_FRACTION_DIGITS) {
+      v = v * 10 + (*c - '0');
+      ++n_digits;
+    }
   }
-  if ((value = ttml_get_xml_property (node, "writingMode"))) {
-    s->writing_mode = g_strdup (value);
-    g_free (value);
+
+  if (c == *pos)
+    return -1;
+
+  *pos = c;
+  *numerator = v;
+  return n_digits;
+}
+
+
+/* Returns the sum of @a and @b, or GST_CLOCK_TIME_NONE if either is invalid
+ * or the sum overflows. */
+static GstClockTime
+ttml_add_times (GstClockTime a, GstClockTime b)
+{
+  if (!GST_CLOCK_TIME_IS_VALID (a) || !GST_CLOCK_TIME_IS_VALID (b)
+      || a > G_MAXUINT64 - 1 - b)
+    return GST_CLOCK_TIME_NONE;
+  return a + b;
+}
+
+
+/* Returns the time represented by @count + @fraction / 10^@n_digits units,
+ * where each unit lasts @unit_num / @unit_den nanoseconds. */
+static GstClockTime
+ttml_scale_time (guint64 count, guint64 fraction, gint n_digits,
+    guint64 unit_num, guint64 unit_den)
+{
+  GstClockTime time = gst_util_uint64_scale (count, unit_num, unit_den);
+
+  if (n_digits > 0)
+    time = ttml_add_times (time, gst_util_uint64_scale (fraction, unit_num,
+            unit_den * ttml_powers_of_ten[n_digits]));
+  return time;
+}
+
+
+/* Parse a TTML time expression (section 10.3.1 of the TTML specification),
+ * of length @len, without allocating memory. Both forms are accepted:
+ *
+ *   clock-time:  hours:minutes:seconds[.fraction | :frames[.sub-frames]]
+ *   offset-time: time-count[.fraction](h | m | s | ms | f | t)
+ *
+ * Frames and ticks are interpreted according to @params. Returns
+ * GST_CLOCK_TIME_NONE if the expression is malformed. */
+static GstClockTime
+ttml_parse_time_expression (const gchar * expr, gsize len,
+    const TtmlTimeParams * params)
+{
+  const gchar *c = expr, *end = expr + len;
+  guint64 frame_den = (guint64) params->frame_rate * params->frame_rate_num;
+  guint64 count, fraction = 0;
+  gint n_digits = 0;
+  GstClockTime time;
+
+  GST_CAT_LOG (ttmlparse, "time string: %.*s", (gint) len, expr);
+
+  while (c < end && g_ascii_isspace (*c))
+    ++c;
+  while (end > c && g_ascii_isspace (*(end - 1)))
+    --end;
+
+  if (ttml_parse_decimal (&c, end, &count) <= 0)
+    goto error;
+
+  if (c < end && *c == ':') {
+    guint64 minutes, seconds;
+
+    ++c;
+    if (ttml_parse_decimal (&c, end, &minutes) <= 0 || c == end || *c != ':')
+      goto error;
+    ++c;
+    if (ttml_parse_decimal (&c, end, &seconds) <= 0)
+      goto error;
+
+    if (minutes > 59 || seconds > 60) {
+      GST_CAT_ERROR (ttmlparse, "invalid time string "
+          "(minutes or seconds out-of-bounds): %.*s", (gint) len, expr);
+    }
+
+    time = ttml_add_times (
+        ttml_add_times (ttml_scale_time (count, 0, 0, 3600 * GST_SECOND, 1),
+            ttml_scale_time (minutes, 0, 0, 60 * GST_SECOND, 1)),
+        ttml_scale_time (seconds, 0, 0, GST_SECOND, 1));
+
+    if (c < end && *c == '.') {
+      ++c;
+      if ((n_digits = ttml_parse_fraction (&c, end, &fraction)) < 0)
+        goto error;
+      time = ttml_add_times (time,
+          ttml_scale_time (0, fraction, n_digits, GST_SECOND, 1));
+    } else if (c < end && *c == ':') {
+      guint64 frames, sub_frames;
+
+      ++c;
+      if (ttml_parse_decimal (&c, end, &frames) <= 0)
+        goto error;
+      if (frames * params->frame_rate_den >= frame_den)
+        GST_CAT_WARNING (ttmlparse, "Frame count exceeds frame rate: %.*s",
+            (gint) len, expr);
+      time = ttml_add_times (time, ttml_scale_time (frames, 0, 0,
+              GST_SECOND * params->frame_rate_den, frame_den));
+
+      if (c < end && *c == '.') {
+        ++c;
+        if (ttml_parse_decimal (&c, end, &sub_frames) <= 0)
+          goto error;
+        time = ttml_add_times (time, ttml_scale_time (sub_frames, 0, 0,
+                GST_SECOND * params->frame_rate_den,
+                frame_den * params->sub_frame_rate));
+      }
+    }
+  } else {
+    guint64 unit_num, unit_den = 1;
+
+    if (c < end && *c == '.') {
+      ++c;
+      if ((n_digits = ttml_parse_fraction (&c, end, &fraction)) < 0)
+        goto error;
+    }
+
+    if (end - c == 1 && *c == 'h') {
+      unit_num = 3600 * GST_SECOND;
+    } else if (end - c == 1 && *c == 'm') {
+      unit_num = 60 * GST_SECOND;
+    } else if (end - c == 1 && *c == 's') {
+      unit_num = GST_SECOND;
+    } else if (end - c == 2 && c[0] == 'm' && c[1] == 's') {
+      unit_num = GST_MSECOND;
+    } else if (end - c == 1 && *c == 'f') {
+      unit_num = GST_SECOND * params->frame_rate_den;
+      unit_den = frame_den;
+    } else if (end - c == 1 && *c == 't') {
+      unit_num = GST_SECOND;
+      unit_den = params->tick_rate;
+    } else {
+      goto error;
+    }
+    c = end;
+
+    time = ttml_scale_time (count, fraction, n_digits, unit_num, unit_den);
+  }
+
+  if (c != end)
+    goto error;
+
+  if (!GST_CLOCK_TIME_IS_VALID (time))
+    GST_CAT_ERROR (ttmlparse, "time out of range: %.*s", (gint) len, expr);
+  else
+    GST_CAT_LOG (ttmlparse, "Parsed time: %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (time));
+  return time;
+
+error:
+  GST_CAT_ERROR (ttmlparse, "badly formatted time string: %.*s", (gint) len,
+      expr);
+  return GST_CLOCK_TIME_NONE;
+}
+
+
+/* Returns the time given by the attribute with local name @name, or
+ * GST_CLOCK_TIME_NONE if there is no such attribute or its value is not a
+ * valid time expression. */
+static GstClockTime
+ttml_get_time_attribute (const TtmlAttributes * attributes,
+    const gchar * name, const TtmlTimeParams * params)
+{
+  const xmlChar **attribute = ttml_find_attribute (attributes, name);
+
+  if (!attribute)
+    return GST_CLOCK_TIME_NONE;
+  return ttml_parse_time_expression ((const gchar *) attribute[3],
+      attribute[4] - attribute[3], params);
+}
+
+
+static TtmlElement *
+ttml_parse_element (TtmlArena * arena, const gchar * name,
+    const TtmlAttributes * attributes, const TtmlTimeParams * time_params)
+{
+  TtmlElement *element;
+  TtmlElementType type;
+  const xmlChar **attribute;
+  gchar *value;
+
+  GST_CAT_DEBUG (ttmlparse, "Element name: %s", name);
+  if ((g_strcmp0 (name, "style") == 0)) {
+    type = TTML_ELEMENT_TYPE_STYLE;
+  } else if ((g_strcmp0 (name, "region") == 0)) {
+    type = TTML_ELEMENT_TYPE_REGION;
+  } else if ((g_strcmp0 (name, "body") == 0)) {
+    type = TTML_ELEMENT_TYPE_BODY;
+  } else if ((g_strcmp0 (name, "div") == 0)) {
+    type = TTML_ELEMENT_TYPE_DIV;
+  } else if ((g_strcmp0 (name, "p") == 0)) {
+    type = TTML_ELEMENT_TYPE_P;
+  } else if ((g_strcmp0 (name, "span") == 0)) {
+    type = TTML_ELEMENT_TYPE_SPAN;
+  } else if ((g_strcmp0 (name, "br") == 0)) {
+    type = TTML_ELEMENT_TYPE_BR;
+  } else {
+    return NULL;
+  }
+
+  element = ttml_arena_new0 (arena, TtmlElement);
+  element->type = type;
+  element->id = ttml_arena_get_attribute (arena, attributes, "id");
+
+  if ((attribute = ttml_find_attribute (attributes, "style"))) {
+    element->styles = ttml_arena_split_tokens (arena,
+        (const gchar *) attribute[3], attribute[4] - attribute[3]);
+    GST_CAT_DEBUG (ttmlparse, "%u style(s) referenced in element.",
+        g_strv_length (element->styles));
   }
-  if ((value = ttml_get_xml_property (node, "showBackground"))) {
-    s->show_background = g_strdup (value);
+
+  if (element->type == TTML_ELEMENT_TYPE_STYLE
+      || element->type == TTML_ELEMENT_TYPE_REGION) {
+    TtmlStyleSet *ss;
+    ss = ttml_parse_style_set (arena, attributes);
+    if (ss)
+      element->style_set = ss;
+    else
+      GST_CAT_WARNING (ttmlparse,
+          "Style or Region contains no styling attributes.");
+  }
+
+  element->region = ttml_arena_get_attribute (arena, attributes, "region");
+
+  element->begin = ttml_get_time_attribute (attributes, "begin", time_params);
+  element->end = ttml_get_time_attribute (attributes, "end", time_params);
+
+  if ((value = ttml_get_attribute (attributes, "space"))) {
+    if (g_strcmp0 (value, "preserve") == 0)
+      element->whitespace_mode = TTML_WHITESPACE_MODE_PRESERVE;
+    else if (g_strcmp0 (value, "default") == 0)
+      element->whitespace_mode = TTML_WHITESPACE_MODE_DEFAULT;
     g_free (value);
   }
 
-  return s;
+  return element;
+}
+
+
+/* Create an anonymous span holding the text, @text, of length @len. */
+static TtmlElement *
+ttml_new_anon_span (TtmlArena * arena, const gchar * text, gsize len)
+{
+  TtmlElement *element = ttml_arena_new0 (arena, TtmlElement);
+
+  element->type = TTML_ELEMENT_TYPE_ANON_SPAN;
+  element->begin = GST_CLOCK_TIME_NONE;
+  element->end = GST_CLOCK_TIME_NONE;
+  element->text = ttml_arena_strndup (arena, text, len);
+  GST_CAT_LOG (ttmlparse, "Node content: %s", element->text);
+
+  return element;
+}
+
+
+/* Update the fields of a GstSubtitleStyleSet, @style_set, according to the
+ * values defined in a TtmlStyleSet, @tss, and a given cell resolution. */
+static void
+ttml_update_style_set (GstSubtitleStyleSet * style_set, TtmlStyleSet * tss,
+    guint cellres_x, guint cellres_y)
+{
+  if (tss->present & TTML_STYLE_PROP_TEXT_DIRECTION)
+    style_set->text_direction = tss->text_direction;
+
+  if (tss->present & TTML_STYLE_PROP_FONT_FAMILY) {
+    g_free (style_set->font_family);
+    style_set->font_family = g_strdup (tss->font_family);
+  }
+
+  if (tss->present & TTML_STYLE_PROP_FONT_SIZE)
+    style_set->font_size = tss->font_size / 100.0;
+  style_set->font_size *= (1.0 / cellres_y);
+
+  if (tss->present & TTML_STYLE_PROP_LINE_HEIGHT)
+    style_set->line_height = tss->line_height / 100.0;
+
+  if (tss->present & TTML_STYLE_PROP_TEXT_ALIGN)
+    style_set->text_align = tss->text_align;
+
+  if (tss->present & TTML_STYLE_PROP_COLOR)
+    style_set->color = tss->color;
+
+  if (tss->present & TTML_STYLE_PROP_BACKGROUND_COLOR)
+    style_set->background_color = tss->background_color;
+
+  if (tss->present & TTML_STYLE_PROP_FONT_STYLE)
+    style_set->font_style = tss->font_style;
+
+  if (tss->present & TTML_STYLE_PROP_FONT_WEIGHT)
+    style_set->font_weight = tss->font_weight;
+
+  if (tss->present & TTML_STYLE_PROP_TEXT_DECORATION)
+    style_set->text_decoration = tss->text_decoration;
+
+  if (tss->present & TTML_STYLE_PROP_UNICODE_BIDI)
+    style_set->unicode_bidi = tss->unicode_bidi;
+
+  if (tss->present & TTML_STYLE_PROP_WRAP_OPTION)
+    style_set->wrap_option = tss->wrap_option;
+
+  if (tss->present & TTML_STYLE_PROP_MULTI_ROW_ALIGN)
+    style_set->multi_row_align = tss->multi_row_align;
+
+  if (tss->present & TTML_STYLE_PROP_LINE_PADDING)
+    style_set->line_padding = tss->line_padding * (1.0 / cellres_x);
+
+  if (tss->present & TTML_STYLE_PROP_ORIGIN) {
+    style_set->origin_x = tss->origin[0];
+    style_set->origin_y = tss->origin[1];
+  }
+
+  if (tss->present & TTML_STYLE_PROP_EXTENT) {
+    style_set->extent_w = tss->extent[0];
+    if ((style_set->origin_x + style_set->extent_w) > 1.0) {
+      style_set->extent_w = 1.0 - style_set->origin_x;
+    }
+    style_set->extent_h = tss->extent[1];
+    if ((style_set->origin_y + style_set->extent_h) > 1.0) {
+      style_set->extent_h = 1.0 - style_set->origin_y;
+    }
+  }
+
+  if (tss->present & TTML_STYLE_PROP_DISPLAY_ALIGN)
+    style_set->display_align = tss->display_align;
+
+  if (tss->present & TTML_STYLE_PROP_PADDING) {
+    /* Padding values in TTML files are relative to the region width & height;
+     * make them relative to the overall display width & height like all other
+     * dimensions. */
+    style_set->padding_before = tss->padding[0] * style_set->extent_h;
+    style_set->padding_end = tss->padding[1] * style_set->extent_w;
+    style_set->padding_after = tss->padding[2] * style_set->extent_h;
+    style_set->padding_start = tss->padding[3] * style_set->extent_w;
+  }
+
+  if (tss->present & TTML_STYLE_PROP_WRITING_MODE)
+    style_set->writing_mode = tss->writing_mode;
+
+  if (tss->present & TTML_STYLE_PROP_SHOW_BACKGROUND)
+    style_set->show_background = tss->show_background;
+
+  if (tss->present & TTML_STYLE_PROP_OVERFLOW)
+    style_set->overflow = tss->overflow;
+}
+
+
+static TtmlStyleSet *
+ttml_copy_style_set (TtmlArena * arena, const TtmlStyleSet * style_set)
+{
+  TtmlStyleSet *ret = ttml_arena_alloc (arena, sizeof (TtmlStyleSet));
+
+  *ret = *style_set;
+  return ret;
+}
+
+
+/* Merge all the values set in @src into @dest, overriding any values that are
+ * already set in @dest. Unlike style inheritance, merging takes every
+ * attribute. */
+static void
+ttml_merge_style_sets (TtmlStyleSet * dest, const TtmlStyleSet * src)
+{
+  ttml_style_set_copy_props (dest, src, src->present);
+}
+
+
+/* Inherit into @child those inheritable values set in @parent that are not
+ * set in @child. */
+static void
+ttml_inherit_styling (const TtmlStyleSet * parent, TtmlStyleSet * child)
+{
+  guint32 inherited = parent->present & TTML_STYLE_INHERITED_PROPS;
+
+  /* In TTML, if an element which has a defined fontSize is the child of an
+   * element that also has a defined fontSize, the child's font size is
+   * relative to that of its parent. If its parent doesn't have a defined
+   * fontSize, then the child's fontSize is relative to the document's cell
+   * size. Therefore, if the former is true, we calculate the value of
+   * font_size based on the parent's font_size; otherwise, we simply keep the
+   * value defined in the child's style set. */
+  if ((parent->present & TTML_STYLE_PROP_FONT_SIZE)
+      && (child->present & TTML_STYLE_PROP_FONT_SIZE)) {
+    child->font_size = (child->font_size * parent->font_size) / 100.0;
+    GST_CAT_LOG (ttmlparse, "Calculated font size: %g%%", child->font_size);
+  }
+
+  ttml_style_set_copy_props (child, parent, inherited & ~child->present);
+}
+
+
+static const gchar *
+ttml_get_element_type_string (TtmlElement * element)
+{
+  switch (element->type) {
+    case TTML_ELEMENT_TYPE_STYLE:
+      return "<style>";
+    case TTML_ELEMENT_TYPE_REGION:
+      return "<region>";
+    case TTML_ELEMENT_TYPE_BODY:
+      return "<body>";
+    case TTML_ELEMENT_TYPE_DIV:
+      return "<div>";
+    case TTML_ELEMENT_TYPE_P:
+      return "<p>";
+    case TTML_ELEMENT_TYPE_SPAN:
+      return "<span>";
+    case TTML_ELEMENT_TYPE_ANON_SPAN:
+      return "<anon-span>";
+    case TTML_ELEMENT_TYPE_BR:
+      return "<br>";
+    default:
+      return "Unknown";
+  }
+}
+
+
+/* Identifies a resolved style set by the inputs from which it is computed:
+ * the resolved style of the element's parent, the IDs of the styles the
+ * element references, the values of any styling attributes specified on the
+ * element itself and whether all, or only inheritable, attributes are taken
+ * from the parent. Keys, like the style sets and elements to which they
+ * refer, are allocated from the document's arena and so outlive the cache. */
+typedef struct {
+  TtmlStyleSet *parent;
+  gchar **styles;
+  TtmlStyleSet *own;
+  gboolean merge_parent;
+} TtmlStyleCacheKey;
+
+
+static guint
+ttml_style_cache_key_hash (gconstpointer key)
+{
+  const TtmlStyleCacheKey *k = key;
+  guint hash = g_direct_hash (k->parent) ^ k->merge_parent;
+  gchar **style;
+
+  if (k->own)
+    hash ^= ttml_style_set_hash (k->own) << 1;
+
+  for (style = k->styles; style && *style; ++style)
+    hash = (hash * 31) + g_str_hash (*style);
+
+  return hash;
+}
+
+
+static gboolean
+ttml_style_cache_key_equal (gconstpointer a, gconstpointer b)
+{
+  const TtmlStyleCacheKey *k1 = a;
+  const TtmlStyleCacheKey *k2 = b;
+  gchar **s1 = k1->styles, **s2 = k2->styles;
+
+  if (k1->parent != k2->parent || k1->merge_parent != k2->merge_parent
+      || !ttml_style_set_equal (k1->own, k2->own))
+    return FALSE;
+
+  if (!s1 || !s2)
+    return (s1 == s2);
+
+  for (; *s1 && *s2; ++s1, ++s2) {
+    if (g_strcmp0 (*s1, *s2) != 0)
+      return FALSE;
+  }
+  return (*s1 == *s2);
+}
+
+
+/* Create a cache in which to intern resolved style sets, so that elements
+ * whose styling is computed from identical inputs share a single set. */
+static GHashTable *
+ttml_style_cache_new (void)
+{
+  return g_hash_table_new (ttml_style_cache_key_hash,
+      ttml_style_cache_key_equal);
+}
+
+
+/* Compute the styling of @element from its own styling attributes, the styles
+ * it references in @styles_table and the resolved styling of its parent,
+ * @parent_style. Returns the shared, resolved style set, which must not be
+ * modified, or NULL if the element has no styling. */
+static TtmlStyleSet *
+ttml_style_cache_resolve (GHashTable * cache, TtmlArena * arena,
+    GHashTable * styles_table, TtmlElement * element,
+    TtmlStyleSet * parent_style)
+{
+  TtmlStyleCacheKey key, *new_key;
+  TtmlStyleSet *resolved = NULL;
+  guint i;
+
+  key.parent = parent_style;
+  key.styles = element->styles;
+  key.own = element->style_set;
+  /* Anon spans should merge all style attributes from their parent. */
+  key.merge_parent = (element->type == TTML_ELEMENT_TYPE_ANON_SPAN);
+
+  if ((resolved = g_hash_table_lookup (cache, &key)))
+    return resolved;
+
+  if (element->style_set)
+    resolved = ttml_copy_style_set (arena, element->style_set);
+
+  /* Merge styles referenced by the element. */
+  for (i = 0; element->styles && element->styles[i]; ++i) {
+    TtmlElement *style = g_hash_table_lookup (styles_table,
+        element->styles[i]);
+
+    if (style) {
+      GST_CAT_LOG (ttmlparse, "Merging style %s...", element->styles[i]);
+      if (!style->style_set)
+        continue;
+      if (!resolved)
+        resolved = ttml_style_set_new (arena);
+      ttml_merge_style_sets (resolved, style->style_set);
+    } else {
+      GST_CAT_WARNING (ttmlparse, "Element references an unknown style (%s)",
+          element->styles[i]);
+    }
+  }
+
+  /* Inherit styling attributes from parent. */
+  if (parent_style) {
+    if (!resolved)
+      resolved = ttml_style_set_new (arena);
+
+    if (key.merge_parent) {
+      TtmlStyleSet *merged = ttml_copy_style_set (arena, parent_style);
+      ttml_merge_style_sets (merged, resolved);
+      resolved = merged;
+    } else {
+      ttml_inherit_styling (parent_style, resolved);
+    }
+  }
+
+  if (!resolved)
+    return NULL;
+
+  GST_CAT_LOG (ttmlparse, "Resolved style set:");
+  ttml_print_style_set (resolved);
+
+  new_key = ttml_arena_alloc (arena, sizeof (TtmlStyleCacheKey));
+  *new_key = key;
+  g_hash_table_insert (cache, new_key, resolved);
+
+  return resolved;
+}
+
+
+static void
+ttml_resolve_node_styles (GNode * node, TtmlStyleSet * parent_style,
+    GHashTable * cache, TtmlArena * arena, GHashTable * styles_table)
+{
+  TtmlElement *element = node->data;
+  GNode *child;
+
+  GST_CAT_LOG (ttmlparse, "Element type: %s",
+      ttml_get_element_type_string (element));
+
+  element->style_set = ttml_style_cache_resolve (cache, arena, styles_table,
+      element, parent_style);
+
+  for (child = node->children; child; child = child->next)
+    ttml_resolve_node_styles (child, element->style_set, cache, arena,
+        styles_table);
+}
+
+
+/* The resolution of the styles of a single region tree in parallel mode.
+ * Each tree has an arena and a cache of its own, since the elements of each
+ * region tree are copies private to that tree. */
+typedef struct {
+  GNode *root;
+  TtmlArena *arena;
+  GHashTable *styles_table;
+} TtmlStyleTask;
+
+
+static void
+ttml_resolve_tree_styles (gpointer data, gpointer user_data)
+{
+  TtmlStyleTask *task = data;
+  GHashTable *cache = ttml_style_cache_new ();
+
+  ttml_resolve_node_styles (task->root, NULL, cache, task->arena,
+      task->styles_table);
+  g_hash_table_destroy (cache);
+}
+
+
+/* Merge the styles referenced by each element in @trees into its styling and
+ * apply inheritance from its parent. Elements whose styling is derived from
+ * the same inputs share one resolved style set. If @parallel is set, the
+ * trees are processed concurrently, with sets shared only within a tree. */
+static void
+ttml_resolve_element_styles (GList * trees, TtmlArena * arena,
+    GHashTable * styles_table, gboolean parallel)
+{
+  GHashTable *cache;
+  GList * tree;
+
+  if (parallel && trees && trees->next) {
+    guint i, n_trees = g_list_length (trees);
+    TtmlStyleTask *tasks = g_new (TtmlStyleTask, n_trees);
+    gpointer *items = g_new (gpointer, n_trees);
+
+    for (tree = g_list_first (trees), i = 0; tree; tree = tree->next, ++i) {
+      tasks[i].root = (GNode *)tree->data;
+      tasks[i].arena = ttml_arena_new ();
+      tasks[i].styles_table = styles_table;
+      items[i] = &tasks[i];
+    }
+
+    ttml_run_parallel (ttml_resolve_tree_styles, items, n_trees, TRUE);
+
+    /* The resolved sets belong to the document like everything else. */
+    for (i = 0; i < n_trees; ++i)
+      ttml_arena_merge (arena, tasks[i].arena);
+    g_free (items);
+    g_free (tasks);
+    return;
+  }
+
+  cache = ttml_style_cache_new ();
+  for (tree = g_list_first (trees); tree; tree = tree->next) {
+    GNode *root = (GNode *)tree->data;
+    ttml_resolve_node_styles (root, NULL, cache, arena, styles_table);
+  }
+
+  GST_CAT_DEBUG (ttmlparse, "%u distinct resolved style sets.",
+      g_hash_table_size (cache));
+  g_hash_table_destroy (cache);
+}
+
+
+/* If whitespace_mode isn't explicitly set for this element, inherit from its
+ * parent. If this element is the root of the tree, set whitespace_mode to
+ * that of the overall document. */
+static gboolean
+ttml_inherit_element_whitespace_mode (GNode * node, gpointer data)
+{
+  TtmlWhitespaceMode *doc_mode = (TtmlWhitespaceMode *)data;
+  TtmlElement *element = node->data;
+  TtmlElement *parent;
+
+  if (element->whitespace_mode != TTML_WHITESPACE_MODE_NONE)
+    return FALSE;
+
+  if (G_NODE_IS_ROOT (node)) {
+    element->whitespace_mode = *doc_mode;
+    return FALSE;
+  }
+
+  parent = node->parent->data;
+  element->whitespace_mode = parent->whitespace_mode;
+  return FALSE;
+}
+
+
+static void
+ttml_inherit_whitespace_mode (GNode * tree, TtmlWhitespaceMode doc_mode)
+{
+  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
+      ttml_inherit_element_whitespace_mode, &doc_mode);
+}
+
+
+static gboolean
+ttml_resolve_element_timings (GNode * node, gpointer data)
+{
+  TtmlElement *element, *leaf;
+
+  leaf = element = node->data;
+
+  if (GST_CLOCK_TIME_IS_VALID (leaf->begin)
+      && GST_CLOCK_TIME_IS_VALID (leaf->end)) {
+    GST_CAT_LOG (ttmlparse, "Leaf node already has timing.");
+    return FALSE;
+  }
+
+  /* Inherit timings from ancestor. */
+  while (node->parent && !GST_CLOCK_TIME_IS_VALID (element->begin)) {
+    node = node->parent;
+    element = node->data;
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (element->begin)) {
+    GST_CAT_WARNING (ttmlparse,
+        "No timing found for element. Removing from tree...");
+    g_node_unlink (node);
+  } else {
+    leaf->begin = element->begin;
+    leaf->end = element->end;
+    GST_CAT_LOG (ttmlparse, "Leaf begin: %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (leaf->begin));
+    GST_CAT_LOG (ttmlparse, "Leaf end: %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (leaf->end));
+  }
+
+  return FALSE;
+}
+
+
+static void
+ttml_resolve_timings (GNode * tree)
+{
+  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
+      ttml_resolve_element_timings, NULL);
+}
+
+
+static gboolean
+ttml_resolve_leaf_region (GNode * node, gpointer data)
+{
+  TtmlElement *element, *leaf;
+  leaf = element = node->data;
+
+  while (node->parent && !element->region) {
+    node = node->parent;
+    element = node->data;
+  }
+
+  if (element->region) {
+    leaf->region = element->region;
+    GST_CAT_LOG (ttmlparse, "Leaf region: %s", leaf->region);
+  } else {
+    GST_CAT_WARNING (ttmlparse, "No region found above leaf element.");
+  }
+
+  return FALSE;
+}
+
+
+static void
+ttml_resolve_regions (GNode * tree)
+{
+  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
+      ttml_resolve_leaf_region, NULL);
+}
+
+
+/* The location of the text of a node within the text block of a
+ * TtmlNodeTable. */
+typedef struct {
+  gsize offset;
+  gsize size;
+} TtmlTextSpan;
+
+/* A flattened view of a set of element trees, in which each node is
+ * identified by its position in a pre-order traversal of the trees. Scenes
+ * refer to the elements they contain using these indexes, allowing all scenes
+ * to share a single copy of the trees. The text of every text node is
+ * likewise held once, NUL-terminated, in @text; @text_spans gives the
+ * location of each node's text, so that a scene's buffer can carry it as a
+ * memory sharing @text rather than as a copy. */
+typedef struct {
+  GPtrArray *nodes;
+  GArray *parents;
+  GstMemory *text;
+  GArray *text_spans;
+} TtmlNodeTable;
+
+#define TTML_NO_PARENT G_MAXUINT
+
+
+static inline TtmlElement *
+ttml_node_table_get_element (TtmlNodeTable * table, guint index)
+{
+  GNode *node = g_ptr_array_index (table->nodes, index);
+  return node->data;
+}
+
+
+static inline guint
+ttml_node_table_get_parent (TtmlNodeTable * table, guint index)
+{
+  return g_array_index (table->parents, guint, index);
+}
+
+
+static void
+ttml_node_table_add_node (TtmlNodeTable * table, GNode * node,
+    guint parent_index)
+{
+  guint index = table->nodes->len;
+  GNode *child;
+
+  g_ptr_array_add (table->nodes, node);
+  g_array_append_val (table->parents, parent_index);
+
+  for (child = node->children; child; child = child->next)
+    ttml_node_table_add_node (table, child, index);
+}
+
+
+/* Copy the text of all text nodes in @table into a single block of memory.
+ * The block starts with the text of <br> elements, which all share it. */
+static void
+ttml_node_table_add_text (TtmlNodeTable * table)
+{
+  static const gchar br_text[] = "\n";
+  TtmlTextSpan br_span = { 0, sizeof (br_text) };
+  gsize size = sizeof (br_text);
+  GstMapInfo map;
+  guint i;
+
+  g_array_set_size (table->text_spans, table->nodes->len);
+
+  for (i = 0; i < table->nodes->len; ++i) {
+    TtmlElement *element = ttml_node_table_get_element (table, i);
+    TtmlTextSpan *span = &g_array_index (table->text_spans, TtmlTextSpan, i);
+
+    if (element->type == TTML_ELEMENT_TYPE_BR) {
+      *span = br_span;
+    } else if (element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
+      span->offset = size;
+      span->size = (element->text ? strlen (element->text) : 0) + 1;
+      size += span->size;
+    }
+  }
+
+  table->text = gst_allocator_alloc (NULL, size, NULL);
+  if (!gst_memory_map (table->text, &map, GST_MAP_WRITE)) {
+    GST_CAT_ERROR (ttmlparse, "Failed to map memory.");
+    return;
+  }
+
+  memcpy (map.data, br_text, sizeof (br_text));
+  for (i = 0; i < table->nodes->len; ++i) {
+    TtmlElement *element = ttml_node_table_get_element (table, i);
+    TtmlTextSpan *span = &g_array_index (table->text_spans, TtmlTextSpan, i);
+
+    if (element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
+      memcpy (map.data + span->offset, element->text ? element->text : "",
+          span->size - 1);
+      map.data[span->offset + span->size - 1] = '\0';
+    }
+  }
+
+  gst_memory_unmap (table->text, &map);
+  GST_CAT_LOG (ttmlparse, "Text block holds %" G_GSIZE_FORMAT " bytes.",
+      size);
+}
+
+
+static TtmlNodeTable *
+ttml_node_table_new (GList * trees)
+{
+  TtmlNodeTable *table = g_slice_new0 (TtmlNodeTable);
+
+  table->nodes = g_ptr_array_new ();
+  table->parents = g_array_new (FALSE, FALSE, sizeof (guint));
+  table->text_spans = g_array_new (FALSE, TRUE, sizeof (TtmlTextSpan));
+
+  for (trees = g_list_first (trees); trees; trees = trees->next)
+    ttml_node_table_add_node (table, (GNode *)trees->data, TTML_NO_PARENT);
+  ttml_node_table_add_text (table);
+
+  GST_CAT_LOG (ttmlparse, "Node table contains %u nodes.", table->nodes->len);
+  return table;
+}
+
+
+static void
+ttml_node_table_free (TtmlNodeTable * table)
+{
+  g_ptr_array_unref (table->nodes);
+  g_array_free (table->parents, TRUE);
+  g_array_free (table->text_spans, TRUE);
+  /* Scene buffers keep the block alive for as long as they share it. */
+  gst_memory_unref (table->text);
+  g_slice_free (TtmlNodeTable, table);
+}
+
+
+static gint
+ttml_compare_clock_times (gconstpointer a, gconstpointer b)
+{
+  GstClockTime time_a = *((const GstClockTime *)a);
+  GstClockTime time_b = *((const GstClockTime *)b);
+
+  if (time_a < time_b)
+    return -1;
+  else if (time_a > time_b)
+    return 1;
+  else
+    return 0;
+}
+
+
+/* Return a sorted array containing each time after 0 at which an element in
+ * @table becomes visible or ceases to be visible. Collecting and sorting all
+ * begin and end times up front means the elements need only be visited once,
+ * rather than once per transition. */
+static GArray *
+ttml_get_transition_times (TtmlNodeTable * table)
+{
+  GArray *times = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  guint i, n_unique = 0;
+
+  for (i = 0; i < table->nodes->len; ++i) {
+    TtmlElement *element = ttml_node_table_get_element (table, i);
+
+    if (GST_CLOCK_TIME_IS_VALID (element->begin))
+      g_array_append_val (times, element->begin);
+    if (GST_CLOCK_TIME_IS_VALID (element->end))
+      g_array_append_val (times, element->end);
+  }
+
+  g_array_sort (times, ttml_compare_clock_times);
+
+  /* Remove duplicates, along with any transition at time 0, which will never
+   * be preceded by a scene. */
+  for (i = 0; i < times->len; ++i) {
+    GstClockTime time = g_array_index (times, GstClockTime, i);
+    if (time == 0 || (n_unique > 0
+          && time == g_array_index (times, GstClockTime, n_unique - 1)))
+      continue;
+    g_array_index (times, GstClockTime, n_unique++) = time;
+  }
+  g_array_set_size (times, n_unique);
+
+  GST_CAT_LOG (ttmlparse, "Found %u transitions.", times->len);
+  return times;
+}
+
+
+/* The time at which an element becomes (@activate == TRUE) or ceases to be
+ * (@activate == FALSE) active. */
+typedef struct {
+  GstClockTime time;
+  guint node;
+  gboolean activate;
+} TtmlActivityEvent;
+
+
+static gint
+ttml_compare_activity_events (gconstpointer a, gconstpointer b)
+{
+  return ttml_compare_clock_times (&((const TtmlActivityEvent *)a)->time,
+      &((const TtmlActivityEvent *)b)->time);
+}
+
+
+/* Return a time-ordered array of the activation and deactivation events of
+ * all the elements in @table. Elements are active between their begin time
+ * (inclusive) and end time (exclusive). */
+static GArray *
+ttml_get_activity_events (TtmlNodeTable * table)
+{
+  GArray *events = g_array_new (FALSE, FALSE, sizeof (TtmlActivityEvent));
+  guint i;
+
+  for (i = 0; i < table->nodes->len; ++i) {
+    TtmlElement *element = ttml_node_table_get_element (table, i);
+    TtmlActivityEvent event;
+
+    if (!GST_CLOCK_TIME_IS_VALID (element->begin)
+        || element->end <= element->begin)
+      continue;
+
+    event.time = element->begin;
+    event.node = i;
+    event.activate = TRUE;
+    g_array_append_val (events, event);
+
+    if (GST_CLOCK_TIME_IS_VALID (element->end)) {
+      event.time = element->end;
+      event.activate = FALSE;
+      g_array_append_val (events, event);
+    }
+  }
+
+  g_array_sort (events, ttml_compare_activity_events);
+  return events;
+}
+
+
+#define TTML_BITS_PER_WORD (sizeof (gulong) * 8)
+
+/* Tracks which nodes should appear in a scene at the current point of the
+ * sweep through the activity events. A node appears in a scene if it is
+ * itself active or if any of its children appear in the scene; a node's
+ * visibility is therefore recalculated only when that of one of its children
+ * changes, rather than by re-filtering the whole tree at every transition. */
+typedef struct {
+  TtmlNodeTable *table;
+  gboolean *active;
+  guint *visible_children;
+  gulong *visible;
+  guint n_words;
+  guint n_visible;
+} TtmlSweepState;
+
+
+static inline gboolean
+ttml_sweep_state_is_visible (TtmlSweepState * state, guint index)
+{
+  return (state->visible[index / TTML_BITS_PER_WORD]
+      >> (index % TTML_BITS_PER_WORD)) & 1UL;
+}
+
+
+static void
+ttml_sweep_state_init (TtmlSweepState * state, TtmlNodeTable * table)
+{
+  guint n_nodes = table->nodes->len;
+
+  state->table = table;
+  state->active = g_new0 (gboolean, n_nodes);
+  state->visible_children = g_new0 (guint, n_nodes);
+  state->n_words = (n_nodes + TTML_BITS_PER_WORD - 1) / TTML_BITS_PER_WORD;
+  state->visible = g_new0 (gulong, state->n_words);
+  state->n_visible = 0;
+}
+
+
+static void
+ttml_sweep_state_clear (TtmlSweepState * state)
+{
+  g_free (state->active);
+  g_free (state->visible_children);
+  g_free (state->visible);
+}
+
+
+static void
+ttml_sweep_state_set_active (TtmlSweepState * state, guint index,
+    gboolean active)
+{
+  gboolean was_visible = ttml_sweep_state_is_visible (state, index);
+
+  state->active[index] = active;
+
+  for (;;) {
+    gboolean visible = state->active[index]
+      || state->visible_children[index] > 0;
+    guint parent;
+
+    if (visible == was_visible)
+      break;
+
+    state->visible[index / TTML_BITS_PER_WORD] ^=
+      (1UL << (index % TTML_BITS_PER_WORD));
+    if (visible)
+      ++state->n_visible;
+    else
+      --state->n_visible;
+
+    parent = ttml_node_table_get_parent (state->table, index);
+    if (parent == TTML_NO_PARENT)
+      break;
+
+    was_visible = ttml_sweep_state_is_visible (state, parent);
+    if (visible)
+      ++state->visible_children[parent];
+    else
+      --state->visible_children[parent];
+    index = parent;
+  }
+}
+
+
+/* Return the indexes, in document order, of the nodes currently visible. */
+static GArray *
+ttml_sweep_state_get_visible_nodes (TtmlSweepState * state)
+{
+  GArray *ret = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      state->n_visible);
+  guint i;
+
+  for (i = 0; i < state->n_words; ++i) {
+    gint bit = -1;
+
+    while ((bit = g_bit_nth_lsf (state->visible[i], bit)) >= 0) {
+      guint index = i * TTML_BITS_PER_WORD + bit;
+      g_array_append_val (ret, index);
+    }
+  }
+
+  return ret;
+}
+
+
+static void
+ttml_delete_scene (TtmlScene * scene)
+{
+  if (scene->elements)
+    g_array_free (scene->elements, TRUE);
+  if (scene->buf)
+    gst_buffer_unref (scene->buf);
+  g_slice_free (TtmlScene, scene);
+}
+
+
+/* Yields the scenes of a set of element trees one at a time, in time order,
+ * by sweeping through the times at which elements become and cease to be
+ * visible. @cur_scene is the scene begun at the last transition, which ends
+ * at the next. */
+typedef struct {
+  GArray *transitions;
+  GArray *events;
+  TtmlSweepState state;
+  guint next_transition;
+  guint next_event;
+  TtmlScene *cur_scene;
+} TtmlSceneSweep;
+
+
+static void
+ttml_scene_sweep_init (TtmlSceneSweep * sweep, TtmlNodeTable * table)
+{
+  sweep->transitions = ttml_get_transition_times (table);
+  sweep->events = ttml_get_activity_events (table);
+  ttml_sweep_state_init (&sweep->state, table);
+  sweep->next_transition = 0;
+  sweep->next_event = 0;
+  sweep->cur_scene = NULL;
+}
+
+
+static void
+ttml_scene_sweep_clear (TtmlSceneSweep * sweep)
+{
+  if (sweep->cur_scene)
+    ttml_delete_scene (sweep->cur_scene);
+  ttml_sweep_state_clear (&sweep->state);
+  g_array_free (sweep->events, TRUE);
+  g_array_free (sweep->transitions, TRUE);
+}
+
+
+/* Returns the next scene, or NULL once all scenes have been returned. */
+static TtmlScene *
+ttml_scene_sweep_next (TtmlSceneSweep * sweep)
+{
+  while (sweep->next_transition < sweep->transitions->len) {
+    GstClockTime timestamp = g_array_index (sweep->transitions, GstClockTime,
+        sweep->next_transition++);
+    TtmlScene *finished = sweep->cur_scene;
+
+    GST_CAT_LOG (ttmlparse, "Next transition found at time %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (timestamp));
+    if (finished)
+      finished->end = timestamp;
+
+    while (sweep->next_event < sweep->events->len) {
+      TtmlActivityEvent *event =
+        &g_array_index (sweep->events, TtmlActivityEvent, sweep->next_event);
+      if (event->time > timestamp)
+        break;
+      ttml_sweep_state_set_active (&sweep->state, event->node,
+          event->activate);
+      ++sweep->next_event;
+    }
+
+    GST_CAT_LOG (ttmlparse, "There will be %u visible elements after "
+        "transition", sweep->state.n_visible);
+
+    if (sweep->state.n_visible > 0) {
+      sweep->cur_scene = g_slice_new0 (TtmlScene);
+      sweep->cur_scene->begin = timestamp;
+      sweep->cur_scene->elements =
+        ttml_sweep_state_get_visible_nodes (&sweep->state);
+    } else {
+      sweep->cur_scene = NULL;
+    }
+
+    if (finished)
+      return finished;
+  }
+
+  return NULL;
+}
+
+
+/* Replace each linefeed in @text with a space and compress each run of
+ * contiguous spaces into a single space, in place. Both characters are
+ * single bytes in UTF-8 and cannot occur within a multi-byte character, so
+ * @text is scanned bytewise; the spans between runs, found with the C
+ * library's (typically vectorised) strcspn(), are moved down at most once
+ * each, so the time taken is linear in the length of @text. */
+void
+ttml_collapse_whitespace (gchar * text)
+{
+  gchar *in = text, *out = text;
+
+  while (*in) {
+    gsize len = strcspn (in, " \n");
+
+    if (out != in)
+      memmove (out, in, len);
+    out += len;
+    in += len;
+
+    if (*in) {
+      *out++ = ' ';
+      in += strspn (in, " \n");
+    }
+  }
+
+  *out = '\0';
+}
+
+
+/* Handle element whitespace in accordance with section 7.2.3 of the TTML
+ * specification. Note that stripping of whitespace at the start and end of
+ * line areas can only be done in the renderer once the text from multiple
+ * elements has been laid out. */
+static gboolean
+ttml_handle_element_whitespace (GNode * node, gpointer data)
+{
+  TtmlElement *element = node->data;
+
+  if (element->text
+      && (element->whitespace_mode != TTML_WHITESPACE_MODE_PRESERVE))
+    ttml_collapse_whitespace (element->text);
+
+  return FALSE;
+}
+
+
+static void
+ttml_handle_whitespace (GNode * tree)
+{
+  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
+      ttml_handle_element_whitespace, NULL);
+}
+
+
+/* Store @element in @table, as long as @table doesn't already contain an
+ * element with the same ID; otherwise @element is discarded. */
+static void
+ttml_store_unique_element (GHashTable * table, TtmlElement * element)
+{
+  if (element->id && !g_hash_table_contains (table, element->id))
+    g_hash_table_insert (table, (gpointer) (element->id), (gpointer) element);
+}
+
+
+/* Copy @element into @arena. The copy shares the strings and style set of
+ * @element, none of which are modified once the body has been split into
+ * regions. */
+static TtmlElement *
+ttml_copy_element (TtmlArena * arena, const TtmlElement * element)
+{
+  TtmlElement *ret = ttml_arena_alloc (arena, sizeof (TtmlElement));
+
+  *ret = *element;
+  return ret;
+}
+
+
+/* The tree being built for a single region while partitioning the body.
+ * @copies holds, for each depth below the region element, the copy most
+ * recently added at that depth, and @sources the body node it was copied
+ * from; since the body is visited in document order, these form the path from
+ * the region element to the last node added to the tree. */
+typedef struct {
+  const gchar *name;
+  GNode *root;
+  GPtrArray *sources;
+  GPtrArray *copies;
+} TtmlRegionBucket;
+
+
+/* A period of time outside of which elements are ignored when building
+ * scenes. */
+typedef struct {
+  GstClockTime begin;
+  GstClockTime end;
+} TtmlTimeWindow;
+
+
+/* Returns TRUE if @element is active at some point during @window, or if
+ * @window is NULL. */
+static gboolean
+ttml_element_is_in_window (const TtmlElement * element,
+    const TtmlTimeWindow * window)
+{
+  if (!window)
+    return TRUE;
+  return GST_CLOCK_TIME_IS_VALID (element->begin)
+    && element->begin < window->end && element->end > window->begin;
+}
+
+
+/* Marks a node whose ancestors are assigned to more than one region, and so
+ * which belongs to none. */
+static const gchar ttml_conflicting_regions[] = "";
+
+
+/* Add to @bucket the leaf at the end of @path, along with any of its
+ * ancestors that have not already been copied into @bucket. */
+static void
+ttml_region_bucket_add_leaf (TtmlRegionBucket * bucket, TtmlArena * arena,
+    GPtrArray * path)
+{
+  gint depth, matched;
+  GNode *parent;
+
+  /* Find the deepest ancestor already present in the bucket's tree. If an
+   * ancestor is present, so are all of its own ancestors. */
+  for (matched = MIN (bucket->sources->len, path->len) - 1; matched >= 0;
+      --matched) {
+    if (g_ptr_array_index (bucket->sources, matched)
+        == g_ptr_array_index (path, matched))
+      break;
+  }
+
+  parent = (matched >= 0) ? g_ptr_array_index (bucket->copies, matched)
+    : bucket->root;
+
+  for (depth = matched + 1; depth < path->len; ++depth) {
+    GNode *source = g_ptr_array_index (path, depth);
+    GNode *copy = ttml_arena_node_new (arena,
+        ttml_copy_element (arena, source->data));
+
+    /* Only the first node created can have preceding siblings, which will
+     * have been the last node copied at this depth. */
+    if (depth == matched + 1 && depth < bucket->copies->len)
+      g_node_insert_after (parent, g_ptr_array_index (bucket->copies, depth),
+          copy);
+    else
+      g_node_append (parent, copy);
+
+    if (depth < bucket->copies->len) {
+      g_ptr_array_index (bucket->sources, depth) = source;
+      g_ptr_array_index (bucket->copies, depth) = copy;
+    } else {
+      g_ptr_array_add (bucket->sources, source);
+      g_ptr_array_add (bucket->copies, copy);
+    }
+    parent = copy;
+  }
+
+  /* Anything deeper than the leaf belongs to a branch that has been left. */
+  g_ptr_array_set_size (bucket->sources, path->len);
+  g_ptr_array_set_size (bucket->copies, path->len);
+}
+
+
+/* Route the leaves below @node to the buckets of the regions to which they
+ * belong. A node belongs to a region if neither it nor any of its ancestors
+ * is assigned to a different region, with the exception that the region of a
+ * <br> is ignored; @assigned gives the region to which the ancestors of @node
+ * are assigned, if any. Only anonymous spans and <br>s are routed to a region,
+ * along with their ancestors, and only if they are active during @window;
+ * other elements that have no descendants in a region are dropped from it. */
+static void
+ttml_route_node_to_regions (GNode * node, const gchar * assigned,
+    GPtrArray * path, GPtrArray * buckets, GHashTable * buckets_by_name,
+    TtmlArena * arena, const TtmlTimeWindow * window)
+{
+  TtmlElement *element = node->data;
+  GNode *child;
+
+  if (element->type != TTML_ELEMENT_TYPE_BR && element->region
+      && assigned != ttml_conflicting_regions) {
+    if (!assigned)
+      assigned = element->region;
+    else if (g_strcmp0 (assigned, element->region) != 0)
+      assigned = ttml_conflicting_regions;
+  }
+
+  /* No descendant of a node with conflicting regions can belong to any
+   * region. */
+  if (assigned == ttml_conflicting_regions)
+    return;
+
+  g_ptr_array_add (path, node);
+
+  if (element->type == TTML_ELEMENT_TYPE_ANON_SPAN
+      || element->type == TTML_ELEMENT_TYPE_BR) {
+    if (!ttml_element_is_in_window (element, window)) {
+      /* Not needed for the scenes being built. */
+    } else if (assigned) {
+      TtmlRegionBucket *bucket = g_hash_table_lookup (buckets_by_name,
+          assigned);
+      if (bucket)
+        ttml_region_bucket_add_leaf (bucket, arena, path);
+    } else {
+      guint i;
+      for (i = 0; i < buckets->len; ++i)
+        ttml_region_bucket_add_leaf (g_ptr_array_index (buckets, i), arena,
+            path);
+    }
+  } else {
+    for (child = node->children; child; child = child->next)
+      ttml_route_node_to_regions (child, assigned, path, buckets,
+          buckets_by_name, arena, window);
+  }
+
+  g_ptr_array_set_size (path, path->len - 1);
+}
+
+
+/* Split the body tree into a set of trees, each containing only the elements
+ * belonging to a single region. Returns a list of trees, one per region, each
+ * with the corresponding region element at its root. The body is traversed
+ * only once, with each leaf and the ancestors it needs copied directly into
+ * the trees of the regions to which it belongs. If @window is non-NULL, only
+ * leaves active during @window are included. */
+static GList *
+ttml_split_body_by_region (GNode * body, GHashTable * regions,
+    TtmlArena * arena, const TtmlTimeWindow * window)
+{
+  GHashTableIter iter;
+  gpointer key, value;
+  GPtrArray *buckets, *path;
+  GHashTable *buckets_by_name;
+  GList *ret = NULL;
+  guint i;
+
+  buckets = g_ptr_array_new ();
+  buckets_by_name = g_hash_table_new (g_str_hash, g_str_equal);
+
+  g_hash_table_iter_init (&iter, regions);
+  while (g_hash_table_iter_next (&iter, &key, &value)) {
+    TtmlRegionBucket *bucket = g_slice_new0 (TtmlRegionBucket);
+
+    bucket->name = (const gchar *)key;
+    bucket->root = ttml_arena_node_new (arena,
+        ttml_copy_element (arena, (TtmlElement *)value));
+    bucket->sources = g_ptr_array_new ();
+    bucket->copies = g_ptr_array_new ();
+    g_ptr_array_add (buckets, bucket);
+    g_hash_table_insert (buckets_by_name, (gpointer)bucket->name, bucket);
+  }
+
+  path = g_ptr_array_new ();
+  ttml_route_node_to_regions (body, NULL, path, buckets, buckets_by_name,
+      arena, window);
+  g_ptr_array_free (path, TRUE);
+
+  for (i = 0; i < buckets->len; ++i) {
+    TtmlRegionBucket *bucket = g_ptr_array_index (buckets, i);
+
+    GST_CAT_LOG (ttmlparse, "Tree for region %s has %u nodes.", bucket->name,
+        g_node_n_nodes (bucket->root, G_TRAVERSE_ALL));
+    ret = g_list_prepend (ret, bucket->root);
+
+    g_ptr_array_free (bucket->sources, TRUE);
+    g_ptr_array_free (bucket->copies, TRUE);
+    g_slice_free (TtmlRegionBucket, bucket);
+  }
+
+  g_hash_table_destroy (buckets_by_name);
+  g_ptr_array_free (buckets, TRUE);
+
+  GST_CAT_DEBUG (ttmlparse, "Returning %u trees.", g_list_length (ret));
+  return g_list_reverse (ret);
+}
+
+
+/* Append to @buf a memory holding the text of the node at @index in @table.
+ * The memory shares the table's text block, so no text is copied. Returns
+ * the index of the memory in @buf. */
+static guint
+ttml_add_text_to_buffer (GstBuffer * buf, TtmlNodeTable * table, guint index)
+{
+  TtmlTextSpan *span = &g_array_index (table->text_spans, TtmlTextSpan, index);
+  guint ret;
+
+  ret = gst_buffer_n_memory (buf);
+  gst_buffer_insert_memory (buf, -1,
+      gst_memory_share (table->text, span->offset, span->size));
+  return ret;
+}
+
+
+/* Return TRUE if @color is totally transparent. */
+static gboolean
+ttml_color_is_transparent (const GstSubtitleColor * color)
+{
+  if (!color)
+    return FALSE;
+  else
+    return (color->a == 0);
+}
+
+
+/* Blend @color2 over @color1 and return the resulting color. This is currently
+ * a dummy implementation that simply returns color2 as long as it's
+ * not fully transparent. */
+/* TODO: Implement actual blending of colors. */
+static GstSubtitleColor
+ttml_blend_colors (GstSubtitleColor color1, GstSubtitleColor color2)
+{
+  if (ttml_color_is_transparent (&color2))
+    return color1;
+  else
+    return color2;
+}
+
+
+/* The GstSubtitleElements, GstSubtitleBlocks and GstSubtitleRegions created
+ * for the scenes of a document, indexed by the node from which each was
+ * created. Where an element, paragraph or region is unchanged from one scene
+ * to the next, the object created for the earlier scene is handed out again,
+ * saving its re-creation and letting downstream elements tell from its
+ * identity alone that it is unchanged. An object is unchanged if it is
+ * created from the same visible nodes, listed in @nodes, and its text is at
+ * the same indexes in the scene's buffer, starting at @text_base, and it
+ * inherits the same background @color from its ancestors (only blocks
+ * inherit a color; it is transparent for other objects); @text_nodes lists
+ * the nodes whose text the object refers to, in order.
+ * Cached objects are never modified. The cache is locked, as scenes are
+ * built concurrently in parallel mode. */
+typedef struct {
+  GstMiniObject *object;
+  GArray *nodes;
+  guint text_base;
+  GstSubtitleColor color;
+  GArray *text_nodes;
+} TtmlCachedObject;
+
+typedef struct {
+  GMutex lock;
+  TtmlCachedObject *objects;
+  guint n_objects;
+} TtmlObjectCache;
+
+
+static TtmlObjectCache *
+ttml_object_cache_new (guint n_nodes)
+{
+  TtmlObjectCache *cache = g_slice_new0 (TtmlObjectCache);
+
+  g_mutex_init (&cache->lock);
+  cache->objects = g_new0 (TtmlCachedObject, n_nodes);
+  cache->n_objects = n_nodes;
+  return cache;
+}
+
+
+static void
+ttml_cached_object_clear (TtmlCachedObject * cached)
+{
+  if (!cached->object)
+    return;
+
+  gst_mini_object_unref (cached->object);
+  g_array_free (cached->nodes, TRUE);
+  g_array_free (cached->text_nodes, TRUE);
+  memset (cached, 0, sizeof (TtmlCachedObject));
+}
+
+
+static void
+ttml_object_cache_free (TtmlObjectCache * cache)
+{
+  guint i;
+
+  for (i = 0; i < cache->n_objects; ++i)
+    ttml_cached_object_clear (&cache->objects[i]);
+  g_free (cache->objects);
+  g_mutex_clear (&cache->lock);
+  g_slice_free (TtmlObjectCache, cache);
+}
+
+
+/* If the object cached for the node at @index in @table was created from the
+ * nodes at positions @start to @end - 1 in @nodes with inherited background
+ * @color, and its text would again start at the next memory of @buf, append
+ * its text to @buf, append the nodes holding that text to @text_nodes, and
+ * return a new reference to the object. Otherwise returns NULL. */
+static gpointer
+ttml_object_cache_reuse (TtmlObjectCache * cache, TtmlNodeTable * table,
+    guint index, GArray * nodes, guint start, guint end,
+    GstSubtitleColor color, GstBuffer * buf, GArray * text_nodes)
+{
+  TtmlCachedObject *cached = &cache->objects[index];
+  GstMiniObject *ret = NULL;
+  guint i;
+
+  g_mutex_lock (&cache->lock);
+
+  if (cached->object && cached->text_base == gst_buffer_n_memory (buf)
+      && cached->color.r == color.r && cached->color.g == color.g
+      && cached->color.b == color.b && cached->color.a == color.a
+      && cached->nodes->len == end - start
+      && memcmp (cached->nodes->data, &g_array_index (nodes, guint, start),
+          (end - start) * sizeof (guint)) == 0) {
+    ret = gst_mini_object_ref (cached->object);
+    for (i = 0; i < cached->text_nodes->len; ++i)
+      ttml_add_text_to_buffer (buf, table,
+          g_array_index (cached->text_nodes, guint, i));
+    g_array_append_vals (text_nodes, cached->text_nodes->data,
+        cached->text_nodes->len);
+  }
+
+  g_mutex_unlock (&cache->lock);
+  return ret;
+}
+
+
+/* Cache @object as created for the node at @index from the nodes at
+ * positions @start to @end - 1 in @nodes with inherited background @color,
+ * with its text starting at memory @text_base of its buffer and held by the
+ * nodes from position @text_start in @text_nodes onwards. Replaces any
+ * object previously cached for the node. */
+static void
+ttml_object_cache_store (TtmlObjectCache * cache, guint index,
+    gpointer object, GArray * nodes, guint start, guint end,
+    GstSubtitleColor color, guint text_base, GArray * text_nodes,
+    guint text_start)
+{
+  TtmlCachedObject *cached = &cache->objects[index];
+
+  g_mutex_lock (&cache->lock);
+
+  ttml_cached_object_clear (cached);
+  cached->object = gst_mini_object_ref (GST_MINI_OBJECT_CAST (object));
+  cached->nodes = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      end - start);
+  g_array_append_vals (cached->nodes, &g_array_index (nodes, guint, start),
+      end - start);
+  cached->text_base = text_base;
+  cached->color = color;
+  cached->text_nodes = g_array_sized_new (FALSE, FALSE, sizeof (guint),
+      text_nodes->len - text_start);
+  g_array_append_vals (cached->text_nodes,
+      &g_array_index (text_nodes, guint, text_start),
+      text_nodes->len - text_start);
+
+  g_mutex_unlock (&cache->lock);
+}
+
+
+/* Returns the position in @nodes of the first node, from position @pos
+ * onwards, that is not a descendant of the node at @ancestor in @table. */
+static guint
+ttml_find_subtree_end (TtmlNodeTable * table, GArray * nodes, guint pos,
+    guint ancestor)
+{
+  for (; pos < nodes->len; ++pos) {
+    guint index = g_array_index (nodes, guint, pos);
+
+    /* Ancestors precede their descendants in the table. */
+    while (index != TTML_NO_PARENT && index > ancestor)
+      index = ttml_node_table_get_parent (table, index);
+    if (index != ancestor)
+      break;
+  }
+
+  return pos;
 }
 
 
+/* Add to @block a GstSubtitleElement for the node at position @pos in
+ * @nodes, and insert its associated text in @buf, appending the node to
+ * @text_nodes. */
 static void
-ttml_delete_style_set (TtmlStyleSet * style_set)
+ttml_add_element (GstSubtitleBlock * block, TtmlObjectCache * cache,
+    TtmlNodeTable * table, GArray * nodes, guint pos, GstBuffer * buf,
+    GArray * text_nodes, guint cellres_x, guint cellres_y)
 {
-  g_free ((gpointer) style_set->text_direction);
-  g_free ((gpointer) style_set->font_family);
-  g_free ((gpointer) style_set->font_size);
-  g_free ((gpointer) style_set->line_height);
-  g_free ((gpointer) style_set->text_align);
-  g_free ((gpointer) style_set->color);
-  g_free ((gpointer) style_set->background_color);
-  g_free ((gpointer) style_set->font_style);
-  g_free ((gpointer) style_set->font_weight);
-  g_free ((gpointer) style_set->text_decoration);
-  g_free ((gpointer) style_set->unicode_bidi);
-  g_free ((gpointer) style_set->wrap_option);
-  g_free ((gpointer) style_set->multi_row_align);
-  g_free ((gpointer) style_set->line_padding);
-  g_free ((gpointer) style_set->origin);
-  g_free ((gpointer) style_set->extent);
-  g_free ((gpointer) style_set->display_align);
-  g_free ((gpointer) style_set->overflow);
-  g_free ((gpointer) style_set->padding);
-  g_free ((gpointer) style_set->writing_mode);
-  g_free ((gpointer) style_set->show_background);
-  g_slice_free (TtmlStyleSet, style_set);
-}
+  guint index = g_array_index (nodes, guint, pos);
+  TtmlElement *element = ttml_node_table_get_element (table, index);
+  GstSubtitleStyleSet *element_style = NULL;
+  GstSubtitleColor transparent = { 0, 0, 0, 0 };
+  guint buffer_index;
+  GstSubtitleElement *sub_element = NULL;
 
+  sub_element = ttml_object_cache_reuse (cache, table, index, nodes, pos,
+      pos + 1, transparent, buf, text_nodes);
+
+  if (!sub_element) {
+    element_style = gst_subtitle_style_set_new ();
+    ttml_update_style_set (element_style, element->style_set,
+        cellres_x, cellres_y);
+    GST_CAT_DEBUG (ttmlparse, "Creating element with text index %u",
+        element->text_index);
+
+    buffer_index = ttml_add_text_to_buffer (buf, table, index);
+    g_array_append_val (text_nodes, index);
+
+    GST_CAT_DEBUG (ttmlparse, "Inserted text at index %u in GstBuffer.",
+        buffer_index);
+    sub_element = gst_subtitle_element_new (element_style, buffer_index,
+        (element->whitespace_mode != TTML_WHITESPACE_MODE_PRESERVE));
+    ttml_object_cache_store (cache, index, sub_element, nodes, pos, pos + 1,
+        transparent, buffer_index, text_nodes, text_nodes->len - 1);
+  }
 
-static void
-ttml_delete_element (TtmlElement * element)
-{
-  g_free ((gpointer) element->id);
-  if (element->styles) g_strfreev (element->styles);
-  g_free ((gpointer) element->region);
-  if (element->style_set) ttml_delete_style_set (element->style_set);
-  g_free ((gpointer) element->text);
-  g_slice_free (TtmlElement, element);
+  gst_subtitle_block_add_element (block, sub_element);
+  GST_CAT_DEBUG (ttmlparse, "Added element to block; there are now %u"
+      " elements in the block.",
+      gst_subtitle_block_get_element_count (block));
 }
 
 
-static gchar *
-ttml_get_xml_property (const xmlNode * node, const char *name)
+/* Create the subtitle block and its child elements for the paragraph at
+ * position @pos in @nodes, whose visible descendants extend to position
+ * @end - 1, inserting element text in @buf and appending the nodes holding
+ * that text to @text_nodes. Ownership of the block is transferred to the
+ * caller. */
+static GstSubtitleBlock *
+ttml_create_subtitle_block (TtmlObjectCache * cache, TtmlNodeTable * table,
+    GArray * nodes, guint pos, guint end, GstSubtitleColor block_color,
+    GstBuffer * buf, GArray * text_nodes, guint cellres_x, guint cellres_y)
 {
-  xmlChar *xml_string = NULL;
-  gchar *gst_string = NULL;
-
-  g_return_val_if_fail (strlen (name) < 128, NULL);
+  guint p_index = g_array_index (nodes, guint, pos);
+  guint text_base = gst_buffer_n_memory (buf);
+  guint text_start = text_nodes->len;
+  GstSubtitleStyleSet *block_style;
+  GstSubtitleBlock *block;
+  TtmlElement *element;
+  guint i;
 
-  xml_string = xmlGetProp (node, (xmlChar *) name);
-  if (!xml_string)
-    return NULL;
-  gst_string = g_strdup ((gchar *) xml_string);
-  xmlFree (xml_string);
-  return gst_string;
-}
+  block = ttml_object_cache_reuse (cache, table, p_index, nodes, pos, end,
+      block_color, buf, text_nodes);
+  if (block)
+    return block;
 
+  element = ttml_node_table_get_element (table, p_index);
+  g_assert (element->type == TTML_ELEMENT_TYPE_P);
 
-/* EBU-TT-D timecodes have format hours:minutes:seconds[.fraction] */
-static GstClockTime
-ttml_parse_timecode (const gchar * timestring)
-{
-  gchar **strings;
-  guint64 hours = 0, minutes = 0, seconds = 0, milliseconds = 0;
-  GstClockTime time = GST_CLOCK_TIME_NONE;
-
-  GST_CAT_LOG (ttmlparse, "time string: %s", timestring);
-
-  strings = g_strsplit (timestring, ":", 3);
-  if (g_strv_length (strings) != 3U) {
-    GST_CAT_ERROR (ttmlparse, "badly formatted time string: %s", timestring);
-    return time;
-  }
-
-  hours = g_ascii_strtoull (strings[0], NULL, 10U);
-  minutes = g_ascii_strtoull (strings[1], NULL, 10U);
-  if (g_strstr_len (strings[2], -1, ".")) {
-    guint n_digits;
-    gchar ** substrings = g_strsplit (strings[2], ".", 2);
-    seconds = g_ascii_strtoull (substrings[0], NULL, 10U);
-    n_digits = strlen (substrings[1]);
-    milliseconds = g_ascii_strtoull (substrings[1], NULL, 10U);
-    milliseconds =
-      (guint64) (milliseconds * pow (10.0, (3 - (double) n_digits)));
-    g_strfreev (substrings);
-  } else {
-    seconds = g_ascii_strtoull (strings[2], NULL, 10U);
-  }
+  block_style = gst_subtitle_style_set_new ();
+  ttml_update_style_set (block_style, element->style_set, cellres_x,
+      cellres_y);
+  block_style->background_color = block_color;
+  block = gst_subtitle_block_new (block_style);
+  g_assert (block != NULL);
 
-  if (minutes > 59 || seconds > 60) {
-    GST_CAT_ERROR (ttmlparse, "invalid time string "
-        "(minutes or seconds out-of-bounds): %s\n", timestring);
-  }
+  for (i = pos + 1; i < end; ++i) {
+    guint index = g_array_index (nodes, guint, i);
+    guint parent = ttml_node_table_get_parent (table, index);
 
-  g_strfreev (strings);
-  GST_CAT_LOG (ttmlparse,
-      "hours: %" G_GUINT64_FORMAT "  minutes: %" G_GUINT64_FORMAT
-      "  seconds: %" G_GUINT64_FORMAT "  milliseconds: %" G_GUINT64_FORMAT "",
-      hours,  minutes,  seconds,  milliseconds);
+    element = ttml_node_table_get_element (table, index);
 
-  time = hours * GST_SECOND * 3600
-       + minutes * GST_SECOND * 60
-       + seconds * GST_SECOND
-       + milliseconds * GST_MSECOND;
+    if (parent == p_index) {
+      if (element->type == TTML_ELEMENT_TYPE_BR
+          || element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
+        ttml_add_element (block, cache, table, nodes, i, buf, text_nodes,
+            cellres_x, cellres_y);
+      } else if (element->type != TTML_ELEMENT_TYPE_SPAN) {
+        GST_CAT_ERROR (ttmlparse,
+            "Element type not allowed at this level of document.");
+      }
+    } else if (ttml_node_table_get_parent (table, parent) == p_index) {
+      /* Only the anon-span children of a span are rendered; nodes nested
+       * more deeply carry no renderable content. */
+      if (ttml_node_table_get_element (table, parent)->type
+          != TTML_ELEMENT_TYPE_SPAN)
+        continue;
+
+      if (element->type == TTML_ELEMENT_TYPE_BR
+          || element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
+        ttml_add_element (block, cache, table, nodes, i, buf, text_nodes,
+            cellres_x, cellres_y);
+      } else {
+        GST_CAT_ERROR (ttmlparse,
+            "Element type not allowed at this level of document.");
+      }
+    }
+  }
 
-  return time;
+  ttml_object_cache_store (cache, p_index, block, nodes, pos, end,
+      block_color, text_base, text_nodes, text_start);
+  return block;
 }
 
 
-static TtmlElement *
-ttml_parse_element (const xmlNode * node)
+/* Create the subtitle region and its child blocks and elements for the region
+ * whose node index is at position @pos in @nodes, inserting element text in
+ * @buf. @nodes lists, in document order, the indexes in @table of the nodes
+ * visible in a scene; on return, @pos is updated to the position of the next
+ * region in @nodes. Objects unchanged from an earlier scene are taken from
+ * @cache. Ownership of the region is transferred to caller. */
+static GstSubtitleRegion *
+ttml_create_subtitle_region (TtmlObjectCache * cache, TtmlNodeTable * table,
+    GArray * nodes, guint * pos, GstBuffer * buf, guint cellres_x,
+    guint cellres_y)
 {
+  GstSubtitleRegion *region = NULL;
+  GstSubtitleStyleSet *region_style;
+  GstSubtitleColor transparent = { 0, 0, 0, 0 };
+  GstSubtitleColor block_color = transparent;
+  GstSubtitleBlock *block = NULL;
   TtmlElement *element;
-  TtmlElementType type;
-  gchar *value;
+  GArray *text_nodes;
+  guint region_index, start, end, text_base, i;
 
-  GST_CAT_DEBUG (ttmlparse, "Element name: %s", (const char*) node->name);
-  if ((g_strcmp0 ((const char*) node->name, "style") == 0)) {
-    type = TTML_ELEMENT_TYPE_STYLE;
-  } else if ((g_strcmp0 ((const char*) node->name, "region") == 0)) {
-    type = TTML_ELEMENT_TYPE_REGION;
-  } else if ((g_strcmp0 ((const char*) node->name, "body") == 0)) {
-    type = TTML_ELEMENT_TYPE_BODY;
-  } else if ((g_strcmp0 ((const char*) node->name, "div") == 0)) {
-    type = TTML_ELEMENT_TYPE_DIV;
-  } else if ((g_strcmp0 ((const char*) node->name, "p") == 0)) {
-    type = TTML_ELEMENT_TYPE_P;
-  } else if ((g_strcmp0 ((const char*) node->name, "span") == 0)) {
-    type = TTML_ELEMENT_TYPE_SPAN;
-  } else if ((g_strcmp0 ((const char*) node->name, "text") == 0)) {
-    type = TTML_ELEMENT_TYPE_ANON_SPAN;
-  } else if ((g_strcmp0 ((const char*) node->name, "br") == 0)) {
-    type = TTML_ELEMENT_TYPE_BR;
-  } else {
-    return NULL;
-  }
+  start = *pos;
+  region_index = g_array_index (nodes, guint, start);
+  end = ttml_find_subtree_end (table, nodes, start + 1, region_index);
+  *pos = end;
 
-  element = g_slice_new0 (TtmlElement);
-  element->type = type;
+  text_nodes = g_array_new (FALSE, FALSE, sizeof (guint));
+  text_base = gst_buffer_n_memory (buf);
 
-  if ((value = ttml_get_xml_property (node, "id"))) {
-    element->id = g_strdup (value);
-    g_free (value);
+  region = ttml_object_cache_reuse (cache, table, region_index, nodes, start,
+      end, transparent, buf, text_nodes);
+  if (region) {
+    g_array_free (text_nodes, TRUE);
+    return region;
   }
 
-  if ((value = ttml_get_xml_property (node, "style"))) {
-    element->styles = g_strsplit (value, " ", 0);
-    GST_CAT_DEBUG (ttmlparse, "%u style(s) referenced in element.",
-        g_strv_length (element->styles));
-    g_free (value);
-  }
+  element = ttml_node_table_get_element (table, region_index);
+  g_assert (element->type == TTML_ELEMENT_TYPE_REGION);
 
-  if (element->type == TTML_ELEMENT_TYPE_STYLE
-      || element->type == TTML_ELEMENT_TYPE_REGION) {
-    TtmlStyleSet *ss;
-    ss = ttml_parse_style_set (node);
-    if (ss)
-      element->style_set = ss;
-    else
-      GST_CAT_WARNING (ttmlparse,
-          "Style or Region contains no styling attributes.");
-  }
+  region_style = gst_subtitle_style_set_new ();
+  ttml_update_style_set (region_style, element->style_set, cellres_x,
+      cellres_y);
+  region = gst_subtitle_region_new (region_style);
 
-  if ((value = ttml_get_xml_property (node, "region"))) {
-    element->region = g_strdup (value);
-    g_free (value);
-  }
+  for (i = start + 1; i < end; ++i) {
+    guint index = g_array_index (nodes, guint, i);
+    guint depth = 1, ancestor;
 
-  if ((value = ttml_get_xml_property (node, "begin"))) {
-    element->begin = ttml_parse_timecode (value);
-    g_free (value);
-  } else {
-    element->begin = GST_CLOCK_TIME_NONE;
-  }
+    /* Depth of node below the region element. */
+    for (ancestor = ttml_node_table_get_parent (table, index);
+        ancestor != region_index && depth <= 3;
+        ancestor = ttml_node_table_get_parent (table, ancestor))
+      ++depth;
 
-  if ((value = ttml_get_xml_property (node, "end"))) {
-    element->end = ttml_parse_timecode (value);
-    g_free (value);
-  } else {
-    element->end = GST_CLOCK_TIME_NONE;
-  }
+    element = ttml_node_table_get_element (table, index);
 
-  if (node->content) {
-    GST_CAT_LOG (ttmlparse, "Node content: %s", node->content);
-    element->text = g_strdup ((const gchar*) node->content);
-  }
+    switch (depth) {
+      case 1:
+        g_assert (element->type == TTML_ELEMENT_TYPE_BODY);
+        block_color =
+          ttml_get_background_color (element->style_set);
+        break;
 
-  if ((value = ttml_get_xml_property (node, "space"))) {
-    if (g_strcmp0 (value, "preserve") == 0)
-      element->whitespace_mode = TTML_WHITESPACE_MODE_PRESERVE;
-    else if (g_strcmp0 (value, "default") == 0)
-      element->whitespace_mode = TTML_WHITESPACE_MODE_DEFAULT;
-    g_free (value);
+      case 2:
+      {
+        GstSubtitleColor div_color;
+
+        g_assert (element->type == TTML_ELEMENT_TYPE_DIV);
+        div_color =
+          ttml_get_background_color (element->style_set);
+        block_color = ttml_blend_colors (block_color, div_color);
+        break;
+      }
+
+      case 3:
+      {
+        GstSubtitleColor p_color;
+        guint block_end;
+
+        g_assert (element->type == TTML_ELEMENT_TYPE_P);
+        p_color = ttml_get_background_color (element->style_set);
+        block_color = ttml_blend_colors (block_color, p_color);
+        block_end = ttml_find_subtree_end (table, nodes, i + 1, index);
+        block = ttml_create_subtitle_block (cache, table, nodes, i, block_end,
+            block_color, buf, text_nodes, cellres_x, cellres_y);
+
+        gst_subtitle_region_add_block (region, block);
+        GST_CAT_DEBUG (ttmlparse, "Added block to region; there are now %u "
+            "blocks in the region.",
+            gst_subtitle_region_get_block_count (region));
+        i = block_end - 1;
+        break;
+      }
+
+      default:
+        break;
+    }
   }
 
-  return element;
+  ttml_object_cache_store (cache, region_index, region, nodes, start, end,
+      transparent, text_base, text_nodes, 0);
+  g_array_free (text_nodes, TRUE);
+  return region;
 }
 
 
-static GNode *
-ttml_parse_body (const xmlNode * node)
+/* Create data objects to describe the layout and styling of @scene and
+ * attach them as metadata to the GstBuffer that will be used to carry the
+ * scene's text, taking those unchanged from earlier scenes from @cache. */
+static void
+ttml_attach_scene_metadata (TtmlScene * scene, TtmlNodeTable * table,
+    TtmlObjectCache * cache, guint cellres_x, guint cellres_y)
 {
-  GNode *ret;
-  TtmlElement *element;
+  GPtrArray *regions = g_ptr_array_new_with_free_func (
+    (GDestroyNotify) gst_subtitle_region_unref);
+  guint pos = 0;
 
-  GST_CAT_LOG (ttmlparse, "parsing node %s", node->name);
-  element = ttml_parse_element (node);
-  if (element)
-    ret = g_node_new (element);
-  else
-    return NULL;
+  scene->buf = gst_buffer_new ();
+  GST_BUFFER_PTS (scene->buf) = scene->begin;
+  GST_BUFFER_DURATION (scene->buf) = (scene->end - scene->begin);
+
+  while (pos < scene->elements->len) {
+    GstSubtitleRegion *region;
 
-  for (node = node->children; node != NULL; node = node->next) {
-    GNode *descendants = NULL;
-    if (!xmlIsBlankNode (node) && (descendants = ttml_parse_body (node)))
-        g_node_append (ret, descendants);
+    region = ttml_create_subtitle_region (cache, table, scene->elements, &pos,
+        scene->buf, cellres_x, cellres_y);
+    g_ptr_array_add (regions, region);
   }
 
-  return ret;
+  gst_buffer_add_subtitle_meta (scene->buf, regions);
+}
+
+
+/* Trim @scene to fit within @window. Returns FALSE if @scene lies wholly
+ * outside @window. */
+static gboolean
+ttml_clip_scene (TtmlScene * scene, const TtmlTimeWindow * window)
+{
+  if (scene->end <= window->begin || scene->begin >= window->end)
+    return FALSE;
+
+  scene->begin = MAX (scene->begin, window->begin);
+  scene->end = MIN (scene->end, window->end);
+  return TRUE;
 }
 
 
-/* Update the fields of a GstSubtitleStyleSet, @style_set, according to the
- * values defined in a TtmlStyleSet, @tss, and a given cell resolution. */
 static void
-ttml_update_style_set (GstSubtitleStyleSet * style_set, TtmlStyleSet * tss,
-    guint cellres_x, guint cellres_y)
+ttml_assign_region_times (GList *region_trees, GstClockTime doc_begin,
+    GstClockTime doc_duration)
 {
-  if (tss->text_direction) {
-    if (g_strcmp0 (tss->text_direction, "rtl") == 0)
-      style_set->text_direction = GST_SUBTITLE_TEXT_DIRECTION_RTL;
-    else
-      style_set->text_direction = GST_SUBTITLE_TEXT_DIRECTION_LTR;
-  }
+  GList *tree;
 
-  if (tss->font_family) {
-    if (strlen (tss->font_family) <= MAX_FONT_FAMILY_NAME_LENGTH) {
-      g_free (style_set->font_family);
-      style_set->font_family = g_strdup (tss->font_family);
-    } else {
-      GST_CAT_WARNING (ttmlparse,
-          "Ignoring font family name as it's overly long.");
+  for (tree = g_list_first (region_trees); tree; tree = tree->next) {
+    GNode *region_node = (GNode *)tree->data;
+    TtmlElement *region = (TtmlElement *)region_node->data;
+    gboolean always_visible =
+      !(region->style_set->present & TTML_STYLE_PROP_SHOW_BACKGROUND)
+      || (region->style_set->show_background
+          == GST_SUBTITLE_BACKGROUND_MODE_ALWAYS);
+
+    GstSubtitleColor region_color =
+      ttml_get_background_color (region->style_set);
+
+    if (always_visible && !ttml_color_is_transparent (&region_color)) {
+      GST_CAT_DEBUG (ttmlparse, "Assigning times to region.");
+      /* If the input XML document was not encapsulated in a container that
+       * provides timing information for the document as a whole (i.e., its
+       * PTS and duration) and the region background should be always visible,
+       * set region start time to 40ms and end time to 24 hours. This allows
+       * the transition finding logic to work cleanly and ensures that
+       * regions with showBackground="always" are visible for [virtually] the
+       * entirety of any real-world stream. */
+      region->begin = (doc_begin != GST_CLOCK_TIME_NONE) ?
+        doc_begin : 40 * GST_MSECOND;
+      region->end = (doc_duration != GST_CLOCK_TIME_NONE) ?
+        region->begin + doc_duration : 24 * 3600 * GST_SECOND;
     }
   }
+}
 
-  if (tss->font_size) {
-    style_set->font_size = g_ascii_strtod (tss->font_size, NULL) / 100.0;
-  }
-  style_set->font_size *= (1.0 / cellres_y);
 
-  if (tss->line_height) {
-    /* The TTML spec (section 8.2.12) recommends using a line height of 125%
-     * when "normal" is specified. */
-    if (g_strcmp0 (tss->line_height, "normal") == 0)
-      style_set->line_height = 1.25;
-    else
-      style_set->line_height = g_ascii_strtod (tss->line_height, NULL) / 100.0;
-  }
-
-  if (tss->text_align) {
-    if (g_strcmp0 (tss->text_align, "left") == 0)
-      style_set->text_align = GST_SUBTITLE_TEXT_ALIGN_LEFT;
-    else if (g_strcmp0 (tss->text_align, "center") == 0)
-      style_set->text_align = GST_SUBTITLE_TEXT_ALIGN_CENTER;
-    else if (g_strcmp0 (tss->text_align, "right") == 0)
-      style_set->text_align = GST_SUBTITLE_TEXT_ALIGN_RIGHT;
-    else if (g_strcmp0 (tss->text_align, "end") == 0)
-      style_set->text_align = GST_SUBTITLE_TEXT_ALIGN_END;
-    else
-      style_set->text_align = GST_SUBTITLE_TEXT_ALIGN_START;
-  }
+/* The styles and regions defined in the <head> of a document. The segments of
+ * a DASH subtitle stream typically carry identical heads, so a head may be
+ * shared, through a TtmlHeadCache, by any number of documents; its elements
+ * are therefore allocated from an arena of its own rather than from that of
+ * any one document, and are not modified once the head has been parsed.
+ * @bytes holds the serialized head from which it was parsed, if it has been
+ * cached, and @time_params the time parameters of the root element of its
+ * document, by which the times of its regions were resolved. */
+typedef struct {
+  gint ref_count;
+  GBytes *bytes;
+  TtmlTimeParams time_params;
+  TtmlArena *arena;
+  GHashTable *styles_table;
+  GHashTable *regions_table;
+} TtmlHead;
 
-  if (tss->color) {
-    style_set->color = ttml_parse_colorstring (tss->color);
-  }
+/* The maximum number of distinct heads held by a TtmlHeadCache. */
+#define TTML_HEAD_CACHE_SIZE 4
 
-  if (tss->background_color) {
-    style_set->background_color =
-      ttml_parse_colorstring (tss->background_color);
-  }
+/* Parsed heads, keyed by their serialized bytes and the time parameters of
+ * their documents, most recently used first. */
+struct _TtmlHeadCache {
+  GQueue heads;
+};
 
-  if (tss->font_style) {
-    if (g_strcmp0 (tss->font_style, "italic") == 0)
-      style_set->font_style = GST_SUBTITLE_FONT_STYLE_ITALIC;
-    else
-      style_set->font_style = GST_SUBTITLE_FONT_STYLE_NORMAL;
-  }
 
-  if (tss->font_weight) {
-    if (g_strcmp0 (tss->font_weight, "bold") == 0)
-      style_set->font_weight = GST_SUBTITLE_FONT_WEIGHT_BOLD;
-    else
-      style_set->font_weight = GST_SUBTITLE_FONT_WEIGHT_NORMAL;
-  }
+static TtmlHead *
+ttml_head_new (void)
+{
+  TtmlHead *head = g_slice_new0 (TtmlHead);
 
-  if (tss->text_decoration) {
-    if (g_strcmp0 (tss->text_decoration, "underline") == 0)
-      style_set->text_decoration = GST_SUBTITLE_TEXT_DECORATION_UNDERLINE;
-    else
-      style_set->text_decoration = GST_SUBTITLE_TEXT_DECORATION_NONE;
-  }
+  head->ref_count = 1;
+  head->arena = ttml_arena_new ();
+  head->styles_table = g_hash_table_new (g_str_hash, g_str_equal);
+  head->regions_table = g_hash_table_new (g_str_hash, g_str_equal);
+  return head;
+}
 
-  if (tss->unicode_bidi) {
-    if (g_strcmp0 (tss->unicode_bidi, "embed") == 0)
-      style_set->unicode_bidi = GST_SUBTITLE_UNICODE_BIDI_EMBED;
-    else if (g_strcmp0 (tss->unicode_bidi, "bidiOverride") == 0)
-      style_set->unicode_bidi = GST_SUBTITLE_UNICODE_BIDI_OVERRIDE;
-    else
-      style_set->unicode_bidi = GST_SUBTITLE_UNICODE_BIDI_NORMAL;
-  }
 
-  if (tss->wrap_option) {
-    if (g_strcmp0 (tss->wrap_option, "noWrap") == 0)
-      style_set->wrap_option = GST_SUBTITLE_WRAPPING_OFF;
-    else
-      style_set->wrap_option = GST_SUBTITLE_WRAPPING_ON;
-  }
+static TtmlHead *
+ttml_head_ref (TtmlHead * head)
+{
+  ++head->ref_count;
+  return head;
+}
 
-  if (tss->multi_row_align) {
-    if (g_strcmp0 (tss->multi_row_align, "start") == 0)
-      style_set->multi_row_align = GST_SUBTITLE_MULTI_ROW_ALIGN_START;
-    else if (g_strcmp0 (tss->multi_row_align, "center") == 0)
-      style_set->multi_row_align = GST_SUBTITLE_MULTI_ROW_ALIGN_CENTER;
-    else if (g_strcmp0 (tss->multi_row_align, "end") == 0)
-      style_set->multi_row_align = GST_SUBTITLE_MULTI_ROW_ALIGN_END;
-    else
-      style_set->multi_row_align = GST_SUBTITLE_MULTI_ROW_ALIGN_AUTO;
-  }
 
-  if (tss->line_padding) {
-    style_set->line_padding = g_ascii_strtod (tss->line_padding, NULL);
-    style_set->line_padding *= (1.0 / cellres_x);
-  }
+static void
+ttml_head_unref (TtmlHead * head)
+{
+  if (--head->ref_count > 0)
+    return;
 
-  if (tss->origin) {
-    gchar *c;
-    style_set->origin_x = g_ascii_strtod (tss->origin, &c) / 100.0;
-    while (!g_ascii_isdigit (*c) && *c != '+' && *c != '-') ++c;
-    style_set->origin_y = g_ascii_strtod (c, NULL) / 100.0;
-  }
+  g_hash_table_destroy (head->styles_table);
+  g_hash_table_destroy (head->regions_table);
+  ttml_arena_free (head->arena);
+  if (head->bytes)
+    g_bytes_unref (head->bytes);
+  g_slice_free (TtmlHead, head);
+}
 
-  if (tss->extent) {
-    gchar *c;
-    style_set->extent_w = g_ascii_strtod (tss->extent, &c) / 100.0;
-    if ((style_set->origin_x + style_set->extent_w) > 1.0) {
-      style_set->extent_w = 1.0 - style_set->origin_x;
-    }
-    while (!g_ascii_isdigit (*c) && *c != '+' && *c != '-') ++c;
-    style_set->extent_h = g_ascii_strtod (c, NULL) / 100.0;
-    if ((style_set->origin_y + style_set->extent_h) > 1.0) {
-      style_set->extent_h = 1.0 - style_set->origin_y;
-    }
-  }
 
-  if (tss->display_align) {
-    if (g_strcmp0 (tss->display_align, "center") == 0)
-      style_set->display_align = GST_SUBTITLE_DISPLAY_ALIGN_CENTER;
-    else if (g_strcmp0 (tss->display_align, "after") == 0)
-      style_set->display_align = GST_SUBTITLE_DISPLAY_ALIGN_AFTER;
-    else
-      style_set->display_align = GST_SUBTITLE_DISPLAY_ALIGN_BEFORE;
-  }
+TtmlHeadCache *
+ttml_head_cache_new (void)
+{
+  TtmlHeadCache *cache = g_slice_new0 (TtmlHeadCache);
 
-  if (tss->padding) {
-    gchar **decimals;
-    guint n_decimals;
-    guint i;
+  g_queue_init (&cache->heads);
+  return cache;
+}
 
-    decimals = g_strsplit (tss->padding, "%", 0);
-    n_decimals = g_strv_length (decimals) - 1;
-    for (i = 0; i < n_decimals; ++i)
-      g_strstrip (decimals[i]);
 
-    switch (n_decimals) {
-      case 1:
-        style_set->padding_start = style_set->padding_end =
-          style_set->padding_before = style_set->padding_after =
-          g_ascii_strtod (decimals[0], NULL) / 100.0;
-        break;
+void
+ttml_head_cache_free (TtmlHeadCache * cache)
+{
+  g_queue_foreach (&cache->heads, (GFunc) ttml_head_unref, NULL);
+  g_queue_clear (&cache->heads);
+  g_slice_free (TtmlHeadCache, cache);
+}
 
-      case 2:
-        style_set->padding_before = style_set->padding_after =
-          g_ascii_strtod (decimals[0], NULL) / 100.0;
-        style_set->padding_start = style_set->padding_end =
-          g_ascii_strtod (decimals[1], NULL) / 100.0;
-        break;
 
-      case 3:
-        style_set->padding_before = g_ascii_strtod (decimals[0], NULL) / 100.0;
-        style_set->padding_start = style_set->padding_end =
-          g_ascii_strtod (decimals[1], NULL) / 100.0;
-        style_set->padding_after = g_ascii_strtod (decimals[2], NULL) / 100.0;
-        break;
+/* Returns a new reference to the cached head parsed from the @len bytes at
+ * @data in a document with time parameters @params, or NULL if there is
+ * none. */
+static TtmlHead *
+ttml_head_cache_lookup (TtmlHeadCache * cache, const gchar * data, gsize len,
+    const TtmlTimeParams * params)
+{
+  GBytes *key = g_bytes_new_static (data, len);
+  guint hash = g_bytes_hash (key);
+  GList *link;
 
-      case 4:
-        style_set->padding_before = g_ascii_strtod (decimals[0], NULL) / 100.0;
-        style_set->padding_end = g_ascii_strtod (decimals[1], NULL) / 100.0;
-        style_set->padding_after = g_ascii_strtod (decimals[2], NULL) / 100.0;
-        style_set->padding_start = g_ascii_strtod (decimals[3], NULL) / 100.0;
-        break;
-    }
-    g_strfreev (decimals);
+  for (link = cache->heads.head; link; link = link->next) {
+    TtmlHead *head = link->data;
 
-    /* Padding values in TTML files are relative to the region width & height;
-     * make them relative to the overall display width & height like all other
-     * dimensions. */
-    style_set->padding_before *= style_set->extent_h;
-    style_set->padding_after *= style_set->extent_h;
-    style_set->padding_end *= style_set->extent_w;
-    style_set->padding_start *= style_set->extent_w;
-  }
-
-  if (tss->writing_mode) {
-    if (g_str_has_prefix (tss->writing_mode, "rl"))
-      style_set->writing_mode = GST_SUBTITLE_WRITING_MODE_RLTB;
-    else if ((g_strcmp0 (tss->writing_mode, "tbrl") == 0)
-        || (g_strcmp0 (tss->writing_mode, "tb") == 0))
-      style_set->writing_mode = GST_SUBTITLE_WRITING_MODE_TBRL;
-    else if (g_strcmp0 (tss->writing_mode, "tblr") == 0)
-      style_set->writing_mode = GST_SUBTITLE_WRITING_MODE_TBLR;
-    else
-      style_set->writing_mode = GST_SUBTITLE_WRITING_MODE_LRTB;
+    if (!ttml_time_params_equal (&head->time_params, params))
+      continue;
+    /* g_bytes_hash() is cheap, but g_bytes_equal() compares every byte. */
+    if (g_bytes_hash (head->bytes) == hash && g_bytes_equal (head->bytes, key))
+      break;
   }
+  g_bytes_unref (key);
 
-  if (tss->show_background) {
-    if (g_strcmp0 (tss->show_background, "whenActive") == 0)
-      style_set->show_background = GST_SUBTITLE_BACKGROUND_MODE_WHEN_ACTIVE;
-    else
-      style_set->show_background = GST_SUBTITLE_BACKGROUND_MODE_ALWAYS;
-  }
+  if (!link)
+    return NULL;
 
-  if (tss->overflow) {
-    if (g_strcmp0 (tss->overflow, "visible") == 0)
-      style_set->overflow = GST_SUBTITLE_OVERFLOW_MODE_VISIBLE;
-    else
-      style_set->overflow = GST_SUBTITLE_OVERFLOW_MODE_HIDDEN;
-  }
+  g_queue_unlink (&cache->heads, link);
+  g_queue_push_head_link (&cache->heads, link);
+  return ttml_head_ref (link->data);
 }
 
 
-static TtmlStyleSet *
-ttml_copy_style_set (TtmlStyleSet * style_set)
-{
-  TtmlStyleSet *ret;
-
-  ret = g_slice_new0 (TtmlStyleSet);
-
-  if (style_set->text_direction)
-    ret->text_direction = g_strdup (style_set->text_direction);
-  if (style_set->font_family)
-    ret->font_family = g_strdup (style_set->font_family);
-  if (style_set->font_size)
-    ret->font_size = g_strdup (style_set->font_size);
-  if (style_set->line_height)
-    ret->line_height = g_strdup (style_set->line_height);
-  if (style_set->text_align)
-    ret->text_align = g_strdup (style_set->text_align);
-  if (style_set->color)
-    ret->color = g_strdup (style_set->color);
-  if (style_set->background_color)
-    ret->background_color = g_strdup (style_set->background_color);
-  if (style_set->font_style)
-    ret->font_style = g_strdup (style_set->font_style);
-  if (style_set->font_weight)
-    ret->font_weight = g_strdup (style_set->font_weight);
-  if (style_set->text_decoration)
-    ret->text_decoration = g_strdup (style_set->text_decoration);
-  if (style_set->unicode_bidi)
-    ret->unicode_bidi = g_strdup (style_set->unicode_bidi);
-  if (style_set->wrap_option)
-    ret->wrap_option = g_strdup (style_set->wrap_option);
-  if (style_set->multi_row_align)
-    ret->multi_row_align = g_strdup (style_set->multi_row_align);
-  if (style_set->line_padding)
-    ret->line_padding = g_strdup (style_set->line_padding);
-  if (style_set->origin)
-    ret->origin = g_strdup (style_set->origin);
-  if (style_set->extent)
-    ret->extent = g_strdup (style_set->extent);
-  if (style_set->display_align)
-    ret->display_align = g_strdup (style_set->display_align);
-  if (style_set->overflow)
-    ret->overflow = g_strdup (style_set->overflow);
-  if (style_set->padding)
-    ret->padding = g_strdup (style_set->padding);
-  if (style_set->writing_mode)
-    ret->writing_mode = g_strdup (style_set->writing_mode);
-  if (style_set->show_background)
-    ret->show_background = g_strdup (style_set->show_background);
+/* Add @head, which was parsed from the @len bytes at @data in a document with
+ * time parameters @params, to @cache, evicting the least recently used head
+ * if the cache is full. */
+static void
+ttml_head_cache_insert (TtmlHeadCache * cache, TtmlHead * head,
+    const gchar * data, gsize len, const TtmlTimeParams * params)
+{
+  head->bytes = g_bytes_new (data, len);
+  head->time_params = *params;
+  g_queue_push_head (&cache->heads, ttml_head_ref (head));
 
-  return ret;
+  if (g_queue_get_length (&cache->heads) > TTML_HEAD_CACHE_SIZE)
+    ttml_head_unref (g_queue_pop_tail (&cache->heads));
+
+  GST_CAT_DEBUG (ttmlparse, "Cached head of %" G_GSIZE_FORMAT " bytes with %u "
+      "styles and %u regions.", len, g_hash_table_size (head->styles_table),
+      g_hash_table_size (head->regions_table));
 }
 
 
-/* s2 overrides s1. Unlike style inheritance, merging will result in all values from s1 being merged into s2. */
-static TtmlStyleSet *
-ttml_merge_style_sets (TtmlStyleSet * set1, TtmlStyleSet * set2)
-{
-  TtmlStyleSet *ret = NULL;
-
-  if (set1) {
-    ret = ttml_copy_style_set (set1);
-
-    if (set2) {
-      if (set2->text_direction)
-        ret->text_direction = g_strdup (set2->text_direction);
-      if (set2->font_family)
-        ret->font_family = g_strdup (set2->font_family);
-      if (set2->font_size)
-        ret->font_size = g_strdup (set2->font_size);
-      if (set2->line_height)
-        ret->line_height = g_strdup (set2->line_height);
-      if (set2->text_align)
-        ret->text_align = g_strdup (set2->text_align);
-      if (set2->background_color)
-        ret->background_color = g_strdup (set2->background_color);
-      if (set2->color)
-        ret->color = g_strdup (set2->color);
-      if (set2->font_style)
-        ret->font_style = g_strdup (set2->font_style);
-      if (set2->font_weight)
-        ret->font_weight = g_strdup (set2->font_weight);
-      if (set2->text_decoration)
-        ret->text_decoration = g_strdup (set2->text_decoration);
-      if (set2->unicode_bidi)
-        ret->unicode_bidi = g_strdup (set2->unicode_bidi);
-      if (set2->wrap_option)
-        ret->wrap_option = g_strdup (set2->wrap_option);
-      if (set2->multi_row_align)
-        ret->multi_row_align = g_strdup (set2->multi_row_align);
-      if (set2->line_padding)
-        ret->line_padding = g_strdup (set2->line_padding);
-      if (set2->origin)
-        ret->origin = g_strdup (set2->origin);
-      if (set2->extent)
-        ret->extent = g_strdup (set2->extent);
-      if (set2->display_align)
-        ret->display_align = g_strdup (set2->display_align);
-      if (set2->overflow)
-        ret->overflow = g_strdup (set2->overflow);
-      if (set2->padding)
-        ret->padding = g_strdup (set2->padding);
-      if (set2->writing_mode)
-        ret->writing_mode = g_strdup (set2->writing_mode);
-      if (set2->show_background)
-        ret->show_background = g_strdup (set2->show_background);
-    }
-  } else if (set2) {
-    ret = ttml_copy_style_set (set2);
-  }
+/* The part of the document within which the parser currently is. */
+typedef enum {
+  TTML_PARSER_SECTION_ROOT,
+  TTML_PARSER_SECTION_HEAD,
+  TTML_PARSER_SECTION_STYLING,
+  TTML_PARSER_SECTION_LAYOUT,
+  TTML_PARSER_SECTION_BODY
+} TtmlParserSection;
 
-  return ret;
+/* The byte range of an element's start tag within a document. */
+typedef struct {
+  gsize start;
+  gsize end;
+} TtmlTagRange;
+
+/* A point in a document, just after the end tag of an element within the
+ * body, from which a document that extends it can be parsed. @n_tags gives
+ * the number of elements open at that point, and @parent the deepest of
+ * those, whose last child was then @last_child. */
+typedef struct {
+  gsize offset;
+  guint n_tags;
+  GNode *parent;
+  GNode *last_child;
+} TtmlResumePoint;
+
+/* Builds the element trees for a document from the events generated by a
+ * libxml2 SAX2 push parser, so that a document can be parsed as it arrives
+ * without first being read into a DOM. Elements that are not needed (e.g.,
+ * metadata, embedded fonts and images) are skipped along with all of their
+ * descendants.
+ *
+ * A parser may be used for a succession of documents. Live encoders often
+ * republish a document with new content appended to its body. Any point
+ * after the end tag of an element within the body, beyond which the previous
+ * document added nothing to the body, is a resume point. If a document is
+ * identical to its predecessor up to a resume point, the trees built for the
+ * previous document are kept. Only the remainder of the new document is
+ * parsed, by giving libxml2 the start tags of the elements that were open at
+ * the resume point followed by the bytes after it, and only the scenes
+ * affected by the new content are built. */
+struct _TtmlParser {
+  xmlParserCtxtPtr ctxt;
+  gsize bytes_fed;
+  glong doc_end;
+  /* Added to positions in the input seen by @ctxt to give the corresponding
+   * positions in the document. */
+  glong offset_delta;
+
+  /* Holds every element, style set, string and tree node created for the
+   * body of the document and for any predecessors that it extends. */
+  TtmlArena *arena;
+
+  /* Holds the region trees and resolved style sets built from the body for
+   * the latest scenes. It is emptied before each build, so that the copies
+   * made for each document that extends its predecessor do not accumulate
+   * for as long as a live stream runs. */
+  TtmlArena *build_arena;
+
+  /* The styles and regions of the document, and the cache, if any, from
+   * which the heads of documents are taken when they have been seen before.
+   * If the head of the document is to be added to @head_cache, @head_start
+   * gives the position of its start tag. */
+  TtmlHead *head;
+  TtmlHeadCache *head_cache;
+  gboolean cache_head;
+  gsize head_start;
+  guint cellres_x, cellres_y;
+  TtmlTimeParams time_params;
+  TtmlWhitespaceMode doc_whitespace_mode;
+
+  TtmlParserSection section;
+  guint depth;
+  guint skip_depth;
+  gboolean seen_head;
+  GNode *body;
+  GNode *current;
+  GNode *last_child;
+  GString *text;
+
+  gboolean complete;
+  gboolean failed;
+  gboolean built;
+
+  /* The latest end time of the scenes returned for the document and for any
+   * predecessors that it extends. */
+  GstClockTime output_end;
+
+  /* Set if scenes are to be built using the shared thread pool. */
+  gboolean parallel;
+
+  /* The limits on the resources used to process each document, the time
+   * (in microseconds) spent so far parsing the document and building its
+   * scenes, the monotonic time at which the work in progress started, if
+   * any, and the limits the document has exceeded. Once @truncated is set,
+   * no more of the body is added to the document. */
+  TtmlLimits limits;
+  gint64 time_used;
+  gint64 work_start;
+  TtmlLimitFlags exceeded;
+  guint n_elements;
+  gboolean truncated;
+
+  /* The bytes of the document received so far, and the start tags of the
+   * root element and of each open element of the body. Positions reported by
+   * libxml2 are byte offsets within @input only if @positions_valid is
+   * set. */
+  GString *input;
+  GArray *open_tags;
+  gboolean positions_valid;
+  gboolean resumable;
+
+  /* The resume points of the document, in document order, and the start
+   * tags of the elements open at the first of them; the elements open at
+   * each of the others are a subset of those. */
+  GArray *resume_points;
+  GArray *resume_tags;
+
+  /* Set while the start of a document is compared against its
+   * predecessor. */
+  gboolean matching;
+
+  /* If the document extends its predecessor, the start tags and body nodes
+   * (body first) of the elements that were open at the resume point, the
+   * last child that the deepest of them then had, and the number of those
+   * start tags that libxml2 has so far reported. */
+  gboolean resumed;
+  GArray *reentry_tags;
+  GPtrArray *reentry_path;
+  GNode *reentry_last_child;
+  guint n_reentered;
+};
+
+
+/* Returns the position in the document of the parser. */
+static gsize
+ttml_parser_position (TtmlParser * parser)
+{
+  return (gsize) (xmlByteConsumed (parser->ctxt) + parser->offset_delta);
 }
 
 
-static const gchar *
-ttml_get_relative_font_size (const gchar * parent_size,
-    const gchar * child_size)
+/* Locate the start tag of the element that has just been entered. libxml2
+ * reports a start tag before consuming its closing '>', and a '<' cannot
+ * appear unescaped within an attribute value. Returns FALSE if the tag could
+ * not be found. */
+static gboolean
+ttml_parser_locate_start_tag (TtmlParser * parser, TtmlTagRange * tag)
 {
-  guint psize = (guint) g_ascii_strtoull (parent_size, NULL, 10U);
-  guint csize = (guint) g_ascii_strtoull (child_size, NULL, 10U);
-  csize = (csize * psize) / 100U;
-  return g_strdup_printf ("%u%%", csize);
-}
+  const gchar *str = parser->input->str;
+  gsize len = parser->input->len;
 
+  tag->start = tag->end = MIN (ttml_parser_position (parser), len);
+  while (tag->start > 0 && str[tag->start] != '<')
+    --tag->start;
+  while (tag->end < len && str[tag->end] != '>')
+    ++tag->end;
 
-static TtmlStyleSet *
-ttml_inherit_styling (TtmlStyleSet * parent, TtmlStyleSet * child)
-{
-  TtmlStyleSet *ret = NULL;
-
-  /*
-   * The following styling attributes are not inherited:
-   *   - tts:backgroundColor
-   *   - tts:origin
-   *   - tts:extent
-   *   - tts:displayAlign
-   *   - tts:overflow
-   *   - tts:padding
-   *   - tts:writingMode
-   *   - tts:showBackground
-   *   - tts:unicodeBidi
-   */
-
-  if (child) {
-    ret = ttml_copy_style_set (child);
-  } else {
-    ret = g_slice_new0 (TtmlStyleSet);
-  }
-
-  if (parent) {
-    if (parent->text_direction && !ret->text_direction)
-      ret->text_direction = g_strdup (parent->text_direction);
-    if (parent->font_family && !ret->font_family)
-      ret->font_family = g_strdup (parent->font_family);
-
-    /* In TTML, if an element which has a defined fontSize is the child of an
-     * element that also has a defined fontSize, the child's font size is
-     * relative to that of its parent. If its parent doesn't have a defined
-     * fontSize, then the child's fontSize is relative to the document's cell
-     * size. Therefore, if the former is true, we calculate the value of
-     * font_size based on the parent's font_size; otherwise, we simply keep the
-     * value defined in the child's style set. */
-    if (parent->font_size) {
-      if (!ret->font_size) {
-        ret->font_size = g_strdup (parent->font_size);
-      } else {
-        const gchar *tmp = ret->font_size;
-        ret->font_size = ttml_get_relative_font_size (parent->font_size,
-            child->font_size);
-        GST_CAT_LOG (ttmlparse, "Calculated font size: %s", ret->font_size);
-        g_free ((gpointer) tmp);
-      }
-    }
-
-    if (parent->line_height && !ret->line_height)
-      ret->line_height = g_strdup (parent->line_height);
-    if (parent->text_align && !ret->text_align)
-      ret->text_align = g_strdup (parent->text_align);
-    if (parent->color && !ret->color)
-      ret->color = g_strdup (parent->color);
-    if (parent->font_style && !ret->font_style)
-      ret->font_style = g_strdup (parent->font_style);
-    if (parent->font_weight && !ret->font_weight)
-      ret->font_weight = g_strdup (parent->font_weight);
-    if (parent->text_decoration && !ret->text_decoration)
-      ret->text_decoration = g_strdup (parent->text_decoration);
-    if (parent->wrap_option && !ret->wrap_option)
-      ret->wrap_option = g_strdup (parent->wrap_option);
-    if (parent->multi_row_align && !ret->multi_row_align)
-      ret->multi_row_align = g_strdup (parent->multi_row_align);
-    if (parent->line_padding && !ret->line_padding)
-      ret->line_padding = g_strdup (parent->line_padding);
-  }
+  if (tag->end == len || str[tag->start] != '<')
+    return FALSE;
 
-  return ret;
+  ++tag->end;
+  return TRUE;
 }
 
 
-static gchar *
-ttml_get_element_type_string (TtmlElement * element)
-{
-  switch (element->type) {
-    case TTML_ELEMENT_TYPE_STYLE:
-      return g_strdup ("<style>");
-      break;
-    case TTML_ELEMENT_TYPE_REGION:
-      return g_strdup ("<region>");
-      break;
-    case TTML_ELEMENT_TYPE_BODY:
-      return g_strdup ("<body>");
-      break;
-    case TTML_ELEMENT_TYPE_DIV:
-      return g_strdup ("<div>");
-      break;
-    case TTML_ELEMENT_TYPE_P:
-      return g_strdup ("<p>");
-      break;
-    case TTML_ELEMENT_TYPE_SPAN:
-      return g_strdup ("<span>");
-      break;
-    case TTML_ELEMENT_TYPE_ANON_SPAN:
-      return g_strdup ("<anon-span>");
-      break;
-    case TTML_ELEMENT_TYPE_BR:
-      return g_strdup ("<br>");
-      break;
-    default:
-      return g_strdup ("Unknown");
-      break;
+/* Record the location of the start tag of the element that has just been
+ * entered. */
+static void
+ttml_parser_push_open_tag (TtmlParser * parser)
+{
+  TtmlTagRange tag;
+
+  if (!ttml_parser_locate_start_tag (parser, &tag)) {
+    GST_CAT_DEBUG (ttmlparse, "Could not locate start tag; document will "
+        "not be resumable.");
+    parser->resumable = FALSE;
   }
+
+  g_array_append_val (parser->open_tags, tag);
 }
 
 
-/* Merge styles referenced by an element. */
-gboolean
-ttml_resolve_styles (GNode * node, gpointer data)
+/* Returns the position just after the end tag of the head whose start tag
+ * ends at @start, or 0 if that end tag has not yet been received. The end tag
+ * is taken to be the first with the head's qualified name, given by @prefix;
+ * should that be wrong (e.g., because a comment contains such a tag), the
+ * bytes found cannot match those of any head that has been parsed. */
+static gsize
+ttml_parser_find_head_end (TtmlParser * parser, gsize start,
+    const gchar * prefix)
 {
-  TtmlStyleSet *tmp = NULL;
-  TtmlElement *element, *style;
-  GHashTable *styles_table;
-  gchar *type_string;
-  guint i;
+  const gchar *str = parser->input->str;
+  const gchar *end = str + parser->input->len;
+  const gchar *c = str + start;
+  gsize prefix_len = prefix ? strlen (prefix) : 0;
+
+  while (c < end && (c = memchr (c, '<', end - c))) {
+    const gchar *name = c + 2;
+
+    ++c;
+    if (name > end || c[0] != '/')
+      continue;
+    if (prefix) {
+      if ((gsize) (end - name) <= prefix_len
+          || memcmp (name, prefix, prefix_len) != 0 || name[prefix_len] != ':')
+        continue;
+      name += prefix_len + 1;
+    }
+    if (end - name < 4 || memcmp (name, "head", 4) != 0)
+      continue;
 
-  styles_table = (GHashTable *)data;
-  element = node->data;
+    for (name += 4; name < end && g_ascii_isspace (*name); ++name);
+    if (name < end && *name == '>')
+      return name + 1 - str;
+  }
 
-  type_string = ttml_get_element_type_string (element);
-  GST_CAT_LOG (ttmlparse, "Element type: %s", type_string);
-  g_free (type_string);
+  return 0;
+}
 
-  if (!element->styles)
-    return FALSE;
 
-  for (i = 0; i < g_strv_length (element->styles); ++i) {
-    tmp = element->style_set;
-    style = g_hash_table_lookup (styles_table, element->styles[i]);
-    if (style) {
-      GST_CAT_LOG (ttmlparse, "Merging style %s...", element->styles[i]);
-      element->style_set = ttml_merge_style_sets (element->style_set,
-          style->style_set);
-      if (tmp)
-        ttml_delete_style_set (tmp);
-    } else {
-      GST_CAT_WARNING (ttmlparse, "Element references an unknown style (%s)",
-          element->styles[i]);
-    }
-  }
+/* Record that the document has exceeded the limits in @limit. As the
+ * document is then only partly processed, no successor may extend it. */
+static void
+ttml_parser_exceed_limit (TtmlParser * parser, TtmlLimitFlags limit)
+{
+  if (!(parser->exceeded & limit))
+    GST_CAT_WARNING (ttmlparse, "Document exceeds processing limit 0x%x.",
+        limit);
+  parser->exceeded |= limit;
+  parser->resumable = FALSE;
+  g_array_set_size (parser->resume_points, 0);
+}
 
-  GST_CAT_LOG (ttmlparse, "Style set after merging:");
-  ttml_print_style_set (element->style_set);
 
-  return FALSE;
+/* Start timing a piece of work on the document, which counts towards the
+ * time allowed for processing it. */
+static void
+ttml_parser_begin_work (TtmlParser * parser)
+{
+  parser->work_start = g_get_monotonic_time ();
 }
 
 
+/* Add the time taken by the work started by ttml_parser_begin_work() to the
+ * time used by the document. */
 static void
-ttml_resolve_referenced_styles (GList * trees, GHashTable * styles_table)
+ttml_parser_end_work (TtmlParser * parser)
 {
-  GList * tree;
+  parser->time_used += g_get_monotonic_time () - parser->work_start;
+  parser->work_start = 0;
+}
 
-  for (tree = g_list_first (trees); tree; tree = tree->next) {
-    GNode *root = (GNode *)tree->data;
-    g_node_traverse (root, G_PRE_ORDER, G_TRAVERSE_ALL, -1, ttml_resolve_styles,
-        styles_table);
+
+/* Returns TRUE if the time allowed for processing the document has run
+ * out, recording as much. Only the time spent within the parser counts, not
+ * that spent between calls to it, e.g. waiting for more of the document. */
+static gboolean
+ttml_parser_out_of_time (TtmlParser * parser)
+{
+  gint64 used = parser->time_used;
+
+  if (!GST_CLOCK_TIME_IS_VALID (parser->limits.time_budget)
+      || parser->limits.time_budget == 0)
+    return FALSE;
+
+  if (parser->work_start != 0)
+    used += g_get_monotonic_time () - parser->work_start;
+  if (used < GST_TIME_AS_USECONDS (parser->limits.time_budget))
+    return FALSE;
+
+  ttml_parser_exceed_limit (parser, TTML_LIMIT_TIME);
+  return TRUE;
+}
+
+
+/* Returns TRUE if another element may be added to the body of the
+ * document; the caller counts it in @n_elements once it has been added. Once
+ * the element limit or the time allowed is reached, the rest of the body is
+ * ignored. The clock is read only every few elements. */
+static gboolean
+ttml_parser_may_add_element (TtmlParser * parser)
+{
+  if (parser->truncated)
+    return FALSE;
+
+  if (parser->limits.max_elements > 0
+      && parser->n_elements >= parser->limits.max_elements) {
+    ttml_parser_exceed_limit (parser, TTML_LIMIT_ELEMENTS);
+    parser->truncated = TRUE;
+    return FALSE;
   }
+
+  if (parser->n_elements % 64 == 0 && ttml_parser_out_of_time (parser)) {
+    parser->truncated = TRUE;
+    return FALSE;
+  }
+
+  return TRUE;
 }
 
 
-/* Inherit styling attributes from parent. */
-gboolean
-ttml_inherit_styles (GNode * node, gpointer data)
-{
-  TtmlStyleSet *tmp = NULL;
-  TtmlElement *element, *parent;
-  gchar *type_string;
-
-  element = node->data;
-
-  type_string = ttml_get_element_type_string (element);
-  GST_CAT_LOG (ttmlparse, "Element type: %s", type_string);
-  g_free (type_string);
-
-  if (node->parent) {
-    parent = node->parent->data;
-    if (parent->style_set) {
-      tmp = element->style_set;
-      if (element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
-        /* Anon spans should merge all style attributes from their parent. */
-        element->style_set = ttml_merge_style_sets (parent->style_set,
-            element->style_set);
-      } else {
-        element->style_set = ttml_inherit_styling (parent->style_set,
-            element->style_set);
+/* Handle the start tag of the document's head. If a head consisting of the
+ * same bytes, from a document with the same time parameters, is in the head
+ * cache, it is used in place of this one, which is skipped; otherwise the
+ * head is parsed and, once its end tag has been reached, added to the cache.
+ * Returns TRUE if a cached head is used. */
+static gboolean
+ttml_parser_enter_head (TtmlParser * parser, const xmlChar * prefix)
+{
+  TtmlTagRange tag;
+  gsize head_end;
+
+  parser->cache_head = FALSE;
+
+  if (parser->head_cache && parser->positions_valid
+      && ttml_parser_locate_start_tag (parser, &tag)) {
+    head_end = ttml_parser_find_head_end (parser, tag.end,
+        (const gchar *) prefix);
+
+    if (head_end > 0 && (parser->head = ttml_head_cache_lookup (
+                parser->head_cache, parser->input->str + tag.start,
+                head_end - tag.start, &parser->time_params))) {
+      /* The head was cached under a higher region limit; parse it again so
+       * that the limit is applied. */
+      if (parser->limits.max_regions > 0
+          && g_hash_table_size (parser->head->regions_table)
+          > parser->limits.max_regions) {
+        ttml_head_unref (parser->head);
+        parser->head = ttml_head_new ();
+        return FALSE;
       }
-      if (tmp) ttml_delete_style_set (tmp);
+      GST_CAT_DEBUG (ttmlparse, "Reusing cached head.");
+      return TRUE;
     }
-  }
 
-  GST_CAT_LOG (ttmlparse, "Style set after inheriting:");
-  ttml_print_style_set (element->style_set);
+    parser->cache_head = TRUE;
+    parser->head_start = tag.start;
+  }
 
+  parser->head = ttml_head_new ();
   return FALSE;
 }
 
 
+/* Handle the end tag of a head that has been parsed, adding the head to the
+ * head cache if required. libxml2 reports an end tag after consuming its
+ * closing '>'. */
 static void
-ttml_inherit_element_styles (GList * trees)
+ttml_parser_leave_head (TtmlParser * parser)
 {
-  GList * tree;
+  gsize head_end = ttml_parser_position (parser);
 
-  for (tree = g_list_first (trees); tree; tree = tree->next) {
-    GNode *root = (GNode *)tree->data;
-    g_node_traverse (root, G_PRE_ORDER, G_TRAVERSE_ALL, -1, ttml_inherit_styles,
-        NULL);
+  if (!parser->cache_head)
+    return;
+  parser->cache_head = FALSE;
+
+  if (head_end <= parser->head_start || head_end > parser->input->len
+      || parser->input->str[head_end - 1] != '>') {
+    GST_CAT_DEBUG (ttmlparse, "Could not locate end of head; head will not "
+        "be cached.");
+    return;
   }
+
+  ttml_head_cache_insert (parser->head_cache, parser->head,
+      parser->input->str + parser->head_start, head_end - parser->head_start,
+      &parser->time_params);
 }
 
 
-/* If whitespace_mode isn't explicitly set for this element, inherit from its
- * parent. If this element is the root of the tree, set whitespace_mode to
- * that of the overall document. */
-static gboolean
-ttml_inherit_element_whitespace_mode (GNode * node, gpointer data)
+/* Record the current position, which follows the end tag of an element
+ * within the body, as a resume point. */
+static void
+ttml_parser_add_resume_point (TtmlParser * parser)
 {
-  TtmlWhitespaceMode *doc_mode = (TtmlWhitespaceMode *)data;
-  TtmlElement *element = node->data;
-  TtmlElement *parent;
-
-  if (element->whitespace_mode != TTML_WHITESPACE_MODE_NONE)
-    return FALSE;
+  TtmlResumePoint point;
 
-  if (G_NODE_IS_ROOT (node)) {
-    element->whitespace_mode = *doc_mode;
-    return FALSE;
+  if (parser->resume_points->len == 0) {
+    g_array_set_size (parser->resume_tags, 0);
+    g_array_append_vals (parser->resume_tags, parser->open_tags->data,
+        parser->open_tags->len);
   }
 
-  parent = node->parent->data;
-  element->whitespace_mode = parent->whitespace_mode;
-  return FALSE;
+  point.offset = ttml_parser_position (parser);
+  point.n_tags = parser->open_tags->len;
+  point.parent = parser->current;
+  point.last_child = parser->last_child;
+  g_array_append_val (parser->resume_points, point);
 }
 
 
+/* Append @node as the last child of the element currently being parsed. */
 static void
-ttml_inherit_whitespace_mode (GNode * tree, TtmlWhitespaceMode doc_mode)
+ttml_parser_append_node (TtmlParser * parser, GNode * node)
 {
-  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
-      ttml_inherit_element_whitespace_mode, &doc_mode);
+  /* Avoid walking the list of siblings when appending. */
+  if (parser->last_child)
+    g_node_insert_after (parser->current, parser->last_child, node);
+  else
+    g_node_append (parser->current, node);
+  parser->last_child = node;
+
+  /* The body has grown beyond any earlier resume point. */
+  g_array_set_size (parser->resume_points, 0);
 }
 
 
-static gboolean
-ttml_resolve_element_timings (GNode * node, gpointer data)
+/* Add any text accumulated since the last element boundary to the current
+ * element as an anonymous span. Text consisting solely of whitespace is
+ * discarded. */
+static void
+ttml_parser_flush_text (TtmlParser * parser)
 {
-  TtmlElement *element, *leaf;
+  gsize i;
 
-  leaf = element = node->data;
+  if (parser->text->len == 0)
+    return;
 
-  if (GST_CLOCK_TIME_IS_VALID (leaf->begin)
-      && GST_CLOCK_TIME_IS_VALID (leaf->end)) {
-    GST_CAT_LOG (ttmlparse, "Leaf node already has timing.");
-    return FALSE;
+  for (i = 0; i < parser->text->len; ++i) {
+    gchar c = parser->text->str[i];
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r')
+      break;
   }
 
-  /* Inherit timings from ancestor. */
-  while (node->parent && !GST_CLOCK_TIME_IS_VALID (element->begin)) {
-    node = node->parent;
-    element = node->data;
+  if (i < parser->text->len && ttml_parser_may_add_element (parser)) {
+    ttml_parser_append_node (parser,
+        ttml_arena_node_new (parser->arena, ttml_new_anon_span (parser->arena,
+                parser->text->str, parser->text->len)));
+    ++parser->n_elements;
   }
 
-  if (!GST_CLOCK_TIME_IS_VALID (element->begin)) {
-    GST_CAT_WARNING (ttmlparse,
-        "No timing found for element. Removing from tree...");
-    g_node_unlink (node);
-  } else {
-    leaf->begin = element->begin;
-    leaf->end = element->end;
-    GST_CAT_LOG (ttmlparse, "Leaf begin: %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (leaf->begin));
-    GST_CAT_LOG (ttmlparse, "Leaf end: %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (leaf->end));
-  }
+  g_string_truncate (parser->text, 0);
+}
 
-  return FALSE;
+
+/* Parse a strictly positive integer from @str, advancing @str past it. */
+static gboolean
+ttml_parse_positive_integer (gchar ** str, guint * value)
+{
+  gchar *end;
+  guint64 v = g_ascii_strtoull (*str, &end, 10U);
+
+  if (end == *str || v == 0 || v > G_MAXUINT)
+    return FALSE;
+  *str = end;
+  *value = (guint) v;
+  return TRUE;
 }
 
 
+/* Read the frame rate, frame rate multiplier, sub-frame rate and tick rate
+ * specified on the root element. As per section 6.2.11 of the TTML
+ * specification, the tick rate defaults to the effective frame rate times the
+ * sub-frame rate if a frame rate is specified, and to 1 otherwise. */
 static void
-ttml_resolve_timings (GNode * tree)
+ttml_parse_time_params (TtmlTimeParams * params,
+    const TtmlAttributes * attributes)
 {
-  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
-      ttml_resolve_element_timings, NULL);
+  gboolean have_frame_rate = FALSE, have_tick_rate = FALSE;
+  gchar *value, *ptr;
+  guint num, den;
+
+  if ((ptr = value = ttml_get_attribute (attributes, "frameRate"))) {
+    have_frame_rate = ttml_parse_positive_integer (&ptr,
+        &params->frame_rate);
+    if (!have_frame_rate)
+      GST_CAT_WARNING (ttmlparse, "Invalid frame rate: %s", value);
+    g_free (value);
+  }
+
+  if ((ptr = value = ttml_get_attribute (attributes, "frameRateMultiplier"))) {
+    if (ttml_parse_positive_integer (&ptr, &num)
+        && ttml_parse_positive_integer (&ptr, &den)) {
+      params->frame_rate_num = num;
+      params->frame_rate_den = den;
+    } else {
+      GST_CAT_WARNING (ttmlparse, "Invalid frame rate multiplier: %s", value);
+    }
+    g_free (value);
+  }
+
+  if ((ptr = value = ttml_get_attribute (attributes, "subFrameRate"))) {
+    if (!ttml_parse_positive_integer (&ptr, &params->sub_frame_rate))
+      GST_CAT_WARNING (ttmlparse, "Invalid sub-frame rate: %s", value);
+    g_free (value);
+  }
+
+  if ((ptr = value = ttml_get_attribute (attributes, "tickRate"))) {
+    have_tick_rate = ttml_parse_positive_integer (&ptr, &params->tick_rate);
+    if (!have_tick_rate)
+      GST_CAT_WARNING (ttmlparse, "Invalid tick rate: %s", value);
+    g_free (value);
+  }
+
+  if (!have_tick_rate && have_frame_rate)
+    params->tick_rate = gst_util_uint64_scale_round (params->frame_rate,
+        (guint64) params->frame_rate_num * params->sub_frame_rate,
+        params->frame_rate_den);
+
+  if (params->tick_rate == 0)
+    params->tick_rate = 1;
+
+  GST_CAT_DEBUG (ttmlparse, "frame rate: %u*%u/%u  sub-frame rate: %u  "
+      "tick rate: %u", params->frame_rate, params->frame_rate_num,
+      params->frame_rate_den, params->sub_frame_rate, params->tick_rate);
 }
 
 
-static gboolean
-ttml_resolve_leaf_region (GNode * node, gpointer data)
+static void
+ttml_parser_parse_root (TtmlParser * parser,
+    const TtmlAttributes * attributes)
 {
-  TtmlElement *element, *leaf;
-  leaf = element = node->data;
+  gchar *value;
 
-  while (node->parent && !element->region) {
-    node = node->parent;
-    element = node->data;
+  if ((value = ttml_get_attribute (attributes, "cellResolution"))) {
+    gchar *ptr = value;
+    parser->cellres_x = (guint) g_ascii_strtoull (ptr, &ptr, 10U);
+    parser->cellres_y = (guint) g_ascii_strtoull (ptr, NULL, 10U);
+    g_free (value);
   }
 
-  if (element->region) {
-    leaf->region = g_strdup (element->region);
-    GST_CAT_LOG (ttmlparse, "Leaf region: %s", leaf->region);
-  } else {
-    GST_CAT_WARNING (ttmlparse, "No region found above leaf element.");
+  GST_CAT_DEBUG (ttmlparse, "cellres_x: %u   cellres_y: %u",
+      parser->cellres_x, parser->cellres_y);
+
+  if ((value = ttml_get_attribute (attributes, "space"))) {
+    if (g_strcmp0 (value, "preserve") == 0) {
+      GST_CAT_DEBUG (ttmlparse, "Preserving whitespace...");
+      parser->doc_whitespace_mode = TTML_WHITESPACE_MODE_PRESERVE;
+    }
+    g_free (value);
   }
 
-  return FALSE;
+  ttml_parse_time_params (&parser->time_params, attributes);
 }
 
 
+/* Handle the start tag of one of the elements that were open at the resume
+ * point by re-entering the corresponding node of the existing body tree. */
 static void
-ttml_resolve_regions (GNode * tree)
+ttml_parser_reenter_element (TtmlParser * parser,
+    const TtmlAttributes * attributes)
 {
-  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
-      ttml_resolve_leaf_region, NULL);
-}
+  guint i = parser->n_reentered++;
 
+  g_array_append_val (parser->open_tags,
+      g_array_index (parser->reentry_tags, TtmlTagRange, i));
 
-typedef struct {
-  GstClockTime start_time;
-  GstClockTime next_transition_time;
-} TrState;
+  if (i == 0) {
+    ttml_parser_parse_root (parser, attributes);
+    return;
+  }
 
+  parser->section = TTML_PARSER_SECTION_BODY;
+  parser->current = g_ptr_array_index (parser->reentry_path, i - 1);
+  if (i == parser->reentry_tags->len - 1)
+    parser->last_child = parser->reentry_last_child;
+  else
+    parser->last_child = NULL;
+}
 
-static gboolean
-ttml_update_transition_time (GNode * node, gpointer data)
+
+static void
+ttml_parser_start_element (void *ctx, const xmlChar * localname,
+    const xmlChar * prefix, const xmlChar * uri, int n_namespaces,
+    const xmlChar ** namespaces, int n_attributes, int n_defaulted,
+    const xmlChar ** attribute_values)
 {
-  TtmlElement *element = node->data;
-  TrState *state = (TrState *)data;
-
-  if ((element->begin < state->next_transition_time)
-      && (element->begin > state->start_time)) {
-    state->next_transition_time = element->begin;
-    GST_CAT_LOG (ttmlparse,
-        "Updating next transition time to element begin time (%"
-        GST_TIME_FORMAT ")", GST_TIME_ARGS (state->next_transition_time));
-    return FALSE;
+  TtmlParser *parser = (TtmlParser *) ctx;
+  const gchar *name = (const gchar *) localname;
+  TtmlAttributes attributes = { attribute_values, n_attributes };
+  TtmlElement *element;
+
+  ttml_parser_flush_text (parser);
+  ++parser->depth;
+
+  if (parser->skip_depth)
+    return;
+
+  if (parser->n_reentered < parser->reentry_tags->len) {
+    ttml_parser_reenter_element (parser, &attributes);
+    return;
   }
 
-  if ((element->end < state->next_transition_time)
-      && (element->end > state->start_time)) {
-    state->next_transition_time = element->end;
-    GST_CAT_LOG (ttmlparse,
-        "Updating next transition time to element end time (%"
-        GST_TIME_FORMAT ")", GST_TIME_ARGS (state->next_transition_time));
+  if (parser->limits.max_depth > 0
+      && parser->depth > parser->limits.max_depth) {
+    ttml_parser_exceed_limit (parser, TTML_LIMIT_DEPTH);
+    parser->skip_depth = parser->depth;
+    return;
   }
 
-  return FALSE;
+  if (parser->depth == 1) {
+    if (g_strcmp0 (name, "tt") != 0) {
+      GST_CAT_ERROR (ttmlparse, "Root element of document is not tt:tt.");
+      parser->failed = TRUE;
+      xmlStopParser (parser->ctxt);
+      return;
+    }
+    /* Positions reported by libxml2 are only byte offsets within the
+     * document if its input is not being transcoded. */
+    parser->positions_valid = parser->ctxt->input && parser->ctxt->input->buf
+      && !parser->ctxt->input->buf->encoder;
+    parser->resumable = parser->positions_valid;
+    ttml_parser_push_open_tag (parser);
+    ttml_parser_parse_root (parser, &attributes);
+    return;
+  }
+
+  switch (parser->section) {
+    case TTML_PARSER_SECTION_ROOT:
+      if (!parser->seen_head && g_strcmp0 (name, "head") == 0) {
+        parser->seen_head = TRUE;
+        if (ttml_parser_enter_head (parser, prefix))
+          break;
+        parser->section = TTML_PARSER_SECTION_HEAD;
+        return;
+      }
+      if (!parser->body && g_strcmp0 (name, "body") == 0) {
+        element = ttml_parse_element (parser->arena, name, &attributes,
+            &parser->time_params);
+        parser->body = parser->current =
+          ttml_arena_node_new (parser->arena, element);
+        parser->last_child = NULL;
+        parser->section = TTML_PARSER_SECTION_BODY;
+        ttml_parser_push_open_tag (parser);
+        return;
+      }
+      break;
+
+    case TTML_PARSER_SECTION_HEAD:
+      if (g_strcmp0 (name, "styling") == 0) {
+        parser->section = TTML_PARSER_SECTION_STYLING;
+        return;
+      }
+      if (g_strcmp0 (name, "layout") == 0) {
+        parser->section = TTML_PARSER_SECTION_LAYOUT;
+        return;
+      }
+      break;
+
+    case TTML_PARSER_SECTION_STYLING:
+      /* Store style and region elements for future reference; their children
+       * are not needed. */
+      if (g_strcmp0 (name, "style") == 0
+          && (element = ttml_parse_element (parser->head->arena, name,
+                  &attributes, &parser->time_params)))
+        ttml_store_unique_element (parser->head->styles_table, element);
+      break;
+
+    case TTML_PARSER_SECTION_LAYOUT:
+      if (g_strcmp0 (name, "region") != 0)
+        break;
+      /* A head missing some of its regions must not be cached. */
+      if (parser->limits.max_regions > 0
+          && g_hash_table_size (parser->head->regions_table)
+          >= parser->limits.max_regions) {
+        ttml_parser_exceed_limit (parser, TTML_LIMIT_REGIONS);
+        parser->cache_head = FALSE;
+        break;
+      }
+      if ((element = ttml_parse_element (parser->head->arena, name,
+                  &attributes, &parser->time_params)))
+        ttml_store_unique_element (parser->head->regions_table, element);
+      break;
+
+    case TTML_PARSER_SECTION_BODY:
+      if (ttml_parser_may_add_element (parser)
+          && (element = ttml_parse_element (parser->arena, name, &attributes,
+                  &parser->time_params))) {
+        GNode *node = ttml_arena_node_new (parser->arena, element);
+        ttml_parser_append_node (parser, node);
+        ++parser->n_elements;
+        parser->current = node;
+        parser->last_child = NULL;
+        ttml_parser_push_open_tag (parser);
+        return;
+      }
+      break;
+  }
+
+  /* Skip this element and all of its descendants. */
+  GST_CAT_LOG (ttmlparse, "Skipping element %s", name);
+  parser->skip_depth = parser->depth;
 }
 
 
-/* Return details about the next transition after @time. */
-static GstClockTime
-ttml_find_next_transition (GList * trees, GstClockTime time)
+static void
+ttml_parser_end_element (void *ctx, const xmlChar * localname,
+    const xmlChar * prefix, const xmlChar * uri)
 {
-  TrState state;
-  state.start_time = time;
-  state.next_transition_time = GST_CLOCK_TIME_NONE;
+  TtmlParser *parser = (TtmlParser *) ctx;
+
+  ttml_parser_flush_text (parser);
 
-  for (trees = g_list_first (trees); trees; trees = trees->next) {
-    GNode *tree = (GNode *)trees->data;
-    g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_ALL, -1,
-        ttml_update_transition_time, &state);
+  if (parser->skip_depth) {
+    if (parser->depth == parser->skip_depth)
+      parser->skip_depth = 0;
+    --parser->depth;
+    return;
   }
 
-  GST_CAT_LOG (ttmlparse, "Next transition is at %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (state.next_transition_time));
+  switch (parser->section) {
+    case TTML_PARSER_SECTION_BODY:
+      parser->last_child = parser->current;
+      parser->current = parser->current->parent;
+      g_array_set_size (parser->open_tags, parser->open_tags->len - 1);
+      if (parser->current)
+        ttml_parser_add_resume_point (parser);
+      else
+        parser->section = TTML_PARSER_SECTION_ROOT;
+      break;
+
+    case TTML_PARSER_SECTION_STYLING:
+    case TTML_PARSER_SECTION_LAYOUT:
+      parser->section = TTML_PARSER_SECTION_HEAD;
+      break;
+
+    case TTML_PARSER_SECTION_HEAD:
+      parser->section = TTML_PARSER_SECTION_ROOT;
+      ttml_parser_leave_head (parser);
+      break;
+
+    case TTML_PARSER_SECTION_ROOT:
+      /* End of the root element; anything that follows belongs to the next
+       * document. */
+      parser->complete = TRUE;
+      parser->doc_end = (glong) ttml_parser_position (parser);
+      xmlStopParser (parser->ctxt);
+      break;
+  }
 
-  return state.next_transition_time;
+  --parser->depth;
 }
 
 
-/* Remove nodes from tree that are not visible at @time. */
-static GNode *
-ttml_remove_nodes_by_time (GNode * node, GstClockTime time)
+static void
+ttml_parser_characters (void *ctx, const xmlChar * ch, int len)
 {
-  GNode *child, *next_child;
-  TtmlElement *element;
-  element = node->data;
+  TtmlParser *parser = (TtmlParser *) ctx;
 
-  child = node->children;
-  next_child = child ? child->next : NULL;
-  while (child) {
-    ttml_remove_nodes_by_time (child, time);
-    child = next_child;
-    next_child = child ? child->next : NULL;
-  }
+  if (parser->section == TTML_PARSER_SECTION_BODY && !parser->skip_depth
+      && !parser->truncated)
+    g_string_append_len (parser->text, (const gchar *) ch, len);
+}
 
-  if (!node->children && ((element->begin > time) || (element->end <= time))) {
-    g_node_destroy (node);
-    node = NULL;
+
+static xmlParserCtxtPtr
+ttml_parser_create_context (TtmlParser * parser)
+{
+  xmlParserCtxtPtr ctxt;
+  xmlSAXHandler sax;
+
+  memset (&sax, 0, sizeof (sax));
+  sax.initialized = XML_SAX2_MAGIC;
+  sax.startElementNs = ttml_parser_start_element;
+  sax.endElementNs = ttml_parser_end_element;
+  sax.characters = ttml_parser_characters;
+  sax.ignorableWhitespace = ttml_parser_characters;
+
+  ctxt = xmlCreatePushParserCtxt (&sax, parser, NULL, 0, "any_doc_name");
+  if (!ctxt) {
+    GST_CAT_ERROR (ttmlparse, "Failed to create XML parser.");
+    parser->failed = TRUE;
   }
 
-  return node;
+  return ctxt;
 }
 
 
-/* Return a list of trees containing the elements and their ancestors that are
- * visible at @time. */
-static GList *
-ttml_get_active_elements (GList * element_trees, GstClockTime time)
+static void
+ttml_parser_free_context (TtmlParser * parser)
 {
-  GList *tree;
-  GList *ret = NULL;
+  if (parser->ctxt) {
+    if (parser->ctxt->myDoc)
+      xmlFreeDoc (parser->ctxt->myDoc);
+    xmlFreeParserCtxt (parser->ctxt);
+    parser->ctxt = NULL;
+  }
+}
 
-  for (tree = g_list_first (element_trees); tree; tree = tree->next) {
-    GNode *root = g_node_copy ((GNode *)tree->data);
-    GST_CAT_LOG (ttmlparse, "There are %u nodes in tree.",
-        g_node_n_nodes (root, G_TRAVERSE_ALL));
-    root = ttml_remove_nodes_by_time (root, time);
-    if (root) {
-      GST_CAT_LOG (ttmlparse, "After filtering there are %u nodes in tree.",
-          g_node_n_nodes (root, G_TRAVERSE_ALL));
 
-      ret = g_list_append (ret, root);
-    } else {
-      GST_CAT_LOG (ttmlparse, "All elements have been filtered from tree.");
-    }
-  }
+/* Reset the state of the parse of the current document, ready for libxml2 to
+ * be given the document from its beginning. */
+static void
+ttml_parser_reset_parse_state (TtmlParser * parser)
+{
+  ttml_parser_free_context (parser);
+  parser->complete = FALSE;
+  parser->failed = FALSE;
+  parser->built = FALSE;
+  parser->ctxt = ttml_parser_create_context (parser);
+  parser->doc_end = 0;
+  parser->offset_delta = 0;
+  parser->section = TTML_PARSER_SECTION_ROOT;
+  parser->depth = 0;
+  parser->skip_depth = 0;
+  parser->current = NULL;
+  parser->last_child = NULL;
+  g_string_truncate (parser->text, 0);
+  g_array_set_size (parser->open_tags, 0);
+  g_array_set_size (parser->reentry_tags, 0);
+  g_ptr_array_set_size (parser->reentry_path, 0);
+  parser->n_reentered = 0;
+  parser->matching = FALSE;
+  parser->resumed = FALSE;
+  parser->exceeded = 0;
+  parser->n_elements = 0;
+  parser->truncated = FALSE;
+}
 
-  GST_CAT_DEBUG (ttmlparse, "There are %u trees in returned list.",
-      g_list_length (ret));
-  return ret;
+
+/* Discard everything built from previous documents and prepare to parse a
+ * document from scratch. */
+static void
+ttml_parser_reset (TtmlParser * parser)
+{
+  /* Release the element trees of previous documents in one go. */
+  if (parser->arena)
+    ttml_arena_free (parser->arena);
+  if (parser->build_arena)
+    ttml_arena_free (parser->build_arena);
+  if (parser->head)
+    ttml_head_unref (parser->head);
+
+  parser->arena = ttml_arena_new ();
+  parser->build_arena = ttml_arena_new ();
+  parser->head = NULL;
+  parser->cache_head = FALSE;
+  parser->cellres_x = DEFAULT_CELLRES_X;
+  parser->cellres_y = DEFAULT_CELLRES_Y;
+  ttml_time_params_init (&parser->time_params);
+  parser->doc_whitespace_mode = TTML_WHITESPACE_MODE_DEFAULT;
+  parser->seen_head = FALSE;
+  parser->body = NULL;
+  parser->bytes_fed = 0;
+  parser->output_end = 0;
+  parser->positions_valid = FALSE;
+  parser->resumable = FALSE;
+  g_array_set_size (parser->resume_points, 0);
+  g_array_set_size (parser->resume_tags, 0);
+
+  ttml_parser_reset_parse_state (parser);
 }
 
 
-static GList *
-ttml_create_scenes (GList * region_trees)
+/* Create a parser for a succession of documents. If @head_cache is non-NULL,
+ * the heads of documents are taken from and added to it; it must outlive the
+ * parser. */
+TtmlParser *
+ttml_parser_new (TtmlHeadCache * head_cache)
 {
-  TtmlScene *cur_scene = NULL;
-  GList *output_scenes = NULL;
-  GList *active_elements = NULL;
-  GstClockTime timestamp = 0;
+  TtmlParser *parser;
 
-  while ((timestamp = ttml_find_next_transition (region_trees, timestamp))
-      != GST_CLOCK_TIME_NONE) {
-    GST_CAT_LOG (ttmlparse, "Next transition found at time %" GST_TIME_FORMAT,
-        GST_TIME_ARGS (timestamp));
-    if (cur_scene) {
-      cur_scene->end = timestamp;
-      output_scenes = g_list_append (output_scenes, cur_scene);
-    }
+  GST_DEBUG_CATEGORY_INIT (ttmlparse, "ttmlparse", 0,
+      "TTML parser debug category");
 
-    active_elements = ttml_get_active_elements (region_trees, timestamp);
-    GST_CAT_LOG (ttmlparse, "There will be %u active regions after "
-        "transition", g_list_length (active_elements));
+  parser = g_slice_new0 (TtmlParser);
+  parser->text = g_string_new (NULL);
+  parser->input = g_string_new (NULL);
+  parser->open_tags = g_array_new (FALSE, FALSE, sizeof (TtmlTagRange));
+  parser->resume_points = g_array_new (FALSE, FALSE,
+      sizeof (TtmlResumePoint));
+  parser->resume_tags = g_array_new (FALSE, FALSE, sizeof (TtmlTagRange));
+  parser->reentry_tags = g_array_new (FALSE, FALSE, sizeof (TtmlTagRange));
+  parser->reentry_path = g_ptr_array_new ();
+  parser->head_cache = head_cache;
+  parser->limits.time_budget = GST_CLOCK_TIME_NONE;
+  ttml_parser_reset (parser);
+
+  return parser;
+}
 
-    if (active_elements) {
-      cur_scene = g_slice_new0 (TtmlScene);
-      cur_scene->begin = timestamp;
-      cur_scene->elements = active_elements;
-    } else {
-      cur_scene = NULL;
-    }
-  }
 
-  return output_scenes;
+void
+ttml_parser_free (TtmlParser * parser)
+{
+  ttml_parser_free_context (parser);
+  if (parser->head)
+    ttml_head_unref (parser->head);
+  g_string_free (parser->text, TRUE);
+  g_string_free (parser->input, TRUE);
+  g_array_free (parser->open_tags, TRUE);
+  g_array_free (parser->resume_points, TRUE);
+  g_array_free (parser->resume_tags, TRUE);
+  g_array_free (parser->reentry_tags, TRUE);
+  g_ptr_array_free (parser->reentry_path, TRUE);
+  /* Release the document's element trees in one go. */
+  ttml_arena_free (parser->arena);
+  ttml_arena_free (parser->build_arena);
+  g_slice_free (TtmlParser, parser);
 }
 
 
-/* Handle element whitespace in accordance with section 7.2.3 of the TTML
- * specification. Note that stripping of whitespace at the start and end of
- * line areas can only be done in the renderer once the text from multiple
- * elements has been laid out. */
-static gboolean
-ttml_handle_element_whitespace (GNode * node, gpointer data)
+/* Give libxml2 the next @len bytes of the document from @data, stopping at
+ * the end of the document. Returns the number of bytes consumed. */
+static gsize
+ttml_parser_parse (TtmlParser * parser, const gchar * data, gsize len)
 {
-  TtmlElement *element = node->data;
-  if (element->text
-      && (element->whitespace_mode != TTML_WHITESPACE_MODE_PRESERVE)) {
-    guint space_count = 0;
-    guint textlen;
-    gchar *c;
-    gint i;
-
-    /* Replace linefeeds with spaces. */
-    for (c = element->text; *c > 0; c = g_utf8_next_char (c)) {
-      gchar buf[6] = { 0 };
-      gunichar u = g_utf8_get_char (c);
-      gint nbytes = g_unichar_to_utf8 (u, buf);
-      if (nbytes == 1 && buf[0] == 0xA)
-        *c = ' ';
+  gsize consumed = len;
+
+  while (len > 0 && !parser->complete && !parser->failed) {
+    /* xmlParseChunk takes an int length. */
+    gsize chunk_len = MIN (len, G_MAXINT);
+
+    xmlParseChunk (parser->ctxt, data, (int) chunk_len, 0);
+
+    if (parser->complete) {
+      if (parser->doc_end >= 0 && (gsize) parser->doc_end >= parser->bytes_fed)
+        chunk_len = MIN (chunk_len,
+            (gsize) parser->doc_end - parser->bytes_fed);
+      consumed -= (len - chunk_len);
+    } else if (!parser->ctxt->wellFormed) {
+      GST_CAT_ERROR (ttmlparse, "Failed to parse document.");
+      parser->failed = TRUE;
     }
 
-    /* Compress each run of multiple contiguous spaces into a single space. */
-    textlen = strlen (element->text);
-    for (i = 0; i <= textlen; ++i) {
-      c = element->text + i;
-      if (*c == ' ') {
-        ++space_count;
-      } else {
-        if (space_count > 1) {
-          gchar *new_head = c - space_count + 1;
-          g_strlcpy (new_head, c, textlen);
-          i = new_head - element->text;
-        }
-        space_count = 0;
-      }
-    }
+    parser->bytes_fed += chunk_len;
+    data += chunk_len;
+    len -= chunk_len;
   }
-  return FALSE;
+
+  return consumed;
 }
 
 
+/* Abandon the trees built for previous documents and parse the current
+ * document from its start, beginning with the part of it that has already
+ * been received, which is held in @input. */
 static void
-ttml_handle_whitespace (GNode * tree)
+ttml_parser_restart (TtmlParser * parser)
 {
-  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
-      ttml_handle_element_whitespace, NULL);
+  gsize received = parser->bytes_fed;
+
+  ttml_parser_reset (parser);
+  g_string_truncate (parser->input, received);
+  ttml_parser_parse (parser, parser->input->str, received);
 }
 
 
-/* Store child elements of @node with name @element_name in @table, as long as
- * @table doesn't already contain an element with the same ID. */
+/* Continue parsing the current document, which extends the previous one,
+ * from the resume point at index @index, re-entering the elements that were
+ * open at that point in the body tree of the previous document. */
 static void
-ttml_store_unique_children (xmlNodePtr node, const gchar * element_name,
-    GHashTable * table)
+ttml_parser_resume (TtmlParser * parser, guint index)
 {
-  xmlNodePtr ptr;
+  TtmlResumePoint *point =
+    &g_array_index (parser->resume_points, TtmlResumePoint, index);
+  GString *tags = g_string_new (NULL);
+  GNode *node;
+  guint i;
 
-  for (ptr = node->children; ptr; ptr = ptr->next) {
-    if (xmlStrcmp (ptr->name, (const xmlChar *) element_name) == 0) {
-      TtmlElement *element = ttml_parse_element (ptr);
+  GST_CAT_DEBUG (ttmlparse, "Document extends the previous one; resuming "
+      "parse at byte %" G_GSIZE_FORMAT, point->offset);
 
-      if (element)
-        if (!g_hash_table_contains (table, element->id))
-          g_hash_table_insert (table, (gpointer) (element->id),
-              (gpointer) element);
-    }
+  ttml_parser_reset_parse_state (parser);
+  parser->resumed = TRUE;
+  parser->bytes_fed = point->offset;
+
+  g_array_append_vals (parser->reentry_tags, parser->resume_tags->data,
+      point->n_tags);
+  for (i = 0; i < parser->reentry_tags->len; ++i) {
+    TtmlTagRange *tag = &g_array_index (parser->reentry_tags, TtmlTagRange, i);
+    g_string_append_len (tags, parser->input->str + tag->start,
+        tag->end - tag->start);
+  }
+
+  for (node = point->parent; node; node = node->parent)
+    g_ptr_array_add (parser->reentry_path, node);
+  for (i = 0; i < parser->reentry_path->len / 2; ++i) {
+    guint j = parser->reentry_path->len - 1 - i;
+    node = g_ptr_array_index (parser->reentry_path, i);
+    g_ptr_array_index (parser->reentry_path, i) =
+      g_ptr_array_index (parser->reentry_path, j);
+    g_ptr_array_index (parser->reentry_path, j) = node;
   }
+  parser->reentry_last_child = point->last_child;
+
+  /* Later resume points may not be valid for the new document. */
+  g_array_set_size (parser->resume_points, index + 1);
+
+  parser->offset_delta = (glong) parser->bytes_fed - (glong) tags->len;
+  if (parser->ctxt)
+    xmlParseChunk (parser->ctxt, tags->str, (int) tags->len, 0);
+  g_string_free (tags, TRUE);
 }
 
 
-/* Parse style and region elements from @head and store in their respective
- * hash tables for future reference. */
+/* Called once the first @position bytes of the current document are known
+ * to be identical to those of the previous document, which are held in
+ * @input, and that no more bytes are. Resumes parsing from the last resume
+ * point within those bytes, or parses the document from scratch if there is
+ * none. */
 static void
-ttml_parse_head (xmlNodePtr head, GHashTable * styles_table,
-    GHashTable * regions_table)
+ttml_parser_resume_at (TtmlParser * parser, gsize position)
 {
-  xmlNodePtr node;
+  guint i = parser->resume_points->len;
+  TtmlResumePoint *point = NULL;
+
+  while (i-- > 0) {
+    point = &g_array_index (parser->resume_points, TtmlResumePoint, i);
+    if (point->offset <= position)
+      break;
+    point = NULL;
+  }
 
-  for (node = head->children; node; node = node->next) {
-    if (xmlStrcmp (node->name, (const xmlChar *) "styling") == 0)
-      ttml_store_unique_children (node, "style", styles_table);
-    if (xmlStrcmp (node->name, (const xmlChar *) "layout") == 0)
-      ttml_store_unique_children (node, "region", regions_table);
+  if (!point) {
+    GST_CAT_DEBUG (ttmlparse, "Document does not extend the previous one.");
+    parser->bytes_fed = position;
+    ttml_parser_restart (parser);
+    return;
   }
+
+  /* The rest of the previous document is no longer needed. */
+  g_string_truncate (parser->input, position);
+  ttml_parser_resume (parser, i);
+  ttml_parser_parse (parser, parser->input->str + point->offset,
+      position - point->offset);
 }
 
 
-/* Remove nodes that do not belong to @region, or are not an ancestor of a node
- * belonging to @region. */
-static GNode *
-ttml_remove_nodes_by_region (GNode * node, const gchar *region)
+/* Compare the @len bytes at @data, from the start of a new document, with
+ * the previous document, up to its last resume point. Returns the number of
+ * bytes consumed. */
+static gsize
+ttml_parser_match (TtmlParser * parser, const gchar * data, gsize len)
 {
-  GNode *child, *next_child;
-  TtmlElement *element;
-  element = node->data;
-
-  child = node->children;
-  next_child = child ? child->next : NULL;
-  while (child) {
-    ttml_remove_nodes_by_region (child, region);
-    child = next_child;
-    next_child = child ? child->next : NULL;
+  TtmlResumePoint *last = &g_array_index (parser->resume_points,
+      TtmlResumePoint, parser->resume_points->len - 1);
+  const gchar *prev = parser->input->str + parser->bytes_fed;
+  gsize n = MIN (len, last->offset - parser->bytes_fed);
+  gsize i = n;
+
+  if (memcmp (data, prev, n) != 0) {
+    for (i = 0; data[i] == prev[i]; ++i);
   }
 
-  if ((element->type == TTML_ELEMENT_TYPE_ANON_SPAN
-        || element->type != TTML_ELEMENT_TYPE_BR)
-      && element->region && (g_strcmp0 (element->region, region) != 0)) {
-    ttml_delete_element (element);
-    g_node_destroy (node);
-    return NULL;
-  }
-  if (element->type != TTML_ELEMENT_TYPE_ANON_SPAN
-        && element->type != TTML_ELEMENT_TYPE_BR && !node->children) {
-    ttml_delete_element (element);
-    g_node_destroy (node);
-    return NULL;
+  if (i < n || parser->bytes_fed + n == last->offset) {
+    parser->matching = FALSE;
+    ttml_parser_resume_at (parser, parser->bytes_fed + i);
+  } else {
+    parser->bytes_fed += n;
   }
 
-  return node;
+  return i;
 }
 
 
-static TtmlElement *
-ttml_copy_element (const TtmlElement * element)
-{
-  TtmlElement *ret = g_slice_new0 (TtmlElement);
-
-  ret->type = element->type;
-  if (element->id)
-    ret->id = g_strdup (element->id);
-  if (element->styles)
-    ret->styles  = g_strdupv (element->styles);
-  if (element->region)
-    ret->region = g_strdup (element->region);
-  ret->begin = element->begin;
-  ret->end = element->end;
-  if (element->style_set)
-    ret->style_set = ttml_copy_style_set (element->style_set);
-  if (element->text)
-    ret->text = g_strdup (element->text);
-  ret->text_index = element->text_index;
-
-  return ret;
+/* Prepare @parser to parse the document following the one it has just
+ * parsed. If that document was parsed successfully, the new document will be
+ * checked for being an extension of it. */
+void
+ttml_parser_start_document (TtmlParser * parser)
+{
+  parser->exceeded = 0;
+  parser->n_elements = 0;
+  parser->truncated = FALSE;
+  parser->time_used = 0;
+
+  if (parser->built && parser->resumable && parser->resume_points->len > 0) {
+    parser->matching = TRUE;
+    parser->complete = FALSE;
+    parser->built = FALSE;
+    parser->bytes_fed = 0;
+  } else {
+    ttml_parser_reset (parser);
+    g_string_truncate (parser->input, 0);
+  }
 }
 
 
-static gpointer
-ttml_copy_tree_element (gconstpointer src, gpointer data)
+/* Set the limits on the resources used to process each document, which
+ * apply from the current document onwards. A document that exceeds a limit
+ * is processed only in part: nesting beyond the maximum depth and regions
+ * beyond the maximum number are ignored, the rest of the body is ignored
+ * once the maximum number of elements is reached or the time has run out,
+ * and no more scenes are built once the maximum number of scenes is reached
+ * or the time has run out. */
+void
+ttml_parser_set_limits (TtmlParser * parser, const TtmlLimits * limits)
 {
-  return ttml_copy_element ((TtmlElement *)src);
+  parser->limits = *limits;
 }
 
 
-/* Split the body tree into a set of trees, each containing only the elements
- * belonging to a single region. Returns a list of trees, one per region, each
- * with the corresponding region element at its root. */
-static GList *
-ttml_split_body_by_region (GNode * body, GHashTable * regions)
+/* Returns the limits exceeded by the current document, which are complete
+ * only once all of its scenes have been built. */
+TtmlLimitFlags
+ttml_parser_get_exceeded_limits (TtmlParser * parser)
 {
-  GHashTableIter iter;
-  gpointer key, value;
-  GList *ret = NULL;
+  return parser->exceeded;
+}
 
-  g_hash_table_iter_init (&iter, regions);
-  while (g_hash_table_iter_next (&iter, &key, &value)) {
-    gchar *region_name = (gchar *)key;
-    TtmlElement *region = (TtmlElement *)value;
-    GNode *region_node = g_node_new (ttml_copy_element (region));
-    GNode *body_copy = g_node_copy_deep (body, ttml_copy_tree_element, NULL);
-
-    GST_CAT_DEBUG (ttmlparse, "Creating tree for region %s", region_name);
-    GST_CAT_LOG (ttmlparse, "Copy of body has %u nodes.",
-        g_node_n_nodes (body_copy, G_TRAVERSE_ALL));
-
-    body_copy = ttml_remove_nodes_by_region (body_copy, region_name);
-    if (body_copy) {
-      GST_CAT_LOG (ttmlparse, "Copy of body now has %u nodes.",
-          g_node_n_nodes (body_copy, G_TRAVERSE_ALL));
-
-      /* Reparent tree to region node. */
-      g_node_prepend (region_node, body_copy);
-    }
-    GST_CAT_LOG (ttmlparse, "Final tree has %u nodes.",
-        g_node_n_nodes (region_node, G_TRAVERSE_ALL));
-    ret = g_list_append (ret, region_node);
-  }
 
-  GST_CAT_DEBUG (ttmlparse, "Returning %u trees.", g_list_length (ret));
-  return ret;
+/* Set whether the styling and scenes of documents are to be processed
+ * concurrently, using a thread pool shared by all parsers. The scenes built
+ * are the same either way. */
+void
+ttml_parser_set_parallel (TtmlParser * parser, gboolean parallel)
+{
+  parser->parallel = parallel;
 }
 
 
-static guint
-ttml_add_text_to_buffer (GstBuffer * buf, const gchar * text)
+/* Parse the next @len bytes of the document from @data. Returns the number of
+ * bytes consumed, which is less than @len only if the end of the document
+ * was reached before the end of @data. */
+gsize
+ttml_parser_feed (TtmlParser * parser, const gchar * data, gsize len)
 {
-  GstMemory *mem;
-  GstMapInfo map;
-  guint ret;
+  gsize matched = 0, consumed = 0;
 
-  mem = gst_allocator_alloc (NULL, strlen (text) + 1, NULL);
-  if (!gst_memory_map (mem, &map, GST_MAP_WRITE))
-    GST_CAT_ERROR (ttmlparse, "Failed to map memory.");
+  if (parser->complete || parser->failed)
+    return len;
 
-  g_strlcpy ((gchar *)map.data, text, map.size);
-  GST_CAT_DEBUG (ttmlparse, "Inserted following text into buffer: %s",
-      (gchar *)map.data);
-  gst_memory_unmap (mem, &map);
+  ttml_parser_begin_work (parser);
 
-  ret = gst_buffer_n_memory (buf);
-  gst_buffer_insert_memory (buf, -1, mem);
-  return ret;
+  if (parser->matching) {
+    matched = ttml_parser_match (parser, data, len);
+    data += matched;
+    len -= matched;
+  }
+
+  if (len > 0) {
+    g_string_append_len (parser->input, data, len);
+    consumed = ttml_parser_parse (parser, data, len);
+    if (parser->complete)
+      g_string_truncate (parser->input, parser->bytes_fed);
+  }
+
+  ttml_parser_end_work (parser);
+  return matched + consumed;
 }
 
 
-/* Create a GstSubtitleElement from @element, add it to @block, and insert its
- * associated text in @buf. */
-static void
-ttml_add_element (GstSubtitleBlock * block, TtmlElement * element,
-    GstBuffer * buf, guint cellres_x, guint cellres_y)
+/* Returns TRUE once the end of the document's root element has been parsed. */
+gboolean
+ttml_parser_is_complete (TtmlParser * parser)
 {
-  GstSubtitleStyleSet *element_style = NULL;
-  guint buffer_index;
-  GstSubtitleElement *sub_element = NULL;
+  return parser->complete;
+}
 
-  element_style = gst_subtitle_style_set_new ();
-  ttml_update_style_set (element_style, element->style_set,
-      cellres_x, cellres_y);
-  GST_CAT_DEBUG (ttmlparse, "Creating element with text index %u",
-      element->text_index);
 
-  if (element->type != TTML_ELEMENT_TYPE_BR)
-    buffer_index = ttml_add_text_to_buffer (buf, element->text);
-  else
-    buffer_index = ttml_add_text_to_buffer (buf, "\n");
+/* Returns TRUE if the document could not be parsed. */
+gboolean
+ttml_parser_has_failed (TtmlParser * parser)
+{
+  return parser->failed;
+}
 
-  GST_CAT_DEBUG (ttmlparse, "Inserted text at index %u in GstBuffer.",
-      buffer_index);
-  sub_element = gst_subtitle_element_new (element_style, buffer_index,
-      (element->whitespace_mode != TTML_WHITESPACE_MODE_PRESERVE));
 
-  gst_subtitle_block_add_element (block, sub_element);
-  GST_CAT_DEBUG (ttmlparse, "Added element to block; there are now %u"
-      " elements in the block.",
-      gst_subtitle_block_get_element_count (block));
+/* Returns TRUE if the document extends its predecessor, in which case only
+ * the scenes affected by its new content are built. */
+gboolean
+ttml_parser_has_resumed (TtmlParser * parser)
+{
+  return parser->resumed;
 }
 
 
-/* Return TRUE if @color is totally transparent. */
 static gboolean
-ttml_color_is_transparent (const GstSubtitleColor * color)
+ttml_find_earliest_begin (GNode * node, gpointer data)
 {
-  if (!color)
-    return FALSE;
-  else
-    return (color->a == 0);
+  GstClockTime *earliest = data;
+  TtmlElement *leaf = node->data;
+
+  if (GST_CLOCK_TIME_IS_VALID (leaf->begin)
+      && (!GST_CLOCK_TIME_IS_VALID (*earliest) || leaf->begin < *earliest))
+    *earliest = leaf->begin;
+  return FALSE;
 }
 
 
-/* Blend @color2 over @color1 and return the resulting color. This is currently
- * a dummy implementation that simply returns color2 as long as it's
- * not fully transparent. */
-/* TODO: Implement actual blending of colors. */
-static GstSubtitleColor
-ttml_blend_colors (GstSubtitleColor color1, GstSubtitleColor color2)
+/* Prepare the content added to the body after the resume point in the same
+ * way as a whole body is prepared in ttml_parser_build_scenes(), and set
+ * @window to the period affected by that content. Returns FALSE if no timed
+ * content was added.
+ *
+ * The window runs from the beginning of the new content onwards rather than
+ * ending with it, so that the scenes following the new content, which
+ * replace those previously output, are complete. Since new content is
+ * usually appended in time order, few existing elements fall within it.
+ * The window begins no earlier than the end of the scenes already output,
+ * so that the scenes output for the new content never overlap those output
+ * for the previous document; any part of the new content that begins
+ * earlier is shown only from that point. */
+static gboolean
+ttml_parser_prepare_new_content (TtmlParser * parser,
+    TtmlTimeWindow * window)
 {
-  if (ttml_color_is_transparent (&color2))
-    return color1;
-  else
-    return color2;
+  guint i = parser->reentry_path->len;
+
+  window->begin = GST_CLOCK_TIME_NONE;
+  window->end = GST_CLOCK_TIME_NONE;
+
+  /* New content follows the last existing child of each element that was
+   * open at the resume point. */
+  while (i-- > 0) {
+    GNode *node = (i == parser->reentry_path->len - 1) ?
+      parser->reentry_last_child : g_ptr_array_index (parser->reentry_path,
+        i + 1);
+
+    for (node = node->next; node; node = node->next) {
+      ttml_inherit_whitespace_mode (node, parser->doc_whitespace_mode);
+      ttml_handle_whitespace (node);
+      ttml_resolve_timings (node);
+      ttml_resolve_regions (node);
+      g_node_traverse (node, G_PRE_ORDER, G_TRAVERSE_LEAVES, -1,
+          ttml_find_earliest_begin, &window->begin);
+    }
+  }
+
+  if (!GST_CLOCK_TIME_IS_VALID (window->begin))
+    return FALSE;
+
+  window->begin = MAX (window->begin, parser->output_end);
+  return TRUE;
 }
 
 
-/* Create the subtitle region and its child blocks and elements for @tree,
- * inserting element text in @buf. Ownership of created region is transferred
- * to caller. */
-static GstSubtitleRegion *
-ttml_create_subtitle_region (GNode * tree, GstBuffer * buf, guint cellres_x,
-    guint cellres_y)
+/* Yields the scenes of a parsed document on demand, in time order, as
+ * GstBuffers. The element trees, styling and activity events of the document
+ * are prepared up front, but each scene's metadata is created only when the
+ * scene is requested, so that the first scene of a long document is
+ * available almost at once and the scenes need not all be held in memory.
+ * The iterator refers to the trees built by @parser, which must not be given
+ * another document until the iterator has been freed; if @owns_parser is
+ * set, the iterator frees @parser itself.
+ *
+ * In parallel mode, the metadata of a batch of scenes is created at once by
+ * the shared thread pool; @ready holds the scenes of the batch not yet
+ * returned, in time order.
+ *
+ * @object_cache holds the subtitle objects created for earlier scenes, so
+ * that those unchanged in a later scene can be shared with it. */
+struct _TtmlSceneIter {
+  TtmlParser *parser;
+  gboolean owns_parser;
+  GList *region_trees;
+  TtmlNodeTable *node_table;
+  TtmlObjectCache *object_cache;
+  TtmlSceneSweep sweep;
+  guint n_scenes;
+  gboolean clip;
+  TtmlTimeWindow window;
+  gboolean parallel;
+  guint batch_size;
+  GQueue ready;
+};
+
+/* The number of scenes per thread in each batch built in parallel mode. */
+#define TTML_SCENES_PER_THREAD 4
+
+
+/* Prepare to build the scenes for a parsed document. If the document extends
+ * the previous one, only the scenes affected by the new content are built.
+ * Returns NULL if there are no scenes to build. */
+static TtmlSceneIter *
+ttml_parser_build_scenes (TtmlParser * parser, GstClockTime begin,
+    GstClockTime duration)
 {
-  GstSubtitleRegion *region = NULL;
-  GstSubtitleStyleSet *region_style;
-  GstSubtitleColor block_color;
-  TtmlElement *element;
-  GNode *node;
+  GNode *body_tree = parser->body;
+  TtmlSceneIter *iter;
+  TtmlTimeWindow window = { 0, GST_CLOCK_TIME_NONE };
 
-  element = tree->data;
-  g_assert (element->type == TTML_ELEMENT_TYPE_REGION);
+  GST_CAT_LOG (ttmlparse, "body_tree tree contains %u nodes.",
+      g_node_n_nodes (body_tree, G_TRAVERSE_ALL));
+  GST_CAT_LOG (ttmlparse, "body_tree tree height is %u",
+      g_node_max_height (body_tree));
 
-  region_style = gst_subtitle_style_set_new ();
-  ttml_update_style_set (region_style, element->style_set, cellres_x,
-      cellres_y);
-  region = gst_subtitle_region_new (region_style);
+  parser->built = TRUE;
 
-  node = tree->children;
-  if (!node)
-    return region;
+  if (parser->resumed) {
+    if (!ttml_parser_prepare_new_content (parser, &window)) {
+      GST_CAT_DEBUG (ttmlparse, "No new timed content in document.");
+      return NULL;
+    }
+    GST_CAT_DEBUG (ttmlparse, "Building scenes from %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (window.begin));
+  } else {
+    ttml_inherit_whitespace_mode (body_tree, parser->doc_whitespace_mode);
+    ttml_handle_whitespace (body_tree);
+    ttml_resolve_timings (body_tree);
+    ttml_resolve_regions (body_tree);
+  }
+
+  /* Discard the trees built for the previous document's scenes. */
+  ttml_arena_free (parser->build_arena);
+  parser->build_arena = ttml_arena_new ();
+
+  iter = g_slice_new0 (TtmlSceneIter);
+  iter->parser = parser;
+  iter->clip = parser->resumed;
+  iter->window = window;
+  iter->parallel = parser->parallel;
+  iter->batch_size = TTML_SCENES_PER_THREAD * g_get_num_processors ();
+  g_queue_init (&iter->ready);
+
+  iter->region_trees = ttml_split_body_by_region (body_tree,
+      parser->head->regions_table, parser->build_arena,
+      parser->resumed ? &window : NULL);
+  ttml_resolve_element_styles (iter->region_trees, parser->build_arena,
+      parser->head->styles_table, parser->parallel);
+  ttml_assign_region_times (iter->region_trees, begin, duration);
+  iter->node_table = ttml_node_table_new (iter->region_trees);
+  iter->object_cache = ttml_object_cache_new (iter->node_table->nodes->len);
+  ttml_scene_sweep_init (&iter->sweep, iter->node_table);
+  GST_CAT_LOG (ttmlparse, "There are up to %u scenes in all.",
+      iter->sweep.transitions->len);
+
+  return iter;
+}
 
-  g_assert (node->next == NULL);
-  element = node->data;
-  g_assert (element->type == TTML_ELEMENT_TYPE_BODY);
-  block_color = ttml_parse_colorstring (element->style_set->background_color);
 
-  for (node = node->children; node; node = node->next) {
-    GNode *p_node;
-    GstSubtitleColor div_color;
+/* Returns the next scene of the document, without its metadata, or NULL
+ * once all scenes have been returned or the parser's scene or time limit
+ * has been reached. */
+static TtmlScene *
+ttml_scene_iter_next_scene (TtmlSceneIter * iter)
+{
+  TtmlParser *parser = iter->parser;
+  TtmlScene *scene;
 
-    element = node->data;
-    g_assert (element->type == TTML_ELEMENT_TYPE_DIV);
-    div_color = ttml_parse_colorstring (element->style_set->background_color);
-    block_color = ttml_blend_colors (block_color, div_color);
-
-    for (p_node = node->children; p_node; p_node = p_node->next) {
-      GstSubtitleBlock *block = NULL;
-      GstSubtitleStyleSet *block_style;
-      GNode *content_node;
-      GstSubtitleColor p_color;
-
-      element = p_node->data;
-      g_assert (element->type == TTML_ELEMENT_TYPE_P);
-      p_color = ttml_parse_colorstring (element->style_set->background_color);
-      block_color = ttml_blend_colors (block_color, p_color);
-
-      block_style = gst_subtitle_style_set_new ();
-      ttml_update_style_set (block_style, element->style_set, cellres_x,
-          cellres_y);
-      block_style->background_color = block_color;
-      block = gst_subtitle_block_new (block_style);
-      g_assert (block != NULL);
-
-      for (content_node = p_node->children; content_node;
-          content_node = content_node->next) {
-        GNode *anon_node;
-        element = content_node->data;
-
-        if (element->type == TTML_ELEMENT_TYPE_BR
-          || element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
-          ttml_add_element (block, element, buf, cellres_x, cellres_y);
-        } else if (element->type == TTML_ELEMENT_TYPE_SPAN) {
-          /* Loop through anon-span children of this span. */
-          for (anon_node = content_node->children; anon_node;
-              anon_node = anon_node->next) {
-            element = anon_node->data;
-
-            if (element->type == TTML_ELEMENT_TYPE_BR
-                || element->type == TTML_ELEMENT_TYPE_ANON_SPAN) {
-              ttml_add_element (block, element, buf, cellres_x, cellres_y);
-            } else {
-              GST_CAT_ERROR (ttmlparse,
-                  "Element type not allowed at this level of document.");
-            }
-          }
-        } else {
-          GST_CAT_ERROR (ttmlparse,
-              "Element type not allowed at this level of document.");
-        }
-      }
+  if ((parser->exceeded & TTML_LIMIT_SCENES)
+      || ttml_parser_out_of_time (parser))
+    return NULL;
 
-      gst_subtitle_region_add_block (region, block);
-      GST_CAT_DEBUG (ttmlparse, "Added block to region; there are now %u blocks"
-          " in the region.", gst_subtitle_region_get_block_count (region));
-    }
+  while ((scene = ttml_scene_sweep_next (&iter->sweep))) {
+    if (!iter->clip || ttml_clip_scene (scene, &iter->window))
+      break;
+    ttml_delete_scene (scene);
   }
 
-  return region;
+  if (scene && parser->limits.max_scenes > 0
+      && iter->n_scenes >= parser->limits.max_scenes) {
+    ttml_parser_exceed_limit (parser, TTML_LIMIT_SCENES);
+    ttml_delete_scene (scene);
+    return NULL;
+  }
+
+  if (scene)
+    ++iter->n_scenes;
+  return scene;
 }
 
 
-/* For each scene, create data objects to describe the layout and styling of
- * that scene and attach it as metadata to the GstBuffer that will be used to
- * carry that scene's text. */
+/* The creation of the metadata of a single scene in parallel mode. */
+typedef struct {
+  TtmlSceneIter *iter;
+  TtmlScene *scene;
+} TtmlSceneTask;
+
+
 static void
-ttml_attach_scene_metadata (GList * scenes, guint cellres_x, guint cellres_y)
+ttml_scene_iter_attach_metadata (gpointer data, gpointer user_data)
 {
-  GList *scene_entry;
+  TtmlSceneTask *task = data;
 
-  for (scene_entry = g_list_first (scenes); scene_entry;
-      scene_entry = scene_entry->next) {
-    TtmlScene * scene = scene_entry->data;
-    GList *region_tree;
-    GPtrArray *regions = g_ptr_array_new_with_free_func (
-      (GDestroyNotify) gst_subtitle_region_unref);
+  ttml_attach_scene_metadata (task->scene, task->iter->node_table,
+      task->iter->object_cache, task->iter->parser->cellres_x,
+      task->iter->parser->cellres_y);
+}
 
-    scene->buf = gst_buffer_new ();
-    GST_BUFFER_PTS (scene->buf) = scene->begin;
-    GST_BUFFER_DURATION (scene->buf) = (scene->end - scene->begin);
 
-    for (region_tree = g_list_first (scene->elements); region_tree;
-        region_tree = region_tree->next) {
-      GNode *tree = (GNode *)region_tree->data;
-      GstSubtitleRegion *region;
+/* Fill @ready with the next batch of scenes, creating their metadata
+ * concurrently. The scenes of a batch are returned in time order, whatever
+ * the order in which their metadata is created. */
+static void
+ttml_scene_iter_fill_batch (TtmlSceneIter * iter)
+{
+  TtmlSceneTask *tasks = g_new (TtmlSceneTask, iter->batch_size);
+  gpointer *items = g_new (gpointer, iter->batch_size);
+  guint n_scenes = 0, i;
+
+  while (n_scenes < iter->batch_size
+      && (tasks[n_scenes].scene = ttml_scene_iter_next_scene (iter))) {
+    tasks[n_scenes].iter = iter;
+    items[n_scenes] = &tasks[n_scenes];
+    ++n_scenes;
+  }
 
-      region = ttml_create_subtitle_region (tree, scene->buf, cellres_x,
-          cellres_y);
-      g_ptr_array_add (regions, region);
-    }
+  ttml_run_parallel (ttml_scene_iter_attach_metadata, items, n_scenes, TRUE);
 
-    gst_buffer_add_subtitle_meta (scene->buf, regions);
-  }
+  for (i = 0; i < n_scenes; ++i)
+    g_queue_push_tail (&iter->ready, tasks[i].scene);
+  g_free (items);
+  g_free (tasks);
 }
 
 
-GList * create_buffer_list (GList * scenes)
+/* Returns the buffer carrying the next scene of the document, or NULL once
+ * all scenes have been returned. */
+GstBuffer *
+ttml_scene_iter_next (TtmlSceneIter * iter)
 {
-  GList *ret = NULL;
-
-  while (scenes) {
-    TtmlScene *scene = scenes->data;
-    ret = g_list_prepend (ret, gst_buffer_ref (scene->buf));
-    scenes = scenes->next;
+  TtmlScene *scene;
+  GstBuffer *ret;
+
+  ttml_parser_begin_work (iter->parser);
+
+  if (iter->parallel) {
+    if (g_queue_is_empty (&iter->ready))
+      ttml_scene_iter_fill_batch (iter);
+    scene = g_queue_pop_head (&iter->ready);
+  } else if ((scene = ttml_scene_iter_next_scene (iter))) {
+    ttml_attach_scene_metadata (scene, iter->node_table, iter->object_cache,
+        iter->parser->cellres_x, iter->parser->cellres_y);
   }
-  return g_list_reverse (ret);
-}
 
+  ttml_parser_end_work (iter->parser);
 
-static gboolean
-ttml_free_node_data (GNode * node, gpointer data)
-{
-  TtmlElement *element;
-  element = node->data;
-  ttml_delete_element (element);
-  return FALSE;
+  if (!scene)
+    return NULL;
+
+  if (GST_CLOCK_TIME_IS_VALID (scene->end))
+    iter->parser->output_end = MAX (iter->parser->output_end, scene->end);
+  ret = gst_buffer_ref (scene->buf);
+  ttml_delete_scene (scene);
+
+  return ret;
 }
 
 
-static void
-ttml_delete_tree (GNode * tree)
+void
+ttml_scene_iter_free (TtmlSceneIter * iter)
 {
-  g_node_traverse (tree, G_PRE_ORDER, G_TRAVERSE_ALL, -1, ttml_free_node_data,
-      NULL);
-  g_node_destroy (tree);
+  g_queue_foreach (&iter->ready, (GFunc) ttml_delete_scene, NULL);
+  g_queue_clear (&iter->ready);
+  ttml_scene_sweep_clear (&iter->sweep);
+  ttml_object_cache_free (iter->object_cache);
+  ttml_node_table_free (iter->node_table);
+  g_list_free (iter->region_trees);
+  if (iter->owns_parser)
+    ttml_parser_free (iter->parser);
+  g_slice_free (TtmlSceneIter, iter);
 }
 
 
-static void
-ttml_delete_scene (TtmlScene * scene)
+/* Returns all remaining scenes of @iter as a list of GstBuffers, and frees
+ * @iter. */
+static GList *
+ttml_scene_iter_collect (TtmlSceneIter * iter)
 {
-  if (scene->elements)
-    g_list_free_full (scene->elements, (GDestroyNotify) g_node_destroy);
-  if (scene->buf)
-    gst_buffer_unref (scene->buf);
-  g_slice_free (TtmlScene, scene);
+  GList *ret = NULL;
+  GstBuffer *buf;
+
+  if (!iter)
+    return NULL;
+
+  while ((buf = ttml_scene_iter_next (iter)))
+    ret = g_list_prepend (ret, buf);
+  ttml_scene_iter_free (iter);
+
+  GST_CAT_LOG (ttmlparse, "There are %u scenes in all.", g_list_length (ret));
+  return g_list_reverse (ret);
 }
 
 
-static void
-ttml_assign_region_times (GList *region_trees, GstClockTime doc_begin,
-    GstClockTime doc_duration)
+/* Signal the end of the input to @parser and return an iterator over the
+ * scenes of the parsed document, or NULL if the document could not be parsed
+ * or has no scenes. @begin and @duration give the timing of the document as
+ * a whole, if known. */
+TtmlSceneIter *
+ttml_parser_finish_iter (TtmlParser * parser, GstClockTime begin,
+    GstClockTime duration)
 {
-  GList *tree;
+  TtmlSceneIter *iter = NULL;
 
-  for (tree = g_list_first (region_trees); tree; tree = tree->next) {
-    GNode *region_node = (GNode *)tree->data;
-    TtmlElement *region = (TtmlElement *)region_node->data;
-    gboolean always_visible = !region->style_set->show_background
-      || (g_strcmp0 (region->style_set->show_background, "always") == 0);
+  ttml_parser_begin_work (parser);
 
-    GstSubtitleColor region_color = { 0, 0, 0, 0 };
-    if (region->style_set->background_color)
-      region_color =
-        ttml_parse_colorstring (region->style_set->background_color);
+  /* The document ended before reaching the previous one's last resume
+   * point. */
+  if (parser->matching) {
+    parser->matching = FALSE;
+    ttml_parser_resume_at (parser, parser->bytes_fed);
+  }
 
-    if (always_visible && !ttml_color_is_transparent (&region_color)) {
-      GST_CAT_DEBUG (ttmlparse, "Assigning times to region.");
-      /* If the input XML document was not encapsulated in a container that
-       * provides timing information for the document as a whole (i.e., its
-       * PTS and duration) and the region background should be always visible,
-       * set region start time to 40ms and end time to 24 hours. This allows
-       * the transition finding logic to work cleanly and ensures that
-       * regions with showBackground="always" are visible for [virtually] the
-       * entirety of any real-world stream. */
-      region->begin = (doc_begin != GST_CLOCK_TIME_NONE) ?
-        doc_begin : 40 * GST_MSECOND;
-      region->end = (doc_duration != GST_CLOCK_TIME_NONE) ?
-        region->begin + doc_duration : 24 * 3600 * GST_SECOND;
+  if (!parser->complete && !parser->failed) {
+    xmlParseChunk (parser->ctxt, NULL, 0, 1);
+    if (!parser->complete) {
+      GST_CAT_ERROR (ttmlparse, "Failed to parse document.");
+      parser->failed = TRUE;
     }
   }
+
+  if (!parser->failed) {
+    if (!parser->seen_head)
+      GST_CAT_ERROR (ttmlparse, "No <head> element found.");
+    else if (parser->body)
+      iter = ttml_parser_build_scenes (parser, begin, duration);
+  }
+
+  ttml_parser_end_work (parser);
+  return iter;
 }
 
 
-static xmlNodePtr
-ttml_find_child (xmlNodePtr parent, const gchar * name)
+/* As ttml_parser_finish_iter(), but returns all the scenes of the document
+ * at once, as a list of GstBuffers. */
+GList *
+ttml_parser_finish (TtmlParser * parser, GstClockTime begin,
+    GstClockTime duration)
+{
+  return ttml_scene_iter_collect (ttml_parser_finish_iter (parser, begin,
+          duration));
+}
+
+
+/* Parse the document @input and return an iterator over its scenes, or NULL
+ * if the document could not be parsed or has no scenes. */
+TtmlSceneIter *
+ttml_parse_iter (const gchar * input, GstClockTime begin,
+    GstClockTime duration)
 {
-  xmlNodePtr child = parent->children;
-  while (child && xmlStrcmp (child->name, (const xmlChar *) name) != 0)
-    child = child->next;
-  return child;
+  TtmlParser *parser = ttml_parser_new (NULL);
+  TtmlSceneIter *iter;
+
+  GST_CAT_LOG (ttmlparse, "Input:\n%s", input);
+
+  ttml_parser_feed (parser, input, strlen (input));
+  iter = ttml_parser_finish_iter (parser, begin, duration);
+
+  if (iter)
+    iter->owns_parser = TRUE;
+  else
+    ttml_parser_free (parser);
+
+  return iter;
 }
 
 
@@ -1771,98 +4597,132 @@ GList *
 ttml_parse (const gchar * input, GstClockTime begin,
     GstClockTime duration)
 {
-  xmlDocPtr doc;
-  xmlNodePtr root_node, head_node, body_node;
+  return ttml_scene_iter_collect (ttml_parse_iter (input, begin, duration));
+}
 
-  GHashTable *styles_table = g_hash_table_new_full (g_str_hash, g_str_equal,
-      NULL, (GDestroyNotify) ttml_delete_element);
-  GHashTable *regions_table = g_hash_table_new_full (g_str_hash, g_str_equal,
-      NULL, (GDestroyNotify) ttml_delete_element);
-  GList *output_buffers = NULL;
-  gchar *value;
-  guint cellres_x, cellres_y;
-  TtmlWhitespaceMode doc_whitespace_mode = TTML_WHITESPACE_MODE_DEFAULT;
 
-  GST_DEBUG_CATEGORY_INIT (ttmlparse, "ttmlparse", 0,
-      "TTML parser debug category");
-  GST_CAT_LOG (ttmlparse, "Input:\n%s", input);
+/* Returns a description of why @parser could not return the scenes of its
+ * document, or NULL if the document simply has none. */
+static gchar *
+ttml_parser_describe_error (TtmlParser * parser)
+{
+  if (parser->failed) {
+    xmlErrorPtr err = parser->ctxt ? xmlCtxtGetLastError (parser->ctxt) : NULL;
 
-  /* Parse input. */
-  doc = xmlReadMemory (input, strlen (input), "any_doc_name", NULL,
-      XML_PARSE_NOBLANKS);
-  if (!doc) {
-    GST_CAT_ERROR (ttmlparse, "Failed to parse document.");
-    return NULL;
+    if (err && err->message)
+      return g_strstrip (g_strdup_printf ("Failed to parse document: line "
+              "%d: %s", err->line, err->message));
+    return g_strdup ("Failed to parse document.");
   }
-  root_node = xmlDocGetRootElement (doc);
 
-  if (xmlStrcmp (root_node->name, (const xmlChar *) "tt") != 0) {
-    GST_CAT_ERROR (ttmlparse, "Root element of document is not tt:tt.");
-    xmlFreeDoc (doc);
-    return NULL;
+  if (!parser->seen_head)
+    return g_strdup ("No <head> element found.");
+
+  return NULL;
+}
+
+
+static void
+ttml_parse_batch_file (gpointer data, gpointer user_data)
+{
+  TtmlBatchResult *result = data;
+  TtmlParser *parser;
+  TtmlSceneIter *iter;
+  GstBuffer *buf;
+  GError *error = NULL;
+  gchar *contents;
+  gsize len;
+  gint64 start = g_get_monotonic_time ();
+
+  if (!g_file_get_contents (result->filename, &contents, &len, &error)) {
+    result->error = g_strdup (error->message);
+    g_error_free (error);
+    result->parse_time = (g_get_monotonic_time () - start) * GST_USECOND;
+    return;
   }
 
-  if ((value = ttml_get_xml_property (root_node, "cellResolution"))) {
-    gchar *ptr = value;
-    cellres_x = (guint) g_ascii_strtoull (ptr, &ptr, 10U);
-    cellres_y = (guint) g_ascii_strtoull (ptr, NULL, 10U);
-    g_free (value);
+  parser = ttml_parser_new (NULL);
+  ttml_parser_feed (parser, contents, len);
+  iter = ttml_parser_finish_iter (parser, GST_CLOCK_TIME_NONE,
+      GST_CLOCK_TIME_NONE);
+
+  if (iter) {
+    /* Build every scene, so that the timing reflects the full cost of
+     * processing the document, but keep only the count. */
+    while ((buf = ttml_scene_iter_next (iter))) {
+      ++result->n_scenes;
+      gst_buffer_unref (buf);
+    }
+    ttml_scene_iter_free (iter);
   } else {
-    cellres_x = DEFAULT_CELLRES_X;
-    cellres_y = DEFAULT_CELLRES_Y;
+    result->error = ttml_parser_describe_error (parser);
   }
 
-  GST_CAT_DEBUG (ttmlparse, "cellres_x: %u   cellres_y: %u", cellres_x,
-      cellres_y);
+  ttml_parser_free (parser);
+  g_free (contents);
+  result->parse_time = (g_get_monotonic_time () - start) * GST_USECOND;
+}
 
-  if ((value = ttml_get_xml_property (root_node, "space"))) {
-    if (g_strcmp0 (value, "preserve") == 0) {
-      GST_CAT_DEBUG (ttmlparse, "Preserving whitespace...");
-      doc_whitespace_mode = TTML_WHITESPACE_MODE_PRESERVE;
+
+/* Parse each of the @n_files TTML documents named in @filenames, using up to
+ * @n_threads threads (or one per processor if @n_threads is 0), and return
+ * an array holding the outcome for each, in the same order. Documents in a
+ * batch are processed independently, so the parse of each is itself
+ * sequential. Free the results with ttml_batch_results_free(). */
+TtmlBatchResult *
+ttml_parse_batch (const gchar * const *filenames, guint n_files,
+    guint n_threads)
+{
+  TtmlBatchResult *results = g_new0 (TtmlBatchResult, n_files);
+  GThreadPool *pool = NULL;
+  GError *error = NULL;
+  guint i;
+
+  GST_DEBUG_CATEGORY_INIT (ttmlparse, "ttmlparse", 0,
+      "TTML parser debug category");
+
+  /* libxml2 must be initialized before parsers are created on several
+   * threads at once. */
+  xmlInitParser ();
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+  n_threads = MIN (n_threads, MAX (n_files, 1));
+
+  if (n_threads > 1) {
+    pool = g_thread_pool_new (ttml_parse_batch_file, NULL, n_threads, TRUE,
+        &error);
+    if (!pool) {
+      GST_CAT_WARNING (ttmlparse, "Could not create thread pool: %s",
+          error->message);
+      g_error_free (error);
     }
-    g_free (value);
   }
 
-  if (!(head_node = ttml_find_child (root_node, "head"))) {
-    GST_CAT_ERROR (ttmlparse, "No <head> element found.");
-    xmlFreeDoc (doc);
-    return NULL;
+  for (i = 0; i < n_files; ++i) {
+    results[i].filename = g_strdup (filenames[i]);
+    if (pool)
+      g_thread_pool_push (pool, &results[i], NULL);
+    else
+      ttml_parse_batch_file (&results[i], NULL);
   }
-  ttml_parse_head (head_node, styles_table, regions_table);
 
-  if ((body_node = ttml_find_child (root_node, "body"))) {
-    GNode *body_tree;
-    GList *region_trees = NULL;
-    GList *scenes = NULL;
+  /* Wait for every queued document to be processed. */
+  if (pool)
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+  return results;
+}
 
-    body_tree = ttml_parse_body (body_node);
-    GST_CAT_LOG (ttmlparse, "body_tree tree contains %u nodes.",
-        g_node_n_nodes (body_tree, G_TRAVERSE_ALL));
-    GST_CAT_LOG (ttmlparse, "body_tree tree height is %u",
-        g_node_max_height (body_tree));
 
-    ttml_inherit_whitespace_mode (body_tree, doc_whitespace_mode);
-    ttml_handle_whitespace (body_tree);
-    ttml_resolve_timings (body_tree);
-    ttml_resolve_regions (body_tree);
-    region_trees = ttml_split_body_by_region (body_tree, regions_table);
-    ttml_resolve_referenced_styles (region_trees, styles_table);
-    ttml_inherit_element_styles (region_trees);
-    ttml_assign_region_times (region_trees, begin, duration);
-    scenes = ttml_create_scenes (region_trees);
-    GST_CAT_LOG (ttmlparse, "There are %u scenes in all.",
-        g_list_length (scenes));
-    ttml_attach_scene_metadata (scenes, cellres_x, cellres_y);
-    output_buffers = create_buffer_list (scenes);
-
-    g_list_free_full (scenes, (GDestroyNotify) ttml_delete_scene);
-    g_list_free_full (region_trees, (GDestroyNotify) ttml_delete_tree);
-    ttml_delete_tree (body_tree);
-  }
-
-  xmlFreeDoc (doc);
-  g_hash_table_destroy (styles_table);
-  g_hash_table_destroy (regions_table);
-
-  return output_buffers;
+void
+ttml_batch_results_free (TtmlBatchResult * results, guint n_results)
+{
+  guint i;
+
+  for (i = 0; i < n_results; ++i) {
+    g_free (results[i].filename);
+    g_free (results[i].error);
+  }
+  g_free (results);
 }
@@ -23,6 +23,7 @@
 #ifndef _TTML_PARSE_H_
 #define _TTML_PARSE_H_
 
+#include <gst/subtitle/subtitle.h>
 #include "gstttmlparse.h"
 
 G_BEGIN_DECLS
@@ -30,30 +31,68 @@ G_BEGIN_DECLS
 typedef struct _TtmlStyleSet TtmlStyleSet;
 typedef struct _TtmlElement TtmlElement;
 typedef struct _TtmlScene TtmlScene;
+typedef struct _TtmlParser TtmlParser;
+typedef struct _TtmlHeadCache TtmlHeadCache;
+typedef struct _TtmlSceneIter TtmlSceneIter;
 
 
+/* Flags identifying the styling attributes specified in a TtmlStyleSet. */
+typedef enum {
+  TTML_STYLE_PROP_TEXT_DIRECTION   = (1 << 0),
+  TTML_STYLE_PROP_FONT_FAMILY      = (1 << 1),
+  TTML_STYLE_PROP_FONT_SIZE        = (1 << 2),
+  TTML_STYLE_PROP_LINE_HEIGHT      = (1 << 3),
+  TTML_STYLE_PROP_TEXT_ALIGN       = (1 << 4),
+  TTML_STYLE_PROP_COLOR            = (1 << 5),
+  TTML_STYLE_PROP_BACKGROUND_COLOR = (1 << 6),
+  TTML_STYLE_PROP_FONT_STYLE       = (1 << 7),
+  TTML_STYLE_PROP_FONT_WEIGHT      = (1 << 8),
+  TTML_STYLE_PROP_TEXT_DECORATION  = (1 << 9),
+  TTML_STYLE_PROP_UNICODE_BIDI     = (1 << 10),
+  TTML_STYLE_PROP_WRAP_OPTION      = (1 << 11),
+  TTML_STYLE_PROP_MULTI_ROW_ALIGN  = (1 << 12),
+  TTML_STYLE_PROP_LINE_PADDING     = (1 << 13),
+  TTML_STYLE_PROP_ORIGIN           = (1 << 14),
+  TTML_STYLE_PROP_EXTENT           = (1 << 15),
+  TTML_STYLE_PROP_DISPLAY_ALIGN    = (1 << 16),
+  TTML_STYLE_PROP_OVERFLOW         = (1 << 17),
+  TTML_STYLE_PROP_PADDING          = (1 << 18),
+  TTML_STYLE_PROP_WRITING_MODE     = (1 << 19),
+  TTML_STYLE_PROP_SHOW_BACKGROUND  = (1 << 20)
+} TtmlStyleProp;
+
+
+/* Styling attributes of an element, parsed into typed values when read from
+ * the document. Only those values whose flags are set in @present have been
+ * specified. @font_size and @line_height are percentages, @line_padding is in
+ * cells, and @origin, @extent and @padding (ordered before, end, after,
+ * start) are fractions of the root container region or of the region
+ * respectively. @font_family is allocated from the same arena as the set,
+ * or from the arena of the set it was copied from. Once styling has been
+ * resolved, elements with identical styling share a single, immutable set. */
 struct _TtmlStyleSet {
-  const gchar *text_direction;
+  guint32 present;
+  GstSubtitleTextDirection text_direction;
   const gchar *font_family;
-  const gchar *font_size;
-  const gchar *line_height;
-  const gchar *text_align;
-  const gchar *color;
-  const gchar *background_color;
-  const gchar *font_style;
-  const gchar *font_weight;
-  const gchar *text_decoration;
-  const gchar *unicode_bidi;
-  const gchar *wrap_option;
-  const gchar *multi_row_align;
-  const gchar *line_padding;
-  const gchar *origin;
-  const gchar *extent;
-  const gchar *display_align;
-  const gchar *overflow;
-  const gchar *padding;
-  const gchar *writing_mode;
-  const gchar *show_background;
+  gdouble font_size;
+  gdouble line_height;
+  GstSubtitleTextAlign text_align;
+  GstSubtitleColor color;
+  GstSubtitleColor background_color;
+  GstSubtitleFontStyle font_style;
+  GstSubtitleFontWeight font_weight;
+  GstSubtitleTextDecoration text_decoration;
+  GstSubtitleUnicodeBidi unicode_bidi;
+  GstSubtitleWrapping wrap_option;
+  GstSubtitleMultiRowAlign multi_row_align;
+  gdouble line_padding;
+  gdouble origin[2];
+  gdouble extent[2];
+  GstSubtitleDisplayAlign display_align;
+  GstSubtitleOverflowMode overflow;
+  gdouble padding[4];
+  GstSubtitleWritingMode writing_mode;
+  GstSubtitleBackgroundMode show_background;
 };
 
 
@@ -91,17 +130,98 @@ struct _TtmlElement {
 
 
 /* Represents a static scene consisting of one or more text elements that
- * should be visible over a specific period of time. */
+ * should be visible over a specific period of time. Rather than holding its
+ * own copy of the element trees, a scene lists the pre-order indexes, within
+ * the trees shared by all scenes, of the elements that are visible. */
 struct _TtmlScene {
   GstClockTime begin;
   GstClockTime end;
-  GList *elements;
+  GArray *elements;
   GstBuffer *buf;
 };
 
 
+/* Limits on the resources used to process a single document; see
+ * ttml_parser_set_limits(). @time_budget is the total time spent feeding
+ * the document to the parser and building its scenes. A value of 0 (or
+ * GST_CLOCK_TIME_NONE for @time_budget) means no limit. */
+typedef struct {
+  guint max_depth;
+  guint max_regions;
+  guint max_elements;
+  guint max_scenes;
+  GstClockTime time_budget;
+} TtmlLimits;
+
+
+/* Flags identifying the limits exceeded by a document. */
+typedef enum {
+  TTML_LIMIT_DEPTH    = (1 << 0),
+  TTML_LIMIT_REGIONS  = (1 << 1),
+  TTML_LIMIT_ELEMENTS = (1 << 2),
+  TTML_LIMIT_SCENES   = (1 << 3),
+  TTML_LIMIT_TIME     = (1 << 4)
+} TtmlLimitFlags;
+
+
+/* The outcome of processing one document of a batch with ttml_parse_batch().
+ * @parse_time is the wall-clock time taken to read and parse the document
+ * and to build all of its scenes. @error is NULL unless the document could
+ * not be read or parsed. */
+typedef struct {
+  gchar *filename;
+  guint n_scenes;
+  GstClockTime parse_time;
+  gchar *error;
+} TtmlBatchResult;
+
+
 GList *ttml_parse (const gchar * file, GstClockTime begin,
     GstClockTime duration);
 
+TtmlSceneIter *ttml_parse_iter (const gchar * file, GstClockTime begin,
+    GstClockTime duration);
+
+GstBuffer *ttml_scene_iter_next (TtmlSceneIter * iter);
+
+void ttml_scene_iter_free (TtmlSceneIter * iter);
+
+TtmlHeadCache *ttml_head_cache_new (void);
+
+void ttml_head_cache_free (TtmlHeadCache * cache);
+
+TtmlParser *ttml_parser_new (TtmlHeadCache * head_cache);
+
+void ttml_parser_free (TtmlParser * parser);
+
+void ttml_parser_set_parallel (TtmlParser * parser, gboolean parallel);
+
+void ttml_parser_set_limits (TtmlParser * parser, const TtmlLimits * limits);
+
+TtmlLimitFlags ttml_parser_get_exceeded_limits (TtmlParser * parser);
+
+void ttml_parser_start_document (TtmlParser * parser);
+
+gsize ttml_parser_feed (TtmlParser * parser, const gchar * data, gsize len);
+
+gboolean ttml_parser_is_complete (TtmlParser * parser);
+
+gboolean ttml_parser_has_failed (TtmlParser * parser);
+
+gboolean ttml_parser_has_resumed (TtmlParser * parser);
+
+GList *ttml_parser_finish (TtmlParser * parser, GstClockTime begin,
+    GstClockTime duration);
+
+TtmlSceneIter *ttml_parser_finish_iter (TtmlParser * parser,
+    GstClockTime begin, GstClockTime duration);
+
+TtmlBatchResult *ttml_parse_batch (const gchar * const *filenames,
+    guint n_files, guint n_threads);
+
+void ttml_batch_results_free (TtmlBatchResult * results, guint n_results);
+
+void ttml_collapse_whitespace (gchar * text);
+
 G_END_DECLS
 #endif /* _TTML_PARSE_H_ */
@@ -0,0 +1,74 @@
+/* GStreamer TTML parser benchmarks
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "bench-common.h"
+
+
+/* Parse the command line of a benchmark against @entries and, if given,
+ * @group, of which ownership is taken. Returns FALSE, having printed the
+ * reason, if the command line could not be parsed. */
+gboolean
+bench_parse_options (gint * argc, gchar *** argv,
+    const gchar * parameter_string, const GOptionEntry * entries,
+    GOptionGroup * group)
+{
+  GOptionContext *ctx;
+  GError *error = NULL;
+  gboolean parsed;
+
+  ctx = g_option_context_new (parameter_string);
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  if (group)
+    g_option_context_add_group (ctx, group);
+
+  parsed = g_option_context_parse (ctx, argc, argv, &error);
+  if (!parsed) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+  }
+
+  g_option_context_free (ctx);
+  return parsed;
+}
+
+
+/* Run @func @iterations times and return the shortest time it took, in
+ * microseconds and at least 1, or -1 as soon as any iteration fails. The
+ * best rather than the mean time is taken, as it is the least disturbed by
+ * whatever else is running. */
+gint64
+bench_best_of (guint iterations, BenchFunc func, gpointer user_data)
+{
+  gint64 best = G_MAXINT64;
+  guint i;
+
+  for (i = 0; i < iterations; ++i) {
+    gint64 elapsed = func (user_data);
+
+    if (elapsed < 0)
+      return -1;
+    best = MIN (best, elapsed);
+  }
+
+  return MAX (best, 1);
+}
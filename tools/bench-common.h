@@ -0,0 +1,38 @@
+/* GStreamer TTML parser benchmarks
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Runs one iteration of a benchmark and returns the time it took, in
+ * microseconds, or a negative value if it failed. */
+typedef gint64 (*BenchFunc) (gpointer user_data);
+
+gboolean bench_parse_options (gint * argc, gchar *** argv,
+    const gchar * parameter_string, const GOptionEntry * entries,
+    GOptionGroup * group);
+
+gint64 bench_best_of (guint iterations, BenchFunc func, gpointer user_data);
+
+G_END_DECLS
+#endif /* _BENCH_COMMON_H_ */
@@ -0,0 +1,183 @@
+/* GStreamer TTML batch processing tool
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Parses every TTML document found under a directory, spreading the work
+ * over several threads, and prints a summary of the outcome. Used to
+ * validate archives of subtitle files, e.g.:
+ *
+ *   ttml-batch --threads 8 /path/to/archive
+ *
+ * Exits with a non-zero status if any document could not be parsed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "ttmlparse.h"
+
+static const gchar *extensions[] = { ".ttml", ".xml", ".dfxp", NULL };
+
+
+static gboolean
+is_ttml_filename (const gchar * name)
+{
+  gchar *lower = g_ascii_strdown (name, -1);
+  gboolean ret = FALSE;
+  guint i;
+
+  for (i = 0; extensions[i] && !ret; ++i)
+    ret = g_str_has_suffix (lower, extensions[i]);
+
+  g_free (lower);
+  return ret;
+}
+
+
+/* Append to @filenames the paths of all TTML documents in @dirname and its
+ * subdirectories. */
+static void
+find_ttml_files (const gchar * dirname, GPtrArray * filenames)
+{
+  GError *error = NULL;
+  GDir *dir;
+  const gchar *name;
+
+  dir = g_dir_open (dirname, 0, &error);
+  if (!dir) {
+    g_printerr ("Could not open directory: %s\n", error->message);
+    g_error_free (error);
+    return;
+  }
+
+  while ((name = g_dir_read_name (dir))) {
+    gchar *path = g_build_filename (dirname, name, NULL);
+
+    if (g_file_test (path, G_FILE_TEST_IS_DIR)
+        && !g_file_test (path, G_FILE_TEST_IS_SYMLINK)) {
+      find_ttml_files (path, filenames);
+      g_free (path);
+    } else if (is_ttml_filename (name)) {
+      g_ptr_array_add (filenames, path);
+    } else {
+      g_free (path);
+    }
+  }
+
+  g_dir_close (dir);
+}
+
+
+static gint
+compare_filenames (gconstpointer a, gconstpointer b)
+{
+  return strcmp (*(const gchar **) a, *(const gchar **) b);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  gint n_threads = 0;
+  gboolean verbose = FALSE;
+  GOptionEntry options[] = {
+    {"threads", 'j', 0, G_OPTION_ARG_INT, &n_threads,
+        "Number of documents to parse at once (default: one per processor)",
+        "N"},
+    {"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+        "Print the outcome for every document, not just failures", NULL},
+    {NULL}
+  };
+  GOptionContext *ctx;
+  GError *error = NULL;
+  GPtrArray *filenames;
+  TtmlBatchResult *results;
+  guint i, n_failed = 0;
+  guint64 n_scenes = 0;
+  GstClockTime parse_time = 0, slowest = 0;
+  const gchar *slowest_name = NULL;
+  gint64 start, elapsed;
+
+  ctx = g_option_context_new ("DIRECTORY - parse the TTML documents under "
+      "DIRECTORY");
+  g_option_context_add_main_entries (ctx, options, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (ctx);
+    return 2;
+  }
+  g_option_context_free (ctx);
+
+  if (argc != 2 || n_threads < 0) {
+    g_printerr ("Usage: %s [--threads N] [--verbose] DIRECTORY\n", argv[0]);
+    return 2;
+  }
+
+  filenames = g_ptr_array_new_with_free_func (g_free);
+  find_ttml_files (argv[1], filenames);
+  g_ptr_array_sort (filenames, compare_filenames);
+
+  start = g_get_monotonic_time ();
+  results = ttml_parse_batch ((const gchar * const *) filenames->pdata,
+      filenames->len, n_threads);
+  elapsed = g_get_monotonic_time () - start;
+
+  for (i = 0; i < filenames->len; ++i) {
+    TtmlBatchResult *result = &results[i];
+
+    n_scenes += result->n_scenes;
+    parse_time += result->parse_time;
+    if (result->parse_time >= slowest) {
+      slowest = result->parse_time;
+      slowest_name = result->filename;
+    }
+
+    if (result->error) {
+      ++n_failed;
+      g_print ("FAIL %s: %s\n", result->filename, result->error);
+    } else if (verbose) {
+      g_print ("OK   %s: %u scenes in %.3f ms\n", result->filename,
+          result->n_scenes, (gdouble) result->parse_time / GST_MSECOND);
+    }
+  }
+
+  g_print ("\n");
+  g_print ("Documents:     %u (%u failed)\n", filenames->len, n_failed);
+  g_print ("Scenes:        %" G_GUINT64_FORMAT "\n", n_scenes);
+  g_print ("Wall time:     %.3f s\n", (gdouble) elapsed / G_USEC_PER_SEC);
+  g_print ("Parse time:    %.3f s (sum over documents)\n",
+      (gdouble) parse_time / GST_SECOND);
+  if (filenames->len > 0) {
+    g_print ("Mean time:     %.3f ms per document\n",
+        (gdouble) parse_time / GST_MSECOND / filenames->len);
+    g_print ("Slowest:       %s (%.3f ms)\n", slowest_name,
+        (gdouble) slowest / GST_MSECOND);
+  }
+
+  ttml_batch_results_free (results, filenames->len);
+  g_ptr_array_free (filenames, TRUE);
+
+  return n_failed > 0 ? 1 : 0;
+}
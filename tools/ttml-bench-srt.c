@@ -0,0 +1,228 @@
+/* GStreamer SubRip parsing benchmark
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Measures the time the ttmlparse element takes to parse a large SubRip file
+ * and output every cue. The file is read by a filesrc in a single buffer, so
+ * that the whole text is waiting to be parsed at once. A file of 100000 cues
+ * is generated unless one is given. The element must be installed or found
+ * through GST_PLUGIN_PATH, e.g.:
+ *
+ *   GST_PLUGIN_PATH=gst/parser/.libs ttml-bench-srt --cues 100000
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+
+#include "bench-common.h"
+
+/* A SubRip file to play, and the number of buffers output by its last
+ * playback. */
+typedef struct {
+  const gchar *filename;
+  guint blocksize;
+  guint64 n_buffers;
+} SrtRun;
+
+
+/* Write a SubRip file of @n_cues cues to a new temporary file, returning its
+ * name, or NULL on error. */
+static gchar *
+write_srt_file (guint n_cues, GError ** error)
+{
+  GString *srt = g_string_new (NULL);
+  gchar *filename = NULL;
+  gboolean written;
+  guint i;
+  gint fd;
+
+  for (i = 0; i < n_cues; ++i) {
+    guint64 begin = (guint64) i * 2000, end = begin + 1500;
+
+    g_string_append_printf (srt, "%u\n"
+        "%02u:%02u:%02u,%03u --> %02u:%02u:%02u,%03u\n"
+        "Subtitle number %u,\n<i>with a second line</i>\n\n", i + 1,
+        (guint) (begin / 3600000), (guint) (begin / 60000 % 60),
+        (guint) (begin / 1000 % 60), (guint) (begin % 1000),
+        (guint) (end / 3600000), (guint) (end / 60000 % 60),
+        (guint) (end / 1000 % 60), (guint) (end % 1000), i + 1);
+  }
+
+  fd = g_file_open_tmp ("ttml-bench-XXXXXX.srt", &filename, error);
+  if (fd >= 0) {
+    g_close (fd, NULL);
+    written = g_file_set_contents (filename, srt->str, srt->len, error);
+    if (!written) {
+      g_unlink (filename);
+      g_free (filename);
+      filename = NULL;
+    }
+  }
+
+  g_string_free (srt, TRUE);
+  return filename;
+}
+
+
+static GstPadProbeReturn
+count_buffer (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  ++*(guint64 *) user_data;
+  return GST_PAD_PROBE_OK;
+}
+
+
+/* Play the file of @user_data through filesrc and ttmlparse into a
+ * fakesink, counting the buffers output. Returns the time taken from the
+ * start of playback to EOS, or -1 on error. */
+static gint64
+time_pipeline (gpointer user_data)
+{
+  SrtRun *run = user_data;
+  GstElement *pipeline, *src, *parse, *sink;
+  GstPad *pad;
+  GstBus *bus;
+  GstMessage *msg;
+  gint64 start, elapsed = -1;
+
+  src = gst_element_factory_make ("filesrc", NULL);
+  parse = gst_element_factory_make ("ttmlparse", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  if (!src || !parse || !sink) {
+    g_printerr ("Could not create the filesrc, ttmlparse and fakesink "
+        "elements\n");
+    if (src)
+      gst_object_unref (src);
+    if (parse)
+      gst_object_unref (parse);
+    if (sink)
+      gst_object_unref (sink);
+    return -1;
+  }
+
+  g_object_set (src, "location", run->filename, "blocksize", run->blocksize,
+      NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  pipeline = gst_pipeline_new (NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, parse, sink, NULL);
+  gst_element_link_many (src, parse, sink, NULL);
+
+  run->n_buffers = 0;
+  pad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, count_buffer,
+      &run->n_buffers, NULL);
+  gst_object_unref (pad);
+
+  bus = gst_element_get_bus (pipeline);
+  start = g_get_monotonic_time ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+  if (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS) {
+    elapsed = g_get_monotonic_time () - start;
+  } else {
+    GError *error = NULL;
+
+    gst_message_parse_error (msg, &error, NULL);
+    g_printerr ("Pipeline error: %s\n", error->message);
+    g_error_free (error);
+  }
+
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  return elapsed;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  gint n_cues = 100000, iterations = 3;
+  GOptionEntry options[] = {
+    {"cues", 'n', 0, G_OPTION_ARG_INT, &n_cues,
+        "Number of cues in the generated file (default: 100000)", "N"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of times to play the file (default: 3)", "N"},
+    {NULL}
+  };
+  GError *error = NULL;
+  gchar *filename;
+  gboolean generated = FALSE, failed = FALSE;
+  GStatBuf st;
+  SrtRun run;
+  gint64 best = -1;
+
+  if (!bench_parse_options (&argc, &argv,
+          "[FILE] - measure SubRip parsing by ttmlparse", options,
+          gst_init_get_option_group ()))
+    return 2;
+
+  if (argc > 2 || n_cues <= 0 || iterations <= 0) {
+    g_printerr ("Usage: %s [--cues N] [--iterations N] [FILE]\n", argv[0]);
+    return 2;
+  }
+
+  if (argc == 2) {
+    filename = g_strdup (argv[1]);
+  } else if ((filename = write_srt_file (n_cues, &error))) {
+    generated = TRUE;
+  } else {
+    g_printerr ("Could not write SubRip file: %s\n", error->message);
+    g_error_free (error);
+    return 1;
+  }
+
+  if (g_stat (filename, &st) != 0 || st.st_size == 0
+      || st.st_size > G_MAXUINT) {
+    g_printerr ("Could not read a SubRip file from %s\n", filename);
+    failed = TRUE;
+  } else {
+    run.filename = filename;
+    run.blocksize = st.st_size;
+    best = bench_best_of (iterations, time_pipeline, &run);
+    failed = (best < 0);
+  }
+
+  if (!failed) {
+    g_print ("File:          %s\n", filename);
+    g_print ("Size:          %.2f MB (%.1f MB/s)\n",
+        (gdouble) st.st_size / 1e6, (gdouble) st.st_size / best);
+    g_print ("Cues output:   %" G_GUINT64_FORMAT "\n", run.n_buffers);
+    g_print ("Time:          %.3f ms\n", (gdouble) best / 1000.0);
+    g_print ("Throughput:    %.0f cues/s\n",
+        (gdouble) run.n_buffers * G_USEC_PER_SEC / best);
+    if (generated && run.n_buffers != (guint64) n_cues) {
+      g_printerr ("Expected %d cues\n", n_cues);
+      failed = TRUE;
+    }
+  }
+
+  if (generated)
+    g_unlink (filename);
+  g_free (filename);
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,157 @@
+/* GStreamer TTML time expression benchmark
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Measures the throughput of the TTML time expression parser. A document is
+ * generated whose paragraphs carry begin and end attributes in every form of
+ * the time expression grammar, and is fed to the TTML parser; the same
+ * document with those attributes renamed, so that they are ignored, is fed
+ * too. The difference between the two is the cost of parsing the time
+ * expressions, e.g.:
+ *
+ *   ttml-bench-time --elements 100000 --iterations 10
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "bench-common.h"
+#include "ttmlparse.h"
+
+/* With a frame rate of 25, a sub-frame rate of 2 and a tick rate of 10^7. */
+static const gchar *expressions[] = {
+  "00:01:02.345",
+  "01:02:03",
+  "01:02:03:12",
+  "01:02:03:12.1",
+  "12.5s",
+  "1500ms",
+  "3.25m",
+  "0.01h",
+  "250f",
+  "10000000t",
+};
+
+
+/* Returns a document of @n_elements paragraphs, whose begin and end
+ * attributes are named so as to be parsed if @timed is set, and ignored
+ * otherwise. */
+static gchar *
+make_document (guint n_elements, gboolean timed)
+{
+  const gchar *begin_name = timed ? "begin" : "begix";
+  const gchar *end_name = timed ? "end" : "enx";
+  GString *doc = g_string_new (NULL);
+  guint i;
+
+  g_string_append (doc, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      "<tt xmlns=\"http://www.w3.org/ns/ttml\" "
+      "xmlns:ttp=\"http://www.w3.org/ns/ttml#parameter\" "
+      "ttp:frameRate=\"25\" ttp:subFrameRate=\"2\" "
+      "ttp:tickRate=\"10000000\">\n<body><div>\n");
+
+  for (i = 0; i < n_elements; ++i) {
+    const gchar *expr = expressions[i % G_N_ELEMENTS (expressions)];
+
+    g_string_append_printf (doc, "<p %s=\"%s\" %s=\"%s\">x</p>\n",
+        begin_name, expr, end_name, expr);
+  }
+
+  g_string_append (doc, "</div></body></tt>\n");
+  return g_string_free (doc, FALSE);
+}
+
+
+/* Returns the time taken to feed @doc to a new parser, or -1 if the document
+ * could not be parsed. */
+static gint64
+time_feed (gpointer user_data)
+{
+  const gchar *doc = user_data;
+  TtmlParser *parser = ttml_parser_new (NULL);
+  gint64 start, elapsed;
+  gboolean complete;
+
+  start = g_get_monotonic_time ();
+  ttml_parser_feed (parser, doc, strlen (doc));
+  elapsed = g_get_monotonic_time () - start;
+  complete = ttml_parser_is_complete (parser)
+      && !ttml_parser_has_failed (parser);
+  ttml_parser_free (parser);
+
+  return complete ? elapsed : -1;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  gint n_elements = 100000, iterations = 5;
+  GOptionEntry options[] = {
+    {"elements", 'n', 0, G_OPTION_ARG_INT, &n_elements,
+        "Number of timed paragraphs in the document (default: 100000)", "N"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of times to parse each document (default: 5)", "N"},
+    {NULL}
+  };
+  gchar *timed_doc, *untimed_doc;
+  gint64 timed, untimed;
+  guint64 n_expressions;
+
+  if (!bench_parse_options (&argc, &argv,
+          "- measure TTML time expression parsing", options,
+          gst_init_get_option_group ()))
+    return 2;
+
+  if (argc != 1 || n_elements <= 0 || iterations <= 0) {
+    g_printerr ("Usage: %s [--elements N] [--iterations N]\n", argv[0]);
+    return 2;
+  }
+
+  timed_doc = make_document (n_elements, TRUE);
+  untimed_doc = make_document (n_elements, FALSE);
+  timed = bench_best_of (iterations, time_feed, timed_doc);
+  untimed = bench_best_of (iterations, time_feed, untimed_doc);
+  g_free (timed_doc);
+  g_free (untimed_doc);
+
+  if (timed < 0 || untimed < 0) {
+    g_printerr ("The generated document could not be parsed\n");
+    return 1;
+  }
+
+  n_expressions = 2 * (guint64) n_elements;
+  g_print ("Expressions:   %" G_GUINT64_FORMAT "\n", n_expressions);
+  g_print ("Timed:         %.3f ms\n", (gdouble) timed / 1000.0);
+  g_print ("Untimed:       %.3f ms\n", (gdouble) untimed / 1000.0);
+  if (timed > untimed) {
+    g_print ("Per expression: %.1f ns\n",
+        (gdouble) (timed - untimed) * 1000.0 / n_expressions);
+    g_print ("Throughput:    %.2f M expressions/s\n",
+        (gdouble) n_expressions / (timed - untimed));
+  } else {
+    g_print ("Per expression: below measurement noise\n");
+  }
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+/* GStreamer subtitle UTF-8 validation benchmark
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Compares the throughput of the parser's UTF-8 validator,
+ * text_encoding_validate_utf8(), with that of g_utf8_validate() on text of
+ * differing mixes of characters, and checks that the two agree on where
+ * each text stops being valid, e.g.:
+ *
+ *   ttml-bench-utf8 --size 64 --iterations 20
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib.h>
+#include <string.h>
+
+#include "bench-common.h"
+#include "textencoding.h"
+
+/* Each sample is repeated to fill the text; a sample ending in an invalid
+ * byte is used only once, at the end of the text. */
+typedef struct {
+  const gchar *name;
+  const gchar *sample;
+  const gchar *tail;
+} Utf8Sample;
+
+static const Utf8Sample samples[] = {
+  { "ASCII", "The quick brown fox jumps over the lazy dog.\n", "" },
+  { "Latin", "Voix ambigu\xc3\xab d'un c\xc5\x93ur qui, au z\xc3\xa9phyr, "
+        "pr\xc3\xa9" "f\xc3\xa8re les jattes de kiwis.\n", "" },
+  { "CJK", "\xe5\xad\x97\xe5\xb9\x95\xe3\x81\xae\xe3\x83\x86\xe3\x82\xb9"
+        "\xe3\x83\x88\xe3\x80\x82\n", "" },
+  { "4-byte", "\xf0\x9f\x8e\xac\xf0\x9f\x8e\xa5 ", "" },
+  { "bad tail", "The quick brown fox jumps over the lazy dog.\n", "\xc3" },
+};
+
+
+/* Returns @size bytes of @sample repeated, followed by @tail. */
+static gchar *
+make_text (const Utf8Sample * sample, gsize size, gsize * len)
+{
+  gsize sample_len = strlen (sample->sample);
+  GString *text = g_string_sized_new (size + 8);
+
+  while (text->len + sample_len <= size)
+    g_string_append_len (text, sample->sample, sample_len);
+  g_string_append (text, sample->tail);
+
+  *len = text->len;
+  return g_string_free (text, FALSE);
+}
+
+
+typedef gboolean (*ValidateFunc) (const gchar * str, gsize len,
+    const gchar ** end);
+
+static gboolean
+validate_glib (const gchar * str, gsize len, const gchar ** end)
+{
+  return g_utf8_validate (str, len, end);
+}
+
+
+/* A validator run over a text; @end is set to where it stopped. */
+typedef struct {
+  ValidateFunc func;
+  const gchar *text;
+  gsize len;
+  const gchar *end;
+} ValidateRun;
+
+
+/* Returns the time taken by one validation of the text of @user_data. */
+static gint64
+time_validate (gpointer user_data)
+{
+  ValidateRun *run = user_data;
+  gint64 start = g_get_monotonic_time ();
+
+  run->func (run->text, run->len, &run->end);
+  return g_get_monotonic_time () - start;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  gint size_mib = 16, iterations = 10;
+  GOptionEntry options[] = {
+    {"size", 's', 0, G_OPTION_ARG_INT, &size_mib,
+        "Size of each text, in MiB (default: 16)", "MIB"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of times to validate each text (default: 10)", "N"},
+    {NULL}
+  };
+  gboolean mismatch = FALSE;
+  guint i;
+
+  if (!bench_parse_options (&argc, &argv, "- compare UTF-8 validators",
+          options, NULL))
+    return 2;
+
+  if (argc != 1 || size_mib <= 0 || iterations <= 0) {
+    g_printerr ("Usage: %s [--size MIB] [--iterations N]\n", argv[0]);
+    return 2;
+  }
+
+  g_print ("%-10s %14s %14s %8s\n", "Text", "parser (MB/s)", "GLib (MB/s)",
+      "Speedup");
+
+  for (i = 0; i < G_N_ELEMENTS (samples); ++i) {
+    ValidateRun parser_run = { text_encoding_validate_utf8 };
+    ValidateRun glib_run = { validate_glib };
+    gint64 parser_time, glib_time;
+    gsize len;
+    gchar *text;
+
+    text = make_text (&samples[i], (gsize) size_mib * 1024 * 1024, &len);
+    parser_run.text = glib_run.text = text;
+    parser_run.len = glib_run.len = len;
+    parser_time = bench_best_of (iterations, time_validate, &parser_run);
+    glib_time = bench_best_of (iterations, time_validate, &glib_run);
+
+    g_print ("%-10s %14.1f %14.1f %7.2fx\n", samples[i].name,
+        (gdouble) len / parser_time, (gdouble) len / glib_time,
+        (gdouble) glib_time / parser_time);
+
+    if (parser_run.end != glib_run.end) {
+      g_printerr ("%s: validators disagree: parser stopped at byte %"
+          G_GSIZE_FORMAT ", GLib at byte %" G_GSIZE_FORMAT "\n",
+          samples[i].name, (gsize) (parser_run.end - text),
+          (gsize) (glib_run.end - text));
+      mismatch = TRUE;
+    }
+    g_free (text);
+  }
+
+  return mismatch ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/* GStreamer TTML whitespace handling benchmark
+ * Copyright (C) <2015> British Broadcasting Corporation
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Measures the time taken by ttml_collapse_whitespace() to normalise texts
+ * of pathological whitespace, at sizes doubling up to a maximum. The time
+ * per byte stays flat as long as whitespace is handled in linear time,
+ * e.g.:
+ *
+ *   ttml-bench-whitespace --max-size 8192
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <string.h>
+
+#include "bench-common.h"
+#include "ttmlparse.h"
+
+#define MIN_SIZE (64 * 1024)
+
+/* Each pattern is repeated to fill the text. */
+typedef struct {
+  const gchar *name;
+  const gchar *unit;
+} WhitespacePattern;
+
+static const WhitespacePattern patterns[] = {
+  { "short runs", "a  " },
+  { "long runs", "a                                                       "
+        "                                                                "
+        "                                                                "
+        "                                                                " },
+  { "linefeeds", "\xc3\xa9\n \n" },
+  { "only spaces", " " },
+};
+
+
+/* Returns a text of at most @size bytes holding @unit repeated. */
+static gchar *
+make_text (const gchar * unit, gsize size)
+{
+  GString *text = g_string_sized_new (size + 1);
+  gsize unit_len = strlen (unit);
+
+  while (text->len + unit_len <= size)
+    g_string_append_len (text, unit, unit_len);
+
+  return g_string_free (text, FALSE);
+}
+
+
+/* Returns the time taken to collapse the whitespace of a copy of @text; the
+ * copy is made outside the timed section. */
+static gint64
+time_collapse (gpointer user_data)
+{
+  const gchar *text = user_data;
+  gchar *copy = g_strdup (text);
+  gint64 start, elapsed;
+
+  start = g_get_monotonic_time ();
+  ttml_collapse_whitespace (copy);
+  elapsed = g_get_monotonic_time () - start;
+  g_free (copy);
+
+  return elapsed;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  gint max_kib = 4096, iterations = 3;
+  GOptionEntry options[] = {
+    {"max-size", 's', 0, G_OPTION_ARG_INT, &max_kib,
+        "Largest text to normalise, in KiB (default: 4096)", "KIB"},
+    {"iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+        "Number of times to normalise each text (default: 3)", "N"},
+    {NULL}
+  };
+  guint i;
+
+  if (!bench_parse_options (&argc, &argv,
+          "- measure TTML whitespace handling", options, NULL))
+    return 2;
+
+  if (argc != 1 || (gint64) max_kib * 1024 < MIN_SIZE || iterations <= 0) {
+    g_printerr ("Usage: %s [--max-size KIB] [--iterations N]\n", argv[0]);
+    return 2;
+  }
+
+  g_print ("%-12s %10s %12s %10s\n", "Pattern", "Size (KiB)", "Time (ms)",
+      "ns/byte");
+
+  for (i = 0; i < G_N_ELEMENTS (patterns); ++i) {
+    gsize size;
+
+    for (size = MIN_SIZE; size <= (gsize) max_kib * 1024; size *= 2) {
+      gchar *text = make_text (patterns[i].unit, size);
+      gint64 elapsed = bench_best_of (iterations, time_collapse, text);
+
+      g_free (text);
+      g_print ("%-12s %10" G_GSIZE_FORMAT " %12.3f %10.2f\n",
+          patterns[i].name, size / 1024, (gdouble) elapsed / 1000.0,
+          (gdouble) elapsed * 1000.0 / size);
+    }
+  }
+
+  return 0;
+}